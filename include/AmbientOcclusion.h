@@ -0,0 +1,13 @@
+#pragma once
+#include <vector>
+#include "Mesh.h"
+
+/**
+ * @brief Bakes ambient occlusion into the occlusion attribute of each vertex, by tracing
+ * cosine-distributed rays from each vertex over its normal's hemisphere and counting how many of them
+ * hit the rest of the mesh. Vertices are processed on all hardware threads.
+ * @param rayCount the number of rays traced from each vertex.
+ * @param maxDistance rays that travel this far without hitting anything count as unoccluded.
+ */
+void bakeAmbientOcclusion(std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
+	uint32_t rayCount, float maxDistance);
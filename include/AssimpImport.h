@@ -5,9 +5,40 @@
 #include <filesystem>
 #include <string>
 
-Object3D assimpLoad(const std::string& path, bool flipUVCoords);
+/**
+ * @brief Optional processing steps applied to each mesh while it is imported.
+ */
+struct AssimpImportOptions {
+	// Bake per-vertex ambient occlusion into each mesh, by ray tracing the mesh on the CPU. Meshes
+	// whose Vertex3D list is empty, as it is until fromAssimpMesh fills it in, are not baked.
+	bool bakeAmbientOcclusion{ false };
+	// The number of occlusion rays traced from each vertex.
+	uint32_t occlusionRays{ 64 };
+	// How far an occlusion ray travels before it counts as unoccluded, as a fraction of the
+	// diagonal of the mesh's bounding box.
+	float occlusionDistance{ 0.25f };
+
+	// Generate lightmap texture coordinates for each mesh, packed for a lightmap of this many texels
+	// on a side, so the mesh can be baked by LightmapBaker (which also needs retainGeometry). 0 skips
+	// this step.
+	uint32_t lightmapResolution{ 0 };
+
+	// Keep a CPU copy of each mesh's triangles, with a BVH over them, so the imported object can be
+	// ray cast with Object3D::raycast.
+	bool retainGeometry{ false };
+
+	// Build a simplified occluder proxy of each mesh, so the imported object hides what is behind
+	// it from the CPU occlusion test. Only worthwhile for large, solid meshes.
+	bool buildOccluders{ false };
+	// The resolution of the vertex-clustering grid used to simplify occluders, in cells along the
+	// longest side of each mesh's bounding box.
+	uint32_t occluderGridResolution{ 16 };
+};
+
+Object3D assimpLoad(const std::string& path, bool flipUVCoords, const AssimpImportOptions& options = {});
 Object3D processAssimpNode(
 	const aiNode* node, 
 	const aiScene* scene,
 	const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures);
\ No newline at end of file
+	std::unordered_map<std::string, Texture>& loadedTextures,
+	const AssimpImportOptions& options);
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstddef>
+#include <limits>
+
+/**
+ * @brief An axis-aligned bounding box. A default-constructed box is empty, and grows to fit
+ * whatever is added to it.
+ */
+struct BoundingBox {
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+	bool isEmpty() const;
+	glm::vec3 center() const;
+	// Half of the box's size along each axis.
+	glm::vec3 halfExtent() const;
+
+	void grow(const glm::vec3& point);
+	void grow(const BoundingBox& other);
+
+	/**
+	 * @brief Returns the smallest axis-aligned box that contains this box after it is transformed by
+	 * the given matrix.
+	 */
+	BoundingBox transformed(const glm::mat4& matrix) const;
+};
+
+/**
+ * @brief A bounding sphere. A negative radius means the sphere is empty.
+ */
+struct BoundingSphere {
+	glm::vec3 center{};
+	float radius{ -1 };
+};
+
+/**
+ * @brief Computes the bounding box of a list of positions, each made of three floats, that are
+ * "stride" bytes apart. Uses SIMD min/max where it is available.
+ */
+BoundingBox computeBoundingBox(const float* positions, size_t count, size_t stride);
+
+/**
+ * @brief Computes a bounding sphere of a list of positions, centered on their bounding box.
+ */
+BoundingSphere computeBoundingSphere(const float* positions, size_t count, size_t stride, const BoundingBox& box);
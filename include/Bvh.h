@@ -0,0 +1,114 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The closest intersection of a ray with a Bvh's triangles.
+ */
+struct BvhHit {
+	// The distance along the ray, in multiples of the ray direction's length.
+	float distance;
+	// The index of the triangle that was hit, counting triangles in the order of the original face list.
+	uint32_t triangle;
+	// The barycentric coordinates of the hit point, relative to the triangle's second and third vertices.
+	float u;
+	float v;
+};
+
+/**
+ * @brief A bounding volume hierarchy over the triangles of a mesh, for ray casts and overlap queries
+ * against the mesh on the CPU.
+ *
+ * The tree is built top-down with a binned surface area heuristic, with large subtrees built on
+ * separate threads, and is then collapsed into nodes with four children each. The four child boxes
+ * of a node are stored component-by-component so that a ray or sphere is tested against all four with
+ * one set of SIMD operations.
+ */
+class Bvh {
+private:
+	struct alignas(16) Node {
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+		// For an interior child, the index of its node. For a leaf child, the index of its first
+		// triangle in m_triangles. EMPTY for an unused slot.
+		uint32_t child[4];
+		// The number of triangles in a leaf child, or 0 for an interior child.
+		uint32_t count[4];
+	};
+
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+		uint32_t id;
+	};
+
+	// Temporary structures used while building the tree.
+	struct BuildNode;
+	struct BuildState;
+
+	std::vector<Node> m_nodes{};
+	std::vector<Triangle> m_triangles{};
+
+	// Splits the node and its descendants until every leaf is small enough. If parallelSubtrees is
+	// given, nodes below a size threshold are added to it instead of being split.
+	static void buildSubtree(BuildNode& root, BuildState& state, std::vector<BuildNode*>* parallelSubtrees);
+	// Splits one node in two by the surface area heuristic. Returns false if the node should be a leaf.
+	static bool splitNode(BuildNode& node, BuildState& state);
+	// Converts a binary subtree into 4-wide nodes, and returns the index of its root node.
+	uint32_t flatten(const BuildNode& node, const BuildState& state);
+
+	// Test a ray or a sphere against all four child boxes of a node at once, and return a bit mask
+	// of the children that were hit.
+	static uint32_t rayHitsChildren(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+		float maxDistance, float entryDistances[4]);
+	static uint32_t sphereHitsChildren(const Node& node, const glm::vec3& center, float radius);
+	static bool intersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction,
+		float& distance, float& u, float& v);
+
+public:
+	static constexpr uint32_t EMPTY{ 0xffffffff };
+
+	/**
+	 * @brief Builds a BVH over a triangle list.
+	 * @param positions the position of each vertex.
+	 * @param faces three vertex indices for each triangle. Throws if any index is not less than
+	 * positions.size().
+	 */
+	Bvh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces);
+
+	/**
+	 * @brief Finds the closest triangle hit by the ray from origin along direction, at a distance
+	 * less than maxDistance. The direction does not need to be normalized; distances are measured
+	 * in multiples of its length. Returns false if nothing was hit.
+	 */
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const;
+
+	/**
+	 * @brief Finds the first triangle hit by the line segment from start to end.
+	 * The hit distance is the fraction of the way from start to end.
+	 */
+	bool intersectSegment(const glm::vec3& start, const glm::vec3& end, BvhHit& hit) const;
+
+	/**
+	 * @brief Returns true if the ray from origin along direction hits any triangle at a distance
+	 * less than maxDistance. Cheaper than raycast, since it stops at the first hit it finds.
+	 */
+	bool occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+	/**
+	 * @brief Appends the index of every triangle that overlaps the given sphere.
+	 */
+	void overlapSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& triangles) const;
+
+	/**
+	 * @brief Returns the point on triangle abc that is closest to p.
+	 */
+	static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+		const glm::vec3& c);
+};
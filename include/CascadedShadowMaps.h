@@ -0,0 +1,104 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+#include "Object3D.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+
+/**
+ * @brief Shadows of a directional light over the camera's view, in CASCADES depth maps that each cover
+ * a farther and larger slice of the view frustum, sampled by the SHADOWS variant of lighting.frag.
+ *
+ * Every cascade is cached in two layers. The static layer holds only the objects marked static with
+ * Object3D::setStatic, and is re-rendered only when the light turns, a static object moves, or the
+ * cascade's region moves. The shadow layer is a copy of the static layer with the other, dynamic
+ * objects drawn over it, and is refreshed every frame for the nearest cascades and every few frames
+ * for the farther ones, whose texels cover more of the world and change less from frame to frame.
+ *
+ * A cascade's region is a square around its slice's bounding sphere, snapped to a grid in the light's
+ * space and padded by one grid step, so the camera can move and turn within a step without the region
+ * moving. The casters are drawn with the depth prepass programs, depth_only.vert and depth_only.frag.
+ */
+class CascadedShadowMaps {
+public:
+	static constexpr uint32_t CASCADES{ 4 };
+	// The texture unit the shadow map array is bound to.
+	static constexpr uint32_t SHADOW_UNIT{ 12 };
+
+private:
+	// Cascade i is redrawn every UPDATE_INTERVALS[i] frames when nothing forces it sooner.
+	static constexpr uint32_t UPDATE_INTERVALS[CASCADES]{ 1, 1, 2, 4 };
+
+	struct Cascade {
+		// The light-space center and half-size of the cascade's square region.
+		glm::vec3 center{ 0 };
+		float halfSize{ 0 };
+		// The light view->shadow clip and world->shadow clip matrices the layers were last drawn with.
+		glm::mat4 projection{ 1 };
+		glm::mat4 viewProjection{ 1 };
+		// The view-space distance where the cascade's slice of the view ends.
+		float splitDepth{ 0 };
+		bool staticValid{ false };
+	};
+
+	ShaderProgram* m_depthProgram;
+	ShaderProgram* m_instancedDepthProgram;
+	uint32_t m_resolution;
+	float m_shadowDistance;
+	Cascade m_cascades[CASCADES]{};
+	glm::vec3 m_lightDirection{ 0, -1, 0 };
+	glm::mat4 m_lightView{ 1 };
+	uint32_t m_frame{ 0 };
+
+	// Depth texture arrays of CASCADES layers each.
+	uint32_t m_shadowTexture{ 0 };
+	uint32_t m_staticTexture{ 0 };
+	uint32_t m_drawFramebuffer{ 0 };
+	uint32_t m_readFramebuffer{ 0 };
+	RenderQueue m_queue{};
+
+	// Fits cascade "index" to the slice of the view between two view-space depths, returning true
+	// if its region moved.
+	bool fitCascade(uint32_t index, const glm::mat4& inverseView, const glm::mat4& projection, float nearDepth,
+		float farDepth);
+	// Draws the static or the dynamic objects into one layer of a texture array.
+	void drawCasters(uint32_t texture, uint32_t layer, const Cascade& cascade, std::vector<Object3D>& objects,
+		bool staticCasters, bool clear, DrawUniformRing& drawUniforms);
+
+public:
+	/**
+	 * @param depthProgram and instancedDepthProgram the programs the casters are drawn with, which
+	 * must outlive the shadow maps.
+	 * @param resolution the width and height of each cascade's map.
+	 * @param shadowDistance how far from the camera shadows reach.
+	 */
+	CascadedShadowMaps(ShaderProgram& depthProgram, ShaderProgram& instancedDepthProgram, uint32_t resolution = 2048,
+		float shadowDistance = 50);
+
+	/**
+	 * @brief Points the light along a new direction (the "I" vector, from the light). Changing it
+	 * re-renders every cascade.
+	 */
+	void setLightDirection(const glm::vec3& direction);
+
+	/**
+	 * @brief Marks the static layers out of date, e.g. after a static object moved.
+	 */
+	void invalidateStatic();
+
+	/**
+	 * @brief Refits the cascades to a frame's camera and redraws those that are due. The default
+	 * framebuffer and viewport are bound again afterward, and drawUniforms is left with the camera's
+	 * view-projection.
+	 */
+	void update(const glm::mat4& view, const glm::mat4& projection, std::vector<Object3D>& objects,
+		DrawUniformRing& drawUniforms);
+
+	/**
+	 * @brief Binds the shadow maps and sets the uniforms that locate them in the given program, which
+	 * is left active.
+	 */
+	void bind(ShaderProgram& program) const;
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+ * @brief A point or spot light, shaded by the CLUSTERED_LIGHTS variant of lighting.frag.
+ */
+struct Light {
+	glm::vec3 position;
+	// The distance at which the light's contribution falls to zero.
+	float range;
+	glm::vec3 color;
+	// A spot light shines along this unit vector. Point lights ignore it.
+	glm::vec3 direction{ 0, 0, -1 };
+	// Cosines of the spot cone's angles: full intensity inside the inner cone, fading to none at the
+	// outer cone. The defaults of -1 make a point light.
+	float innerCosine{ -1 };
+	float outerCosine{ -1 };
+};
+
+/**
+ * @brief Assigns lights to the clusters of a 3D grid over the view frustum, so that each fragment only
+ * shades the lights whose range reaches its cluster rather than every light in the scene.
+ *
+ * The grid divides the screen into CLUSTERS_X x CLUSTERS_Y tiles and the depth between the near and
+ * far planes into CLUSTERS_Z slices of exponentially increasing thickness. It is rebuilt on the CPU
+ * every frame: each slice is handed to a thread of the shared WorkerPool (or, for a few lights, all of
+ * them to the calling thread), which tests the lights' bounding spheres against four clusters'
+ * view-space boxes at a time with SSE. The light list of every cluster is then
+ * uploaded to texture buffers, which lighting.frag reads with texelFetch:
+ * - clusterLights (RGBA32F): three texels per light, as packed by update().
+ * - clusterGrid (RG32UI): the offset and count of each cluster's run of clusterLightIndices.
+ * - clusterLightIndices (R32UI): the lights of every cluster, one run after another.
+ */
+class ClusteredLighting {
+public:
+	static constexpr uint32_t CLUSTERS_X{ 16 };
+	static constexpr uint32_t CLUSTERS_Y{ 9 };
+	static constexpr uint32_t CLUSTERS_Z{ 24 };
+	// Lights past this many in one cluster are dropped from it.
+	static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER{ 128 };
+
+	// The texture units the three buffers are bound to, above the ones meshes use for their own textures.
+	static constexpr uint32_t LIGHTS_UNIT{ 13 };
+	static constexpr uint32_t GRID_UNIT{ 14 };
+	static constexpr uint32_t INDICES_UNIT{ 15 };
+
+private:
+	static constexpr uint32_t CLUSTERS_PER_SLICE{ CLUSTERS_X * CLUSTERS_Y };
+	static constexpr uint32_t CLUSTER_COUNT{ CLUSTERS_PER_SLICE * CLUSTERS_Z };
+
+	// The view-space box of each cluster, split by component so SSE can load four clusters at once.
+	// Depth is measured as the positive distance in front of the camera.
+	struct ClusterBounds {
+		std::vector<float> minX, minY, minDepth;
+		std::vector<float> maxX, maxY, maxDepth;
+	};
+
+	ClusterBounds m_bounds{};
+	// The projection m_bounds was built for; they are only rebuilt when it changes.
+	glm::mat4 m_boundsProjection{ 0 };
+	float m_near{ 0 };
+	float m_far{ 0 };
+	glm::vec2 m_tileSize{ 0 };
+
+	// The lights' view-space bounding spheres, for the slice tests.
+	std::vector<glm::vec4> m_viewSpheres{};
+	// Each cluster's lights, in a fixed-size list of MAX_LIGHTS_PER_CLUSTER, and how many it has.
+	std::vector<uint32_t> m_clusterLights{};
+	std::vector<uint32_t> m_clusterCounts{};
+
+	std::vector<glm::vec4> m_lightTexels{};
+	std::vector<uint32_t> m_grid{};
+	std::vector<uint32_t> m_indices{};
+
+	uint32_t m_lightBuffer{ 0 };
+	uint32_t m_gridBuffer{ 0 };
+	uint32_t m_indexBuffer{ 0 };
+	uint32_t m_lightTexture{ 0 };
+	uint32_t m_gridTexture{ 0 };
+	uint32_t m_indexTexture{ 0 };
+
+	// Rebuilds m_bounds for a symmetric perspective projection.
+	void buildBounds(const glm::mat4& projection);
+	// Assigns the lights to the clusters of one depth slice.
+	void assignSlice(uint32_t slice);
+	// Replaces the contents of a texture buffer.
+	static void upload(uint32_t buffer, const void* data, size_t size);
+
+public:
+	ClusteredLighting();
+
+	/**
+	 * @brief Rebuilds the grid for a frame's camera and uploads it with the lights.
+	 * @param viewport the size in pixels of the framebuffer the frame is drawn to.
+	 */
+	void update(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+		const glm::uvec2& viewport);
+
+	/**
+	 * @brief Binds the grid's texture buffers and sets the uniforms that locate them in the given
+	 * program, which is left active.
+	 */
+	void bind(ShaderProgram& program) const;
+
+	/**
+	 * @brief The total length of every cluster's light list in the last update.
+	 */
+	size_t getAssignmentCount() const;
+};
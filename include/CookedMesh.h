@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "Mesh.h"
+
+/**
+ * @brief A mesh's vertices and faces in the compressed "cooked" format, which is stored on disk
+ * and decoded directly into the mesh's vertex and element buffers.
+ *
+ * Both streams are split into fixed-size blocks that decode independently, so a large mesh decodes
+ * on several threads at once. Inside a block, each 32-bit word of a vertex is stored as the
+ * difference from the same word of the previous vertex, and each index as the difference from the
+ * previous index. Differences are zigzag-mapped (so small negative values stay small) and written as
+ * base-128 varints, one to five bytes each.
+ */
+class CookedMesh {
+private:
+	uint32_t m_vertexCount{ 0 };
+	uint32_t m_faceCount{ 0 };
+	BoundingBox m_bounds{};
+	BoundingSphere m_boundingSphere{};
+	// Byte offsets into m_data where each block starts, plus one final entry for the end of the stream.
+	std::vector<uint64_t> m_vertexBlocks{};
+	std::vector<uint64_t> m_faceBlocks{};
+	std::vector<uint8_t> m_data{};
+
+public:
+	/**
+	 * @brief The number of vertices in one block of the vertex stream.
+	 */
+	static constexpr uint32_t VERTICES_PER_BLOCK{ 8192 };
+	/**
+	 * @brief The number of indices in one block of the face stream.
+	 */
+	static constexpr uint32_t INDICES_PER_BLOCK{ 3 * 8192 };
+
+	/**
+	 * @brief Compresses a list of vertices and faces.
+	 */
+	static CookedMesh encode(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces);
+
+	/**
+	 * @brief Reads a cooked mesh file that was written by saveToFile. Throws if the file is missing,
+	 * truncated, or was cooked with a different Vertex3D layout. The header's counts and sizes are
+	 * checked against the file before anything is allocated for them.
+	 */
+	static CookedMesh loadFromFile(const std::filesystem::path& path);
+
+	void saveToFile(const std::filesystem::path& path) const;
+
+	uint32_t getVertexCount() const;
+	uint32_t getFaceCount() const;
+	// The bounds of the vertices, computed when the mesh was cooked.
+	const BoundingBox& getBounds() const;
+	const BoundingSphere& getBoundingSphere() const;
+	/**
+	 * @brief The number of bytes of compressed vertex and index data.
+	 */
+	size_t getEncodedSize() const;
+
+	/**
+	 * @brief Decodes every vertex into the given memory, which must have room for getVertexCount()
+	 * vertices. Blocks are decoded on multiple threads, and each thread writes its vertices in
+	 * order, so the destination may be write-combined memory from glMapBufferRange.
+	 * @param positions if not null, also receives each vertex's position, for a position-only stream.
+	 */
+	void decodeVertices(Vertex3D* destination, glm::vec3* positions = nullptr) const;
+	/**
+	 * @brief Decodes every index into the given memory, which must have room for getFaceCount() indices.
+	 * Throws if the data is corrupt, including if an index is not less than getVertexCount().
+	 */
+	void decodeFaces(uint32_t* destination) const;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include "ShaderProgram.h"
+
+/**
+ * @brief Renders a scene in two passes: a geometry pass that writes each pixel's surface into a
+ * G-buffer, and a lighting pass that shades every pixel once from the G-buffer with a full-screen
+ * triangle. The cost of lighting then depends on the number of pixels and the lights that reach
+ * them, not on how many triangles were drawn over each pixel.
+ *
+ * The G-buffer is kept small, 16 bytes per pixel:
+ * - albedo (RGBA8): the base texture's color, and the baked occlusion in alpha.
+ * - normal (RG16): the world-space normal, octahedral-encoded.
+ * - material (RGBA8): the ambient, diffuse, and specular coefficients, and log2(shininess) / 8.
+ * - depth (DEPTH24_STENCIL8): from which the lighting pass rebuilds world positions.
+ *
+ * The geometry pass is drawn with a program writing those three outputs, such as gbuffer.frag. The
+ * lighting pass reads them as "gBufferAlbedo", "gBufferNormal", "gBufferMaterial", and "gBufferDepth".
+ */
+class DeferredRenderer {
+private:
+	uint32_t m_framebuffer{ 0 };
+	uint32_t m_albedoTexture{ 0 };
+	uint32_t m_normalTexture{ 0 };
+	uint32_t m_materialTexture{ 0 };
+	uint32_t m_depthTexture{ 0 };
+	glm::uvec2 m_size{ 0, 0 };
+	// A vertex array with no attributes, which the full-screen triangle needs bound to be drawn.
+	uint32_t m_emptyVertexArray{ 0 };
+
+	// Reallocates the G-buffer's textures for a new size.
+	void resize(const glm::uvec2& size);
+
+public:
+	DeferredRenderer();
+
+	/**
+	 * @brief Binds and clears the G-buffer, sized to match a framebuffer of the given size. Draws
+	 * issued afterward are the geometry pass.
+	 */
+	void beginGeometryPass(const glm::uvec2& size);
+
+	/**
+	 * @brief Draws the lighting pass into the default framebuffer with the given program, then copies
+	 * the G-buffer's depth there, so that forward-rendered draws afterward are hidden correctly.
+	 * @param viewProjection the world->clip matrix the geometry pass was drawn with.
+	 */
+	void shade(ShaderProgram& lightingProgram, const glm::mat4& viewProjection);
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include "Bounds.h"
+
+/**
+ * @brief Where a bounding box lies relative to a frustum.
+ */
+enum class Containment : uint8_t {
+	Outside,
+	Intersecting,
+	Inside
+};
+
+/**
+ * @brief Counts of the frustum tests made while collecting a frame's draws.
+ */
+struct CullingStats {
+	// The number of bounding boxes tested against the frustum.
+	uint32_t tested{ 0 };
+	// The number found outside the frustum, whose objects or meshes were skipped.
+	uint32_t culled{ 0 };
+	// The number found entirely inside the frustum, whose subtrees were accepted without more tests.
+	uint32_t accepted{ 0 };
+	// The number inside the frustum but hidden behind occluders.
+	uint32_t occluded{ 0 };
+};
+
+/**
+ * @brief The six planes of a view frustum in world space, for culling bounding boxes that cannot
+ * be seen by the camera.
+ */
+class Frustum {
+private:
+	// Each plane is (a, b, c, d) with ax + by + cz + d >= 0 inside the frustum.
+	glm::vec4 m_planes[6];
+
+public:
+	/**
+	 * @brief Extracts the frustum planes from a world->clip matrix (projection * view).
+	 */
+	explicit Frustum(const glm::mat4& viewProjection);
+
+	Containment classify(const BoundingBox& box) const;
+
+	/**
+	 * @brief Classifies up to four boxes at once, testing each plane against all of them with one
+	 * set of SIMD operations. Empty boxes are Outside.
+	 */
+	void classify4(const BoundingBox* const boxes[4], uint32_t count, Containment results[4]) const;
+
+	/**
+	 * @brief The six planes, as (a, b, c, d) with ax + by + cz + d >= 0 inside the frustum.
+	 */
+	const glm::vec4* getPlanes() const;
+};
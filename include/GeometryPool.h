@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include "Mesh.h"
+
+/**
+ * @brief Where a mesh's vertices and indices were copied to in a GeometryPool, in the form a
+ * DrawElementsIndirectCommand wants.
+ */
+struct GeometryRange {
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t indexCount;
+};
+
+/**
+ * @brief One vertex buffer and one element buffer holding the geometry of many meshes, behind a
+ * single vertex array, so that draws of different meshes can be issued by one multi-draw call.
+ *
+ * Meshes are copied in on the GPU the first time they are added; the meshes keep their own buffers.
+ */
+class GeometryPool {
+private:
+	uint32_t m_vao{ 0 };
+	uint32_t m_vertexBuffer{ 0 };
+	uint32_t m_elementBuffer{ 0 };
+	// The meshes' position-only streams, behind a second vertex array that shares the element buffer.
+	uint32_t m_positionVao{ 0 };
+	uint32_t m_positionBuffer{ 0 };
+	uint32_t m_vertexCount{ 0 };
+	uint32_t m_vertexCapacity{ 0 };
+	uint32_t m_indexCount{ 0 };
+	uint32_t m_indexCapacity{ 0 };
+	// The range of each mesh that has been added, by the mesh's vertex array.
+	std::unordered_map<uint32_t, GeometryRange> m_ranges{};
+
+	// Grows the buffers, if needed, to hold the given number of additional vertices and indices.
+	void reserve(uint32_t vertices, uint32_t indices);
+
+public:
+	/**
+	 * @brief Returns the mesh's range in the pool, copying the mesh in if it is not there yet.
+	 */
+	const GeometryRange& add(const Mesh& mesh);
+
+	/**
+	 * @brief The vertex array of the pool, with attributes 0 through 3 laid out as Vertex3D.
+	 */
+	uint32_t getVertexArray() const;
+
+	/**
+	 * @brief The position-only vertex array of the pool, with the positions as attribute 0. Vertices and
+	 * indices are numbered the same as in getVertexArray().
+	 */
+	uint32_t getPositionVertexArray() const;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+ * @brief Culls instanced draws on the GPU with a compute shader, on OpenGL 4.3 contexts.
+ *
+ * Each instance is a bounding sphere, the index of the indirect command that draws it, and an
+ * InstanceTransform in an instance buffer. The shader tests every sphere against the view frustum and against a
+ * depth pyramid built from the previous frame's depth buffer, then counts each survivor into its
+ * command's instanceCount with an atomic add and copies its transform to the command's slice of a
+ * compacted transform buffer. The draw reads the commands and matrices straight from the GPU, so no
+ * visibility results come back to the CPU.
+ *
+ * Using the previous frame's depth lets an object that was hidden last frame stay hidden for one
+ * frame after it appears; the pyramid is rebuilt every frame, so it never lags further than that.
+ */
+class GpuCulling {
+private:
+	// The std430 layout of one instance in cull_instances.comp.
+	struct Instance {
+		glm::vec4 sphere;
+		uint32_t command;
+		uint32_t padding[3];
+	};
+
+	ShaderProgram m_cullProgram;
+	ShaderProgram m_pyramidProgram;
+	UniformHandle<int32_t> m_instanceCountUniform{};
+	UniformHandle<glm::vec4> m_frustumPlanesUniform{};
+	UniformHandle<bool> m_useDepthPyramidUniform{};
+	UniformHandle<int32_t> m_depthPyramidLevelsUniform{};
+	UniformHandle<glm::mat4> m_previousViewProjectionUniform{};
+	UniformHandle<int32_t> m_sourceLevelUniform{};
+	UniformHandle<bool> m_copyDepthUniform{};
+
+	std::vector<Instance> m_instances{};
+	uint32_t m_instanceBuffer{ 0 };
+	size_t m_instanceCapacity{ 0 };
+	uint32_t m_visibleBuffer{ 0 };
+	size_t m_visibleCapacity{ 0 };
+
+	// The previous frame's depth buffer is blitted into m_depthTexture, then reduced into the pyramid.
+	uint32_t m_depthFramebuffer{ 0 };
+	uint32_t m_depthTexture{ 0 };
+	uint32_t m_pyramidTexture{ 0 };
+	uint32_t m_width{ 0 };
+	uint32_t m_height{ 0 };
+	uint32_t m_levels{ 0 };
+	// The world->clip matrix the pyramid's depths were rendered with.
+	glm::mat4 m_pyramidViewProjection{ 1 };
+	bool m_hasPyramid{ false };
+
+	// Recreates the depth texture and pyramid for a new window size.
+	void resize(uint32_t width, uint32_t height);
+
+public:
+	/**
+	 * @brief Whether the context can run the culling shaders, which need OpenGL 4.3.
+	 */
+	static bool isSupported();
+
+	/**
+	 * @param cullProgram a compute program loaded from cull_instances.comp.
+	 * @param pyramidProgram a compute program loaded from depth_pyramid.comp.
+	 */
+	GpuCulling(ShaderProgram cullProgram, ShaderProgram pyramidProgram);
+
+	/**
+	 * @brief Empties the instance list for a new frame.
+	 */
+	void clear();
+
+	/**
+	 * @brief Adds the next instance. Instances must be added in the order of their transforms in the
+	 * instance buffer given to cull().
+	 * @param sphere the instance's world-space bounding sphere, as center and radius.
+	 * @param command the index of the indirect command that draws the instance.
+	 */
+	void addInstance(const glm::vec4& sphere, uint32_t command);
+
+	/**
+	 * @brief Culls the added instances. The commands in commandBuffer must have an instanceCount of 0
+	 * and a baseInstance at the start of their instances' transforms; on return, the GPU has been told to
+	 * fill in the count of visible instances, and to copy their transforms to the returned buffer.
+	 * @param instanceTransforms a buffer holding one InstanceTransform per added instance.
+	 * @return the buffer that the visible instances' transforms are written to.
+	 */
+	uint32_t cull(const glm::mat4& viewProjection, uint32_t instanceTransforms, uint32_t commandBuffer);
+
+	/**
+	 * @brief Builds the depth pyramid from the default framebuffer's depth, for the next frame's
+	 * call to cull(). Call after the frame's opaque draws.
+	 * @param viewProjection the world->clip matrix the frame was rendered with.
+	 */
+	void buildDepthPyramid(uint32_t width, uint32_t height, const glm::mat4& viewProjection);
+};
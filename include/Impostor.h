@@ -0,0 +1,57 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+
+class Object3D;
+
+/**
+ * @brief A pre-rendered stand-in for a distant object. The object is rendered once, from a ring of
+ * directions around its local up axis, into atlases of color, normal, and depth. When the object is
+ * far away, it is drawn as a single camera-facing quad that blends the two captured views closest to
+ * the direction it is seen from. Programs built with LIGHTING light the captured color with the
+ * captured normals, so a lit scene's impostors still respond to its directional light.
+ */
+class Impostor {
+private:
+	uint32_t m_colorTexture;
+	uint32_t m_normalTexture;
+	uint32_t m_depthTexture;
+	uint32_t m_viewCount;
+	// The views are laid out in a square grid with this many columns.
+	uint32_t m_columns;
+	// Undoes the normal matrix of the object's world matrix when it was captured, so that captured
+	// normals can be turned to follow the object.
+	glm::mat3 m_captureNormalInverse;
+
+	Impostor(uint32_t colorTexture, uint32_t normalTexture, uint32_t depthTexture, uint32_t viewCount,
+		uint32_t columns, const glm::mat3& captureNormalInverse);
+
+	// The atlas offset (xy) and scale (zw) of a view's tile.
+	glm::vec4 tileOf(uint32_t view) const;
+
+public:
+	/**
+	 * @brief Renders an object into a new impostor. The object's meshes are drawn with captureProgram,
+	 * which must write color to output 0 and a normal to output 1. The frame uniforms are left
+	 * holding the last captured view, so they must be updated again before the next frame is drawn.
+	 * @param viewCount the number of directions in the ring of captured views.
+	 * @param viewResolution the width and height of each captured view, in pixels.
+	 */
+	static Impostor capture(Object3D& object, ShaderProgram& captureProgram, FrameUniformBuffer& frameUniforms,
+		DrawUniformRing& drawUniforms, uint32_t viewCount = 16,
+		uint32_t viewResolution = 256);
+
+	/**
+	 * @brief Draws the impostor in place of the object, using a program built from impostor.vert and
+	 * impostor.frag. The frame uniforms must already hold the camera, and a LIGHTING program must
+	 * already have its light uniforms set.
+	 * @param object the object this impostor was captured from, whose world matrix and bounds must be up to date.
+	 */
+	void render(ShaderProgram& impostorProgram, const Object3D& object, const glm::vec3& cameraPos) const;
+
+	uint32_t getColorTexture() const;
+	uint32_t getNormalTexture() const;
+	uint32_t getDepthTexture() const;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+#include "Object3D.h"
+
+/**
+ * @brief Gives every vertex of a mesh lightmap texture coordinates (lu, lv), so that each point of
+ * the mesh's surface has its own texel in a lightmap of resolution x resolution texels.
+ *
+ * Triangles are grouped into charts of neighbors facing within about 35 degrees of the chart's first
+ * triangle, and each chart is projected flat onto the plane facing that triangle's normal. The charts'
+ * bounding rectangles are then packed into the lightmap in rows, at the largest scale at which they
+ * all fit, with a gap of a few texels between them so that filtering does not blend neighboring
+ * charts. Vertices shared by two charts are duplicated, so the vertex and face lists both change.
+ *
+ * A mesh with no vertices is left as it is. Throws if a face refers to a vertex past the end of the list.
+ */
+void generateLightmapCharts(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& faces, uint32_t resolution);
+
+/**
+ * @brief The light that a LightmapBaker bakes.
+ */
+struct LightmapBakeSettings {
+	// The direction of the directional light (the "I" vector, from the light), and its color.
+	glm::vec3 sunDirection{ 0, -1, 0 };
+	glm::vec3 sunColor{ 1, 1, 1 };
+	// The light arriving from every direction that does not hit the scene.
+	glm::vec3 skyColor{ 0.2f, 0.2f, 0.2f };
+	// The fraction of light surfaces reflect at each bounce. Textures are not sampled while baking,
+	// so every surface reflects the same gray.
+	float bounceAlbedo{ 0.5f };
+	// The paths traced from each texel, and the number of times each bounces off the scene.
+	uint32_t samplesPerTexel{ 128 };
+	uint32_t bounces{ 2 };
+};
+
+/**
+ * @brief Bakes the light of a static scene into a lightmap texture for each mesh, so that static
+ * geometry is lit at runtime by one texture fetch, whatever the number of lights.
+ *
+ * Every texel covered by a mesh's lightmap charts stores the light arriving at its point on the
+ * surface, weighted by the cosine of its angle to the normal: the directional light if the point can
+ * see it, and the sky and the light bounced off other surfaces, found by tracing cosine-distributed
+ * paths through a BVH over the whole scene. Texels are traced on all hardware threads. Each
+ * lightmap is attached to its mesh as a texture for the "lightmap" sampler of the LIGHTMAP variant
+ * of lighting.frag, which uses it in place of the ambient and directional light.
+ */
+class LightmapBaker {
+private:
+	struct Receiver {
+		Mesh* mesh;
+		glm::mat4 world;
+		uint32_t resolution;
+	};
+	// One texel's point on a receiver's surface.
+	struct TexelSample {
+		uint32_t texel;
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	LightmapBakeSettings m_settings;
+	std::vector<Receiver> m_receivers{};
+	// The triangles of every added mesh, in world space.
+	std::vector<glm::vec3> m_positions{};
+	std::vector<uint32_t> m_faces{};
+
+	void addRecursive(Object3D& object, uint32_t resolution);
+	// Finds the point of each covered texel of a receiver's lightmap.
+	std::vector<TexelSample> rasterize(const Receiver& receiver, std::vector<uint8_t>& covered) const;
+
+public:
+	explicit LightmapBaker(const LightmapBakeSettings& settings);
+
+	/**
+	 * @brief Adds an object's hierarchy to the scene, both to receive a lightmap and to block and
+	 * reflect the light reaching other objects. Every mesh with vertices must retain its geometry and
+	 * have lightmap coordinates packed for the given resolution; meshes without any are skipped. The
+	 * object's world matrices must be up to date. The object must not move in memory until bake is called.
+	 */
+	void add(Object3D& object, uint32_t resolution);
+
+	/**
+	 * @brief Bakes the lightmaps of every added mesh and attaches them to the meshes.
+	 */
+	void bake();
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Texture.h"
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+
+/**
+ * @brief The surface of a mesh: its Phong parameters and the textures bound to its samplers. Materials
+ * are only created by MaterialLibrary, which shares one Material between every mesh that looks the same.
+ */
+struct Material {
+	// Ambient, diffuse, and specular coefficients and shininess.
+	glm::vec4 parameters{ 0.1f, 1.0f, 0.3f, 4.0f };
+	std::vector<Texture> textures{};
+	// The material's element of the "Materials" uniform block's array.
+	uint32_t index{ 0 };
+	// The index of the first material that binds the same textures to the same samplers, which may
+	// be this one. Materials whose base textures are layers of the same array share a group.
+	uint32_t bindingGroup{ 0 };
+
+	/**
+	 * @brief Binds each texture to the texture unit of its position in the list, and points its
+	 * sampler at that unit.
+	 */
+	void bindTextures(ShaderProgram& program) const;
+	/**
+	 * @brief Returns true if bindTextures would bind the same textures as the other material's,
+	 * whatever the layers and rectangles of them the two use.
+	 */
+	bool sameBindings(const Material& other) const;
+};
+
+/**
+ * @brief Every distinct material in the program, and the "Materials" uniform buffer that holds their
+ * parameters. Meshes with equal parameters and textures share one Material, so a draw only needs the
+ * material's index, and draws sorted by material bind each set of textures once.
+ *
+ * Before new materials are first drawn, their "baseTexture" textures are moved into texture arrays
+ * and atlases by packTextureArrays, and the shaders find each material's layer and rectangle in its
+ * "Materials" element. Materials whose base textures share an array then bind the same textures, and
+ * draws of them follow one another without rebinding any.
+ *
+ * Materials are never removed; the buffer only grows, and only new or repacked materials are uploaded.
+ */
+class MaterialLibrary {
+public:
+	// The length of the "Materials" block's array. This matches the length of the shaders' array.
+	static constexpr uint32_t MAX_MATERIALS{ 256 };
+	// The sampler whose textures are packed into arrays.
+	static constexpr const char* BASE_TEXTURE_SAMPLER{ "baseTexture" };
+
+private:
+	// Held as mutable so that packing can move their textures into arrays in place; everyone else
+	// sees them as const.
+	static inline std::vector<std::shared_ptr<Material>> s_materials{};
+	static inline uint32_t s_buffer{ 0 };
+	// The number of materials whose elements in the buffer are up to date.
+	static inline size_t s_uploaded{ 0 };
+	// The number of materials whose base textures were packed.
+	static inline size_t s_packed{ 0 };
+
+	// Finds the binding group of a material from the materials before it.
+	static void assignBindingGroup(Material& material);
+	// Packs the base textures of the materials created since the last packing into texture arrays,
+	// deleting the 2D textures that no material binds any more.
+	static void packNewTextures();
+
+public:
+	/**
+	 * @brief Returns the material with the given parameters and textures, creating it if no equal one
+	 * exists. Throws if the library already holds MAX_MATERIALS materials.
+	 */
+	static std::shared_ptr<const Material> intern(const glm::vec4& parameters, std::vector<Texture> textures);
+
+	/**
+	 * @brief Packs the base textures of any materials created since the last call, uploads their
+	 * elements, and binds the buffer to MATERIAL_UNIFORM_BINDING. Call it before drawing.
+	 */
+	static void bind();
+
+	static size_t size();
+};
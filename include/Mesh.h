@@ -1,10 +1,14 @@
 #pragma once
 #include <glm/ext.hpp>
 #include <glad/glad.h>
+#include <memory>
 #include <vector>
 
 #include "Texture.h"
+#include "Material.h"
 #include "ShaderProgram.h"
+#include "Bvh.h"
+#include "Bounds.h"
 struct Vertex3D {
 	float x;
 	float y;
@@ -16,14 +20,76 @@ struct Vertex3D {
 
 	float u;
 	float v;
+
+	// Ambient occlusion baked at import time: 1 for fully open, 0 for fully occluded.
+	float occlusion{ 1 };
+
+	// Lightmap texture coordinates from generateLightmapCharts. Unlike u and v, no two points of the
+	// surface share them.
+	float lu{ 0 };
+	float lv{ 0 };
+};
+
+/**
+ * @brief A CPU-side copy of a mesh's triangles, with a BVH over them for ray casts and other
+ * spatial queries in the mesh's local space.
+ */
+struct RetainedGeometry {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> lightmapCoords;
+	std::vector<uint32_t> faces;
+	Bvh bvh;
 };
 
+/**
+ * @brief A low-polygon stand-in for a mesh's shape, drawn into the CPU occlusion buffer to hide
+ * whatever is behind the mesh.
+ */
+struct OccluderProxy {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> faces;
+};
+
+class CookedMesh;
+
 class Mesh {
 private:
 	uint32_t m_vao;
-	std::vector<Texture> m_textures;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
+	// A second vertex array over just the vertices' positions, for depth-only passes.
+	uint32_t m_positionVao;
+	uint32_t m_positionVbo;
+	// Shared with every other mesh of the same parameters and textures.
+	std::shared_ptr<const Material> m_material;
 	uint32_t m_vertexCount;
 	uint32_t m_faceCount;
+	// The mesh's extent in its local space.
+	BoundingBox m_bounds;
+	BoundingSphere m_boundingSphere;
+	// Null unless retainGeometry was called. Shared, since copies of a Mesh share its GPU buffers too.
+	std::shared_ptr<const RetainedGeometry> m_geometry;
+	// Null unless the mesh was given an occluder proxy.
+	std::shared_ptr<const OccluderProxy> m_occluder;
+
+	/**
+	 * @brief Constructs a Mesh whose buffers are allocated, but not yet filled.
+	*/
+	Mesh(uint32_t vertexCount, uint32_t faceCount, std::vector<Texture> textures);
+
+	/**
+	 * @brief Creates the VAO and its vertex and element buffers, copying the given vertices and faces
+	 * into them. If the pointers are null, the buffers are allocated but left uninitialized.
+	*/
+	void createBuffers(const Vertex3D* vertices, const uint32_t* faces);
+
+	/**
+	 * @brief Creates the position-only vertex array, with the positions in their own tightly packed
+	 * buffer as attribute 0 and the same element buffer as the main vertex array. If the pointer is
+	 * null, the buffer is allocated but left uninitialized.
+	*/
+	void createPositionStream(const glm::vec3* positions);
 
 public:
 	/**
@@ -31,15 +97,75 @@ public:
 	*/
 	Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces);
 	Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces, std::vector<Texture> textures);
+	Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces, std::shared_ptr<const Material> material);
 
 
 	void addTexture(Texture texture);
 	void addTextures(std::vector<Texture> textures);
 
+	/**
+	 * @brief The mesh's material. Adding textures replaces it with the material that has the extra
+	 * textures, so other meshes that shared the old one are not changed.
+	*/
+	const Material& getMaterial() const;
+	void setMaterial(std::shared_ptr<const Material> material);
+	/**
+	 * @brief Replaces the mesh's material with the one of the same textures and new parameters.
+	*/
+	void setMaterialParameters(const glm::vec4& parameters);
+
+	/**
+	 * @brief The mesh's local-space bounding box and sphere.
+	*/
+	const BoundingBox& getBounds() const;
+	const BoundingSphere& getBoundingSphere() const;
+	/**
+	 * @brief Replaces the bounds computed from the mesh's vertices, for meshes whose vertices were
+	 * not all available at construction.
+	*/
+	void setBounds(const BoundingBox& bounds, const BoundingSphere& sphere);
+
+	/**
+	 * @brief Keeps a CPU copy of the mesh's triangles and builds a BVH over them, so the mesh can be
+	 * ray cast. The vertices and faces must be the ones the mesh was constructed from. Throws if the
+	 * faces refer to vertices that are not in the list.
+	*/
+	void retainGeometry(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces);
+	/**
+	 * @brief The mesh's retained CPU geometry, or nullptr if it was not retained.
+	*/
+	const RetainedGeometry* getGeometry() const;
+
+	/**
+	 * @brief Makes the mesh an occluder, which hides meshes behind it from the CPU occlusion test.
+	*/
+	void setOccluder(std::shared_ptr<const OccluderProxy> occluder);
+	/**
+	 * @brief The mesh's occluder proxy, or nullptr if it is not an occluder.
+	*/
+	const OccluderProxy* getOccluder() const;
+
+	// The GL state a draw of this mesh needs.
+	uint32_t getVertexArray() const;
+	uint32_t getVertexBuffer() const;
+	uint32_t getElementBuffer() const;
+	// The position-only vertex array and its buffer of glm::vec3 positions.
+	uint32_t getPositionVertexArray() const;
+	uint32_t getPositionBuffer() const;
+	uint32_t getVertexCount() const;
+	uint32_t getFaceCount() const;
+	const std::vector<Texture>& getTextures() const;
+
 	/**
 	 * @brief Constructs a 1x1 square centered at the origin in world space.
 	*/
 	static Mesh square(std::vector<Texture> textures);
+
+	/**
+	 * @brief Constructs a Mesh from a cooked (compressed) mesh. The vertex and element buffers are
+	 * mapped, and the cooked data is decoded straight into them on worker threads.
+	*/
+	static Mesh fromCooked(const CookedMesh& cooked, std::vector<Texture> textures);
 	
 	/**
 	 * @brief Renders the mesh to the given context.
@@ -48,5 +174,29 @@ public:
 	 * @param proj the view->clip projection matrix.
 	*/
 	void render(ShaderProgram& program) const;
+
+	/**
+	 * @brief Binds the mesh's textures to their samplers, without drawing.
+	*/
+	void bindTextures(ShaderProgram& program) const;
+
+	/**
+	 * @brief Renders several instances of the mesh in one draw call. The per-instance attributes
+	 * must already be set up on the mesh's vertex array.
+	*/
+	void renderInstanced(ShaderProgram& program, uint32_t instanceCount) const;
+
+	/**
+	 * @brief Draws the mesh without binding its textures, for a caller that already bound them,
+	 * e.g. for an earlier draw of the same material. With instanceCount > 0, the draw is instanced.
+	*/
+	void renderWithoutTextures(uint32_t instanceCount = 0) const;
+
+	/**
+	 * @brief Renders the mesh from its position-only vertex array, binding no textures, for a pass
+	 * that only writes depth. With instanceCount > 0, the draw is instanced, and the per-instance
+	 * attributes must already be set up on the position-only vertex array.
+	*/
+	void renderDepth(uint32_t instanceCount = 0) const;
 	
 };
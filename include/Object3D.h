@@ -2,6 +2,38 @@
 #include <memory>
 #include "ShaderProgram.h"
 #include "Mesh.h"
+#include "UniformBuffers.h"
+#include "Frustum.h"
+#include "Occlusion.h"
+
+class Object3D;
+class Impostor;
+class RenderQueue;
+
+/**
+ * @brief The closest intersection of a world-space ray with an object hierarchy.
+ */
+struct RayHit {
+	// The world-space distance from the ray's origin to the hit point.
+	float distance;
+	glm::vec3 position;
+	// The world-space normal of the triangle that was hit.
+	glm::vec3 normal;
+	const Object3D* object;
+	const Mesh* mesh;
+	// The index of the triangle within the mesh's face list.
+	uint32_t triangle;
+};
+
+/**
+ * @brief A triangle that overlaps a world-space sphere.
+ */
+struct SphereHit {
+	const Object3D* object;
+	const Mesh* mesh;
+	uint32_t triangle;
+};
+
 class Object3D {
 private:
 	// The object's list of meshes and children.
@@ -20,7 +52,8 @@ private:
 	// than the local space origin.
 	glm::vec3 m_center{};
 
-	// The object's material parameters (ambient, diffuse, specular, shininess).
+	// The object's material parameters (ambient, diffuse, specular, shininess), given to the
+	// materials of its own meshes by setMaterial.
 	glm::vec4 m_material{0.1, 1.0, 0.3, 4};
 
 	// The object's base transformation matrix, which is used by some model formats to set a "starting" 
@@ -30,9 +63,41 @@ private:
 	// Some objects from Assimp imports have a "name" field, useful for debugging.
 	std::string m_name{};
 
+	// The object's local->world matrix and the world-space bounds of it and all its descendants,
+	// as of the last call to updateHierarchy.
+	glm::mat4 m_worldMatrix{ 1 };
+	BoundingBox m_worldBounds{};
+	// The world-space bounds of each mesh in m_meshes.
+	std::vector<BoundingBox> m_meshWorldBounds{};
+	// Set whenever the object's own transformation or list of children changes, so the next
+	// updateHierarchy knows to recompute it.
+	bool m_transformDirty{ true };
+	// Whether the object and its descendants are static scenery, which shadow maps may cache.
+	bool m_static{ false };
+
+	// An optional pre-rendered stand-in, drawn instead of this hierarchy when the camera is farther
+	// than m_impostorDistance from the object's bounds.
+	std::shared_ptr<const Impostor> m_impostor{};
+	float m_impostorDistance{ 0 };
+
 	// Recomputes the local->world transformation matrix.
 	glm::mat4 buildModelMatrix() const;
 
+	// Spatial queries against this object and its children, given the parent's model matrix.
+	bool raycastRecursive(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, RayHit& hit,
+		const glm::mat4& parentModel) const;
+	void overlapSphereRecursive(const glm::vec3& center, float radius, std::vector<SphereHit>& hits,
+		const glm::mat4& parentModel) const;
+
+	// Updates the world matrix and bounds of this object and its children. Returns true if anything
+	// in this subtree changed, which means the parent's bounds must be recomputed as well.
+	bool updateHierarchy(const glm::mat4& parentWorld, bool parentChanged);
+
+	// Collects the draws of an object whose bounds are known not to be outside the frustum. If
+	// "inside" is true, the whole subtree is inside and is collected without further tests.
+	void collectVisible(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum,
+		const OcclusionBuffer* occlusion, CullingStats& stats, bool inside) const;
+
 
 public:
 	// No default constructor; you must have a mesh to initialize an object.
@@ -49,6 +114,11 @@ public:
 	const std::string& getName() const;
 	const glm::vec4& getMaterial() const;
 
+	// Mesh access.
+	size_t numberOfMeshes() const;
+	const Mesh& getMesh(size_t index) const;
+	Mesh& getMesh(size_t index);
+
 	// Child management.
 	size_t numberOfChildren() const;
 	const Object3D& getChild(size_t index) const;
@@ -62,6 +132,12 @@ public:
 	void setCenter(glm::vec3 center);
 	void setName(std::string name);
 	void setMaterial(glm::vec4 material);
+	/**
+	 * @brief Marks the object and all of its descendants as static scenery, which is expected to move
+	 * rarely if ever, so that CascadedShadowMaps can cache its shadows.
+	 */
+	void setStatic(bool isStatic);
+	bool isStatic() const;
 
 	// Transformations.
 	void move(const glm::vec3& offset);
@@ -69,7 +145,63 @@ public:
 	void grow(const glm::vec3& growth);
 	void addChild(Object3D child);
 
+	// World-space state, maintained by updateHierarchy.
+	/**
+	 * @brief Recomputes the world matrices and world-space bounds of every object in this hierarchy
+	 * whose transformation (or an ancestor's) changed since the last update. Call it on each
+	 * root object once per frame, after moving objects and before using their world-space state.
+	 * Returns true if anything in the hierarchy moved.
+	 */
+	bool updateHierarchy();
+	const glm::mat4& getWorldMatrix() const;
+	/**
+	 * @brief The world-space bounding box of this object's meshes and all of its descendants.
+	 */
+	const BoundingBox& getWorldBounds() const;
+	BoundingSphere getWorldBoundingSphere() const;
+
+	// Spatial queries in world space. Only meshes that retain their geometry take part.
+	/**
+	 * @brief Finds the closest triangle in this object's hierarchy that is hit by a world-space ray
+	 * within maxDistance. Returns false if nothing was hit.
+	 */
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+	/**
+	 * @brief Finds the closest triangle hit by the world-space line segment from start to end.
+	 */
+	bool intersectSegment(const glm::vec3& start, const glm::vec3& end, RayHit& hit) const;
+	/**
+	 * @brief Appends every triangle in this object's hierarchy that overlaps a world-space sphere.
+	 */
+	void overlapSphere(const glm::vec3& center, float radius, std::vector<SphereHit>& hits) const;
+
+	// Impostors.
+	/**
+	 * @brief Sets the impostor to draw in place of this object when the camera is more than
+	 * "distance" units from the center of the object's world bounding sphere.
+	 */
+	void setImpostor(std::shared_ptr<const Impostor> impostor, float distance);
+	const Impostor* getImpostor() const;
+	/**
+	 * @brief Returns true if the object has an impostor and the camera is far enough away to use it.
+	 */
+	bool useImpostor(const glm::vec3& cameraPos) const;
+
 	// Rendering.
-	void render(ShaderProgram& shaderProgram) const;
-	void renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const;
+	/**
+	 * @brief Adds a draw of every mesh in this hierarchy that is at least partly inside the frustum
+	 * to a render queue, using the world matrices and bounds from the last updateHierarchy. Subtrees
+	 * outside the frustum are skipped, and subtrees inside it are accepted without testing their
+	 * descendants against the frustum. If an occlusion buffer is given, objects and meshes hidden
+	 * behind its occluders are skipped as well.
+	 */
+	void collect(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum,
+		const OcclusionBuffer* occlusion, CullingStats& stats) const;
+	/**
+	 * @brief Adds every occluder mesh in this hierarchy that is not outside the frustum to an occlusion buffer.
+	 */
+	void collectOccluders(OcclusionBuffer& occlusion, const Frustum& frustum) const;
+	// Each draw's model matrix and material index are written to drawUniforms.
+	void render(ShaderProgram& shaderProgram, DrawUniformRing& drawUniforms) const;
+	void renderRecursive(ShaderProgram& shaderProgram, DrawUniformRing& drawUniforms, const glm::mat4& parentMatrix) const;
 };
\ No newline at end of file
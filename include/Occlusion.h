@@ -0,0 +1,90 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <vector>
+#include "Bounds.h"
+#include "Mesh.h"
+
+/**
+ * @brief Simplifies a mesh into an occluder proxy by vertex clustering: the mesh's bounding box is
+ * divided into a grid, the vertices in each cell are merged into their average, and triangles that
+ * collapse are dropped. Throws if a face refers to a vertex past the end of the positions.
+ * @param positions the mesh's vertex positions, each made of three floats, "stride" bytes apart.
+ * @param gridResolution the number of cells along the longest side of the bounding box.
+ */
+OccluderProxy buildOccluderProxy(const float* positions, size_t vertexCount, size_t stride,
+	const std::vector<uint32_t>& faces, uint32_t gridResolution);
+
+/**
+ * @brief A small depth buffer that occluders are rasterized into on the CPU each frame, and a
+ * hierarchical-Z pyramid built from it, used to find objects hidden behind the occluders before
+ * they are submitted to the GPU.
+ *
+ * The screen is split into tiles. Occluder triangles are transformed and sorted into the tiles they
+ * touch, and then the tiles are rasterized in parallel, four pixels at a time with SIMD. Each level
+ * of the pyramid holds the farthest depth of the 2x2 texels beneath it, so a box whose nearest point
+ * is behind every texel it covers on some level is hidden.
+ */
+class OcclusionBuffer {
+private:
+	// Tiles are rasterized independently, one tile per task.
+	static constexpr uint32_t TILE_WIDTH{ 32 };
+	static constexpr uint32_t TILE_HEIGHT{ 16 };
+
+	struct ScreenTriangle {
+		// Screen-space positions, in pixels, and depths in [0, 1].
+		glm::vec2 v0, v1, v2;
+		float z0, z1, z2;
+		// Pixel bounds of the triangle, clamped to the screen.
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_tilesX;
+	uint32_t m_tilesY;
+	glm::mat4 m_viewProjection{ 1 };
+	std::vector<ScreenTriangle> m_triangles{};
+	// The triangles touching each tile.
+	std::vector<std::vector<uint32_t>> m_bins{};
+	// The scratch list of an occluder's clip-space vertices.
+	std::vector<glm::vec4> m_clipPositions{};
+	// Level 0 is the full-resolution depth buffer. Each level is half the size of the one below,
+	// rounded up, so texel i of level l covers pixels [i * 2^l, (i + 1) * 2^l) of level 0.
+	std::vector<std::vector<float>> m_levels{};
+	std::vector<uint32_t> m_levelWidths{};
+	std::vector<uint32_t> m_levelHeights{};
+	bool m_hasOccluders{ false };
+
+	void rasterizeTile(uint32_t tile);
+	void buildPyramid();
+
+public:
+	/**
+	 * @param width the width of the depth buffer; rounded up to a multiple of the tile width.
+	 * @param height the height of the depth buffer; rounded up to a multiple of the tile height.
+	 */
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+	/**
+	 * @brief Empties the buffer for a frame seen through the given world->clip matrix.
+	 */
+	void clear(const glm::mat4& viewProjection);
+
+	/**
+	 * @brief Transforms an occluder into screen space and bins its triangles. Triangles crossing the
+	 * near plane are dropped, which only makes the occluder smaller.
+	 */
+	void addOccluder(const OccluderProxy& occluder, const glm::mat4& world);
+
+	/**
+	 * @brief Rasterizes every added occluder and builds the pyramid. Call after the last addOccluder
+	 * and before testing boxes.
+	 */
+	void rasterize();
+
+	/**
+	 * @brief Returns true if the world-space box is entirely hidden behind the occluders.
+	 */
+	bool isOccluded(const BoundingBox& box) const;
+};
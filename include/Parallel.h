@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Worker threads that are started once and kept for the life of the program, so that work
+ * split up every frame does not pay for creating and joining threads each time.
+ *
+ * A job is a range of chunks. Its caller posts it, takes chunks itself, and waits only for the chunks
+ * that workers took, so a job always finishes even if every worker is busy, and a chunk may post
+ * jobs of its own.
+ */
+class WorkerPool {
+public:
+	/**
+	 * @brief A range of chunks to run. The job lives on its caller's stack while execute runs.
+	 */
+	struct Job {
+		// Calls the caller's body on items [begin, end).
+		void (*run)(void* body, size_t begin, size_t end);
+		void* body;
+		size_t count;
+		size_t grain;
+		size_t chunks{ 0 };
+		std::atomic<size_t> nextChunk{ 0 };
+		// The number of workers that are taking chunks of the job.
+		uint32_t workers{ 0 };
+	};
+
+private:
+	std::mutex m_mutex{};
+	std::condition_variable m_wake{};
+	std::condition_variable m_workerLeft{};
+	// Jobs that are still being executed, some of which may have no chunks left to take.
+	std::vector<Job*> m_jobs{};
+	bool m_stopping{ false };
+	std::vector<std::jthread> m_threads{};
+
+	static void runChunks(Job& job);
+	// Returns a posted job that still has chunks to take, or null. Called with m_mutex held.
+	Job* findJob();
+	void workerLoop();
+
+public:
+	/**
+	 * @param threadCount the number of worker threads, not counting the threads that call execute.
+	 */
+	explicit WorkerPool(size_t threadCount);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/**
+	 * @brief The pool that parallelFor uses, with one worker fewer than the machine has hardware
+	 * threads, since the caller works too. Started the first time it is used.
+	 */
+	static WorkerPool& shared();
+
+	/**
+	 * @brief Runs every chunk of the job on this thread and any idle workers, and returns once all
+	 * of them have been processed.
+	 */
+	void execute(Job& job);
+
+	size_t getThreadCount() const;
+};
+
+/**
+ * @brief Calls body(begin, end) for consecutive chunks of at most "grain" items covering [0, count),
+ * spreading the chunks across the shared WorkerPool. The calling thread takes chunks too, and the
+ * function returns once every chunk has been processed.
+ */
+template <typename Body>
+void parallelFor(size_t count, size_t grain, Body&& body) {
+	if (count == 0) {
+		return;
+	}
+	using BodyType = std::remove_reference_t<Body>;
+	WorkerPool::Job job{
+		[](void* context, size_t begin, size_t end) { (*static_cast<BodyType*>(context))(begin, end); },
+		const_cast<void*>(static_cast<const void*>(std::addressof(body))), count, std::max<size_t>(grain, 1)
+	};
+	WorkerPool::shared().execute(job);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief An on-disk cache of linked program binaries from glGetProgramBinary, so that later launches
+ * can skip compiling and linking GLSL.
+ *
+ * Each binary is stored under a key that hashes the program's shader sources together with the GL
+ * vendor, renderer, and version strings, since a binary is only valid for the driver that made it.
+ * The driver may still reject a cached binary, e.g. after an update that kept the version string;
+ * the program is then compiled from source and the cache entry is replaced.
+ *
+ * Program binaries need OpenGL 4.1 or ARB_get_program_binary, and a driver that offers at least one
+ * binary format. Without them the cache does nothing.
+ */
+class ProgramBinaryCache {
+private:
+	static inline std::filesystem::path s_directory{ "shader_cache" };
+
+	static std::filesystem::path entryPath(const std::string& key);
+
+public:
+	/**
+	 * @brief Whether the context supports retrieving and loading program binaries.
+	 */
+	static bool isSupported();
+
+	/**
+	 * @brief Sets the directory that binaries are stored in. The default is "shader_cache" in the
+	 * working directory; it is created when the first binary is stored.
+	 */
+	static void setDirectory(const std::filesystem::path& directory);
+
+	/**
+	 * @brief Returns the cache key of a program made from the given shader sources, in order.
+	 */
+	static std::string makeKey(std::initializer_list<std::string_view> sources);
+
+	/**
+	 * @brief Creates a program from the binary cached under the key. Returns 0 if there is no cached
+	 * binary or the driver rejected it.
+	 */
+	static uint32_t load(const std::string& key);
+
+	/**
+	 * @brief Asks the driver to keep a program's binary retrievable. Call before linking the program.
+	 */
+	static void prepare(uint32_t program);
+
+	/**
+	 * @brief Writes a linked program's binary to the cache under the key. A binary that cannot be
+	 * retrieved or written is skipped, as the cache only saves time.
+	 */
+	static void store(uint32_t program, const std::string& key);
+};
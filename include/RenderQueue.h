@@ -0,0 +1,199 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Mesh.h"
+#include "Material.h"
+#include "GeometryPool.h"
+#include "GpuCulling.h"
+#include "InstanceTransforms.h"
+#include "ShaderProgram.h"
+#include "UniformBuffers.h"
+
+/**
+ * @brief A list of draws collected from a scene, which are sorted to minimize GL state changes before
+ * being submitted. Rendering a frame takes two phases: objects add their meshes with add(), then
+ * submit() sorts and draws them all.
+ *
+ * Each draw gets a 64-bit key. From most to least significant, it holds the program, the binding group
+ * and index of the mesh's Material, the vertex array, and the draw's depth from the camera, so draws
+ * sharing state are grouped together and each group is drawn front to back. Every draw is treated as
+ * opaque. Textures are bound only by the first draw of each run of draws whose materials bind the
+ * same ones, such as materials whose base textures are layers of one texture array; the draws
+ * themselves only differ in the material index they push to the Draw block.
+ *
+ * After sorting, consecutive draws of the same mesh with the same program and material are merged
+ * into one instanced draw, if an instanced variant of the program was registered. Each instance's
+ * InstanceTransform is computed on the CPU and streamed through an instance buffer to vertex
+ * attributes 4 through 14.
+ *
+ * On an OpenGL 4.3 context, draws that have an instanced program are instead submitted with
+ * glMultiDrawElementsIndirect: meshes are copied into a shared GeometryPool, one indirect command is
+ * written per run of identical meshes, and each bucket of draws with the same program and material
+ * is one call. Each command's base instance selects its matrices from the instance buffer,
+ * so the number of GL calls does not grow with the number of objects.
+ *
+ * If a GpuCulling is attached, the multi-draw path also leaves visibility to the GPU: every instance's
+ * bounding sphere is handed to a compute shader, which fills in the commands' instance counts and
+ * compacts the visible matrices before the draws read them.
+ *
+ * With a depth prepass enabled, the sorted draws are issued twice: first from the meshes'
+ * position-only vertex arrays with a depth-only program and color writes off, then with their own
+ * programs, testing depth with GL_EQUAL and writing none. Each pixel then runs the expensive fragment
+ * shader only for the surface that ends up visible. Both passes must compute gl_Position the same way,
+ * so their vertex shaders declare it invariant. depth_only.vert reads plain float positions and moves
+ * none, so draws whose programs have QUANTIZED_VERTICES or SKINNING are left out of the prepass and
+ * shaded with an ordinary GL_LESS depth test, which writes depth.
+ */
+class RenderQueue {
+private:
+	struct DrawItem {
+		ShaderProgram* program;
+		const Mesh* mesh;
+		glm::mat4 world;
+		const Material* material;
+		float viewDepth;
+	};
+
+	struct SortEntry {
+		uint64_t key;
+		uint32_t item;
+	};
+
+	// A run of sorted draws that is submitted with one draw call.
+	struct Batch {
+		uint32_t first;
+		uint32_t count;
+		// Where the run's matrices start in m_instanceMatrices, or -1 if it is not instanced.
+		int32_t instanceStart;
+	};
+
+	// The layout glMultiDrawElementsIndirect reads commands in.
+	struct DrawCommand {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	// Draws that share a program and material, submitted with one multi-draw call.
+	struct Bucket {
+		// The position in m_order of the bucket's first draw.
+		uint32_t first;
+		uint32_t commandStart;
+		// 0 if the draw at "first" has no instanced program and is submitted on its own.
+		uint32_t commandCount;
+	};
+
+	glm::mat4 m_view{ 1 };
+	glm::mat4 m_viewProjection{ 1 };
+	std::vector<DrawItem> m_items{};
+	std::vector<SortEntry> m_order{};
+	std::vector<SortEntry> m_scratch{};
+	std::vector<Batch> m_batches{};
+
+	// Instanced variants of programs, by the ID of the program they replace.
+	std::unordered_map<uint32_t, ShaderProgram*> m_instancedPrograms{};
+	std::vector<glm::mat4> m_instanceMatrices{};
+	std::vector<InstanceTransform> m_instanceTransforms{};
+	uint32_t m_instanceBuffer{ 0 };
+	size_t m_instanceCapacity{ 0 };
+
+	GeometryPool m_geometry{};
+	std::vector<DrawCommand> m_commands{};
+	std::vector<Bucket> m_buckets{};
+	uint32_t m_indirectBuffer{ 0 };
+	size_t m_indirectCapacity{ 0 };
+	GpuCulling* m_gpuCulling{ nullptr };
+	ShaderProgram* m_depthProgram{ nullptr };
+	ShaderProgram* m_instancedDepthProgram{ nullptr };
+
+	static bool sameState(const DrawItem& a, const DrawItem& b);
+	// Binds a draw's textures unless the previous draw of the pass used the same program and textures.
+	static void bindMaterial(ShaderProgram& program, const Material& material, const ShaderProgram*& lastProgram,
+		const Material*& lastMaterial);
+	const DrawItem& sortedItem(uint32_t position) const;
+	// Points a vertex array's instance attributes at a buffer of InstanceTransforms, starting at the given one.
+	void bindInstanceAttributes(uint32_t vertexArray, uint32_t buffer, uint32_t firstInstance);
+	// The world-space bounding sphere of a draw's mesh, as center and radius.
+	static glm::vec4 worldSphere(const DrawItem& item);
+
+	// Splits the sorted draws into batches, gathering the world matrices of instanced batches.
+	void buildBatches();
+	// The two ways of submitting the sorted draws: instanced draws for GL 3.3, or multi-draw indirect.
+	void submitBatches(DrawUniformRing& drawUniforms);
+	void submitMultiDraw(DrawUniformRing& drawUniforms);
+	// Issue the draws that submitBatches and submitMultiDraw prepared, either with their own programs
+	// or, for the depth prepass, with the depth-only programs.
+	void drawBatches(DrawUniformRing& drawUniforms, bool depthOnly);
+	void drawBuckets(DrawUniformRing& drawUniforms, bool depthOnly);
+	// Set the depth and color write state of the prepass, of the shading pass after it, and back to normal.
+	static void beginDepthPrepass();
+	static void beginShadingPass();
+	static void endShadingPass();
+	// Whether a draw is drawn in the depth prepass. Its vertex shader must place vertices where
+	// depth_only.vert does.
+	bool inDepthPrepass(const DrawItem& item) const;
+	// In the shading pass, tests a draw's depth with GL_EQUAL if it was in the prepass, or as usual if not.
+	void setShadingDepthTest(const DrawItem& item, bool& prepassed) const;
+	// Computes and uploads the transforms of m_instanceMatrices, reallocating the buffer so the previous
+	// frame's draws are not waited on.
+	void uploadInstances();
+
+	static uint64_t makeKey(const DrawItem& item);
+	// Sorts m_order by key with a least-significant-digit radix sort, one byte per pass.
+	void sortByKey();
+
+public:
+	/**
+	 * @brief The first vertex attribute location of the per-instance transform: the model matrix,
+	 * then the model-view-projection matrix, then the normal matrix.
+	 */
+	static constexpr uint32_t INSTANCE_ATTRIBUTE{ 4 };
+	/**
+	 * @brief The fewest repeated draws that are merged into an instanced draw.
+	 */
+	static constexpr uint32_t MIN_INSTANCES{ 2 };
+
+	/**
+	 * @brief Registers the program to use in place of "program" when its draws are instanced. The
+	 * instanced program reads an InstanceTransform from attributes INSTANCE_ATTRIBUTE onward.
+	 */
+	void setInstancedProgram(const ShaderProgram& program, ShaderProgram& instancedProgram);
+	/**
+	 * @brief Forgets every registered instanced program, e.g. after programs were rebuilt with new IDs.
+	 */
+	void clearInstancedPrograms();
+
+	/**
+	 * @brief Hands the visibility of multi-draw instances to the GPU. Pass nullptr to go back to
+	 * drawing every queued instance. Has no effect without OpenGL 4.3.
+	 */
+	void setGpuCulling(GpuCulling* culling);
+
+	/**
+	 * @brief Enables the depth prepass, drawn with the given programs: depthProgram for single draws,
+	 * and instancedDepthProgram for instanced and multi-draw draws. Pass nullptr for both to disable it.
+	 */
+	void setDepthPrepass(ShaderProgram* depthProgram, ShaderProgram* instancedDepthProgram);
+
+	/**
+	 * @brief Empties the queue for a new frame seen through the given world->view and view->clip matrices.
+	 */
+	void clear(const glm::mat4& view, const glm::mat4& projection);
+
+	/**
+	 * @brief Adds one draw of a mesh, shaded with the mesh's material.
+	 * @param world the mesh's local->world matrix.
+	 */
+	void add(ShaderProgram& program, const Mesh& mesh, const glm::mat4& world);
+
+	/**
+	 * @brief Sorts the queued draws and issues them. The queue keeps its draws until the next clear().
+	 */
+	void submit(DrawUniformRing& drawUniforms);
+
+	size_t size() const;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The number of GL calls that went through RenderState, and how many of them were dropped
+ * because they would not have changed any state.
+ */
+struct RenderStateCounters {
+	uint32_t issued{ 0 };
+	uint32_t skipped{ 0 };
+};
+
+/**
+ * @brief A cache of the current GL context's bindings. Each function makes its GL call only if the
+ * binding would change, so draws can bind everything they need without paying for redundant binds.
+ *
+ * The cache is only correct if every bind in the program goes through it. Code that binds objects
+ * directly must call invalidate() afterward.
+ */
+class RenderState {
+private:
+	static constexpr uint32_t TEXTURE_UNITS{ 32 };
+	static constexpr uint32_t TEXTURE_TARGETS{ 5 };
+	static constexpr uint32_t BUFFER_TARGETS{ 9 };
+	// The binding of a target whose current value is not known.
+	static constexpr uint32_t UNKNOWN{ 0xffffffff };
+
+	// A new context starts with everything bound to 0 and texture unit 0 active.
+	static inline uint32_t s_program{ 0 };
+	static inline uint32_t s_vertexArray{ 0 };
+	static inline uint32_t s_activeUnit{ 0 };
+	static inline uint32_t s_textures[TEXTURE_UNITS][TEXTURE_TARGETS]{};
+	static inline uint32_t s_buffers[BUFFER_TARGETS]{};
+	static inline RenderStateCounters s_counters{};
+
+	// Returns true, and counts the call as issued, if "cached" differs from "value"; otherwise counts it as skipped.
+	static bool changes(uint32_t& cached, uint32_t value);
+
+public:
+	static void useProgram(uint32_t program);
+	/**
+	 * @brief Binds a vertex array. The element array buffer binding belongs to the vertex array, so
+	 * it changes along with it.
+	 */
+	static void bindVertexArray(uint32_t vertexArray);
+	/**
+	 * @brief Binds a texture to a texture unit, making the unit active only if the binding changes.
+	 */
+	static void bindTexture(uint32_t unit, uint32_t target, uint32_t texture);
+	static void bindBuffer(uint32_t target, uint32_t buffer);
+	// Indexed buffer binds are always issued, but also replace the target's generic binding.
+	static void bindBufferBase(uint32_t target, uint32_t index, uint32_t buffer);
+	static void bindBufferRange(uint32_t target, uint32_t index, uint32_t buffer, ptrdiff_t offset, ptrdiff_t size);
+
+	/**
+	 * @brief Deletes a buffer. GL unbinds a deleted buffer from every target, so the cache does too.
+	 */
+	static void deleteBuffer(uint32_t buffer);
+	/**
+	 * @brief Deletes a texture, which GL likewise unbinds from every unit of the current context.
+	 */
+	static void deleteTexture(uint32_t texture);
+
+	/**
+	 * @brief Forgets every cached binding, so the next call for each one is issued.
+	 */
+	static void invalidate();
+
+	/**
+	 * @brief Returns the counters since the last call, and resets them.
+	 */
+	static RenderStateCounters takeCounters();
+};
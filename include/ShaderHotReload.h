@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+ * @brief Watches the shader source directory and rebuilds the programs that use a file when it
+ * changes, without stalling frames: the new program is compiled in the background, and the old one
+ * keeps drawing until the new one has linked.
+ *
+ * Programs load their shaders from the build's copy of the sources, so a changed source file is
+ * first copied over its copy, and the programs that use the copy are rebuilt. Only files that
+ * already have a copy are followed; a new shader file needs the build to copy it once.
+ *
+ * On Linux the directory is watched with inotify; elsewhere, file modification times are scanned
+ * a few times a second. Without KHR_parallel_shader_compile (or a glad generated without it), there
+ * is no way to ask whether a build is done without waiting for it, so a reload then stalls the frame
+ * that swaps it in for the whole compile.
+ */
+class ShaderHotReload {
+private:
+	static constexpr std::chrono::milliseconds SCAN_INTERVAL{ 500 };
+
+	// The directory that is watched, and the one its files are copied to and loaded from.
+	std::filesystem::path m_sourceDirectory;
+	std::filesystem::path m_buildDirectory;
+	std::vector<ShaderProgram*> m_programs{};
+	// The inotify descriptor, or -1 if modification times are scanned instead.
+	int32_t m_inotify{ -1 };
+	std::unordered_map<std::string, std::filesystem::file_time_type> m_writeTimes{};
+	std::chrono::steady_clock::time_point m_nextScan{};
+
+	// The files in the source directory that changed since the last call.
+	std::vector<std::filesystem::path> changedFiles();
+	// Copies changed source files over their copies, and returns the copies' paths.
+	std::vector<std::filesystem::path> copyToBuild(const std::vector<std::filesystem::path>& changed) const;
+	std::vector<std::filesystem::path> scanWriteTimes();
+
+public:
+	/**
+	 * @param sourceDirectory the directory the shaders are edited in.
+	 * @param buildDirectory the directory the programs load their copies of the shaders from.
+	 */
+	ShaderHotReload(const std::filesystem::path& sourceDirectory, const std::filesystem::path& buildDirectory);
+	~ShaderHotReload();
+	ShaderHotReload(const ShaderHotReload&) = delete;
+	ShaderHotReload& operator=(const ShaderHotReload&) = delete;
+
+	/**
+	 * @brief Rebuilds the program whenever one of its files changes. The program must outlive the watcher.
+	 */
+	void watch(ShaderProgram& program);
+
+	/**
+	 * @brief Call once per frame. Starts rebuilding programs whose files changed, and swaps in the
+	 * ones that have finished. A program that fails to build is reported and keeps its old version.
+	 * @return true if any program was swapped, which changes its ID.
+	 */
+	bool update();
+};
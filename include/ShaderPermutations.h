@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+ * @brief The optional features a shader variant can be compiled with, as bits of a feature mask.
+ * Each feature is compiled in by #defining its name in the shader sources.
+ */
+struct ShaderFeatures {
+	// Phong lighting; without it, fragments only take the base texture's color. Defines LIGHTING.
+	static constexpr uint32_t LIGHTING{ 1 << 0 };
+	// Normals are perturbed by the mesh's "normalMap" texture. Defines NORMAL_MAP.
+	static constexpr uint32_t NORMAL_MAP{ 1 << 1 };
+	// Matrices come from per-instance attributes, for RenderQueue's instanced draws. Defines INSTANCING.
+	static constexpr uint32_t INSTANCING{ 1 << 2 };
+	// Positions and normals are normalized 16-bit integers. Defines QUANTIZED_VERTICES.
+	static constexpr uint32_t QUANTIZED_VERTICES{ 1 << 3 };
+	// Vertices are blended between up to four bone matrices. Defines SKINNING.
+	static constexpr uint32_t SKINNING{ 1 << 4 };
+	// Point and spot lights from ClusteredLighting's grid are added to the Phong terms; requires
+	// LIGHTING. Defines CLUSTERED_LIGHTS.
+	static constexpr uint32_t CLUSTERED_LIGHTS{ 1 << 5 };
+	// The directional light is shadowed by CascadedShadowMaps; requires LIGHTING. Defines SHADOWS.
+	static constexpr uint32_t SHADOWS{ 1 << 6 };
+	// The ambient and directional light come from a LightmapBaker's "lightmap" texture, read at the
+	// vertices' lightmap coordinates; requires LIGHTING. Defines LIGHTMAP.
+	static constexpr uint32_t LIGHTMAP{ 1 << 7 };
+
+	static constexpr uint32_t COUNT{ 8 };
+};
+
+/**
+ * @brief The variants of one vertex and fragment shader pair, compiled from the same sources with a
+ * different set of #defines for each feature mask, instead of a hand-written pair per combination.
+ *
+ * All the variants an application needs should be compiled together with compile(), which starts
+ * every compile and link before checking any of them. With KHR_parallel_shader_compile (or the ARB
+ * version), the driver compiles them on background threads in the meantime. Without either extension,
+ * or with a glad generated without extensions, the variants still build, but one at a time.
+ */
+class ShaderPermutations {
+private:
+	std::string m_vertexShaderPath;
+	std::string m_fragmentShaderPath;
+	std::string m_fragmentPreludePath;
+	std::unordered_map<uint32_t, ShaderProgram> m_variants{};
+
+	// The #defines of a feature mask. Throws if the features cannot be combined.
+	static std::vector<std::string> definesFor(uint32_t features);
+
+public:
+	/**
+	 * @param fragmentPreludePath if not empty, a file of code inserted into every variant's fragment
+	 * shader after its #defines, which the feature blocks of several shaders can share.
+	 */
+	ShaderPermutations(std::string vertexShaderPath, std::string fragmentShaderPath,
+		std::string fragmentPreludePath = "");
+
+	/**
+	 * @brief Compiles every listed variant that has not been compiled yet. Throws if any of them fails.
+	 */
+	void compile(const std::vector<uint32_t>& variants);
+
+	/**
+	 * @brief Returns the variant with exactly the given features, compiling it now if compile() did not.
+	 */
+	ShaderProgram& get(uint32_t features);
+};
@@ -1,15 +1,149 @@
 #pragma once
 #include <glm/ext.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The pre-resolved location of a uniform of type T in one ShaderProgram. Setting a uniform
+ * through a handle skips the name lookup entirely.
+ */
+template <typename T>
+struct UniformHandle {
+	// -1 if the program has no active uniform with the handle's name; setting it is then a no-op.
+	int32_t location{ -1 };
+};
+
 class ShaderProgram {
+	// An active uniform, as reported by glGetActiveUniform when the program was linked.
+	struct UniformInfo {
+		int32_t location;
+		// The uniform's GL type, e.g. GL_FLOAT_MAT4.
+		uint32_t type;
+		// The number of array elements, or 1 for a non-array uniform.
+		int32_t size;
+	};
+
+	// Hashes string_views so the table can be searched without building a std::string.
+	struct NameHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view name) const {
+			return std::hash<std::string_view>{}(name);
+		}
+	};
+
+	// A shader file and its stage, e.g. GL_FRAGMENT_SHADER, and an optional file of code shared with
+	// other shaders that is inserted after its #defines.
+	struct ShaderSource {
+		uint32_t type;
+		std::string path;
+		std::string preludePath{};
+	};
+
+	// A program whose compile and link were started but not checked yet. A program loaded from the
+	// binary cache has no shaders, and is already complete.
+	struct PendingBuild {
+		uint32_t program{ 0 };
+		std::vector<uint32_t> shaders{};
+		// The key the program's binary is cached under.
+		std::string cacheKey{};
+	};
+
 	uint32_t m_programId;
+	std::unordered_map<std::string, UniformInfo, NameHash, std::equal_to<>> m_uniforms{};
+	// What the program was built from, so it can be rebuilt when a file changes.
+	std::vector<ShaderSource> m_sources{};
+	std::vector<std::string> m_defines{};
+	// The build started by startLoad, and the replacement started by startReload.
+	PendingBuild m_pending{};
+	PendingBuild m_reload{};
+
+	static PendingBuild startBuild(const std::vector<ShaderSource>& sources, const std::vector<std::string>& defines);
+	// Whether the driver has finished a build, asked without waiting when parallel compile is available.
+	static bool isBuildComplete(const PendingBuild& build);
+	// Waits for a build, throwing and discarding it if it failed.
+	static void finishBuild(PendingBuild& build);
+	static void discardBuild(PendingBuild& build);
+	// Reflects the uniforms of the newly linked m_programId, and connects its uniform blocks.
+	void prepareLinked();
+
+	// The number of name-to-location lookups since the counter was last taken.
+	static inline uint32_t s_uniformLookups{ 0 };
+
+	// Fills m_uniforms with every active uniform of the linked program.
+	void reflectUniforms();
+	// Returns the location of the named uniform, or -1 if it is not active.
+	int32_t findUniform(std::string_view uniformName) const;
 
 public:
 	ShaderProgram();
-	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+	/**
+	 * @brief Compiles and links a program, throwing if either fails.
+	 * @param defines names that are #defined in both shaders, right after their #version line.
+	 * @param fragmentPreludePath if not empty, a file whose code is inserted into the fragment shader
+	 * after the #defines, so that several fragment shaders can share functions and uniforms.
+	 */
+	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+		const std::vector<std::string>& defines = {}, const std::string& fragmentPreludePath = "");
+	/**
+	 * @brief Starts compiling and linking a program like load, but does not wait for the driver or
+	 * check for errors. Drivers that compile on background threads can work on several programs
+	 * at once while the others are started. finishLoad must be called before the program is used.
+	 */
+	void startLoad(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+		const std::vector<std::string>& defines = {}, const std::string& fragmentPreludePath = "");
+	/**
+	 * @brief Waits for a program started by startLoad, throwing if its compile or link failed.
+	 */
+	void finishLoad();
+
+	/**
+	 * @brief Whether the program was built from the given shader file, or a prelude file.
+	 */
+	bool usesFile(const std::filesystem::path& path) const;
+	/**
+	 * @brief Whether the program was built with the given name #defined, e.g. by ShaderPermutations.
+	 */
+	bool isDefined(std::string_view name) const;
+	/**
+	 * @brief Starts rebuilding the program from its files, which may have changed. The current
+	 * program stays in use until finishReload swaps the new one in.
+	 */
+	void startReload();
+	/**
+	 * @brief Swaps in the program started by startReload once the driver has built it, and returns
+	 * true if it did. The program's ID changes, and uniform handles taken before must be taken again.
+	 * If the new program failed to build, it is discarded and the error is thrown; the old program
+	 * stays in use.
+	 */
+	bool finishReload();
+	/**
+	 * @brief Loads a compute program from a single shader. Throws unless the context is OpenGL 4.3 or newer.
+	 */
+	void loadCompute(const std::string& computeShaderPath);
 
 	void activate();
+	uint32_t getId() const;
+
+	/**
+	 * @brief Connects the named uniform block to a uniform buffer binding point. Does nothing if
+	 * the program has no such block. The "Frame" and "Draw" blocks are connected by load.
+	 */
+	void bindUniformBlock(const std::string& blockName, uint32_t binding);
 
+	/**
+	 * @brief Resolves the named uniform once, for use with the handle overloads of setUniform.
+	 * Throws if the uniform is active but its GLSL type does not match T; a uniform that is not
+	 * active gives an empty handle, as the GLSL compiler may remove unused uniforms.
+	 */
+	template <typename T>
+	UniformHandle<T> getUniform(const std::string& uniformName) const;
+
+	// Set a uniform by name. Each call looks the name up in the program's uniform table.
 	void setUniform(const std::string& uniformName, bool value);
 	void setUniform(const std::string& uniformName, int32_t value);
 	void setUniform(const std::string& uniformName, float value);
@@ -19,4 +153,25 @@ public:
 	void setUniform(const std::string& uniformName, const glm::mat2& value);
 	void setUniform(const std::string& uniformName, const glm::mat3& value);
 	void setUniform(const std::string& uniformName, const glm::mat4& value);
+
+	// Set a uniform through a handle from getUniform.
+	void setUniform(UniformHandle<bool> uniform, bool value);
+	void setUniform(UniformHandle<int32_t> uniform, int32_t value);
+	void setUniform(UniformHandle<float> uniform, float value);
+	void setUniform(UniformHandle<glm::vec2> uniform, const glm::vec2& value);
+	void setUniform(UniformHandle<glm::vec3> uniform, const glm::vec3& value);
+	void setUniform(UniformHandle<glm::vec4> uniform, const glm::vec4& value);
+	// Sets "count" elements of a vec4 array uniform, starting from the element the handle names.
+	void setUniform(UniformHandle<glm::vec4> uniform, const glm::vec4* values, int32_t count);
+	void setUniform(UniformHandle<glm::mat2> uniform, const glm::mat2& value);
+	void setUniform(UniformHandle<glm::mat3> uniform, const glm::mat3& value);
+	void setUniform(UniformHandle<glm::mat4> uniform, const glm::mat4& value);
+	// Sets "count" elements of a mat4 array uniform, starting from the element the handle names.
+	void setUniform(UniformHandle<glm::mat4> uniform, const glm::mat4* values, int32_t count);
+
+	/**
+	 * @brief Returns the number of uniform name lookups made by every program since the last call,
+	 * and resets the count. Call once per frame to see how many lookups the frame made.
+	 */
+	static uint32_t takeUniformLookupCount();
 };
\ No newline at end of file
@@ -1,18 +1,26 @@
 #pragma once
 #include <glad/glad.h>
+#include <glm/ext.hpp>
 #include <string>
 #include <filesystem>
 #include "StbImage.h"
+#include "RenderState.h"
 
 /**
  * @brief Represents a texture that has been loaded into VRAM, and is expected to be bound
- * to a sampler2D with a given sampler name in the fragment shader.
+ * to a sampler with a given sampler name in the fragment shader.
  */
 struct Texture {
 	// The ID of the texture, to be bound with glBindTexture when drawing a mesh.
 	uint32_t textureId;
-	// The name of the sampler2D uniform in the fragment shader that this texture will bind to.
+	// The name of the sampler uniform in the fragment shader that this texture will bind to.
 	std::string samplerName;
+	// GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for a texture that packTextureArrays moved into an array.
+	uint32_t target{ GL_TEXTURE_2D };
+	// For a texture in an array, the layer it is in, and the part of the layer it covers as the
+	// scale (xy) and offset (zw) from its own texture coordinates to the layer's.
+	uint32_t layer{ 0 };
+	glm::vec4 rect{ 1, 1, 0, 0 };
 
 	/**
 	 * @brief Loads an SFML Image into VRAM and returns a Texture object identifying it.
@@ -20,7 +28,7 @@ struct Texture {
 	static Texture loadImage(const StbImage& texture, const std::string& samplerName) {
 		uint32_t texId;
 		glGenTextures(1, &texId);
-		glBindTexture(GL_TEXTURE_2D, texId);
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texId);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -28,7 +36,6 @@ struct Texture {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.getWidth(), texture.getHeight(), 0, GL_RGBA,
 			GL_UNSIGNED_BYTE, texture.getData());
 		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
 
 		return Texture{ texId, samplerName };
 	}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Texture.h"
+
+/**
+ * @brief The largest width and height of a texture that packTextureArrays packs into an atlas layer,
+ * and the width and height of the atlas layers.
+ */
+constexpr uint32_t ATLAS_TILE_LIMIT{ 512 };
+constexpr uint32_t ATLAS_SIZE{ 2048 };
+
+/**
+ * @brief Copies 2D textures into GL_TEXTURE_2D_ARRAY textures, so that meshes with different textures
+ * can be drawn one after another with the same textures bound, each sampling its own layer.
+ *
+ * Textures of the same size each become a layer of one array. If there are two or more textures no
+ * larger than ATLAS_TILE_LIMIT on either side, such as cube.png, they are first packed together into
+ * atlas layers of ATLAS_SIZE, which join the other layers of that size. Each keeps a margin of texels
+ * wrapped around from its opposite edges, so that the repeating and filtering the shaders emulate
+ * within its rectangle do not blend in its neighbors.
+ *
+ * The images are read back from the textures' level 0 and stored as GL_RGBA8, the format
+ * Texture::loadImage creates, with a full mipmap chain.
+ *
+ * @return for each texture, in the same order, a Texture with the same sampler name that identifies
+ * its array, layer, and rectangle of the layer. The original textures are not deleted. The textures
+ * must all be distinct GL_TEXTURE_2D textures.
+ */
+std::vector<Texture> packTextureArrays(const std::vector<Texture>& textures);
@@ -0,0 +1,128 @@
+#pragma once
+#include <glm/ext.hpp>
+#include <cstdint>
+
+/**
+ * @brief The uniform buffer binding point of the "Frame" block, which every program shares.
+ */
+constexpr uint32_t FRAME_UNIFORM_BINDING{ 0 };
+/**
+ * @brief The uniform buffer binding point of the "Draw" block.
+ */
+constexpr uint32_t DRAW_UNIFORM_BINDING{ 1 };
+/**
+ * @brief The uniform buffer binding point of the "Materials" block, MaterialLibrary's array of every
+ * material's parameters, indexed by the "Draw" block's materialIndex.
+ */
+constexpr uint32_t MATERIAL_UNIFORM_BINDING{ 2 };
+
+/**
+ * @brief The std140 layout of the "Frame" uniform block: camera state that is the same for every draw.
+ */
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	// std140 pads a vec3 to 16 bytes; w is unused.
+	glm::vec4 cameraPos;
+};
+
+/**
+ * @brief The std140 layout of the "Draw" uniform block: the state of a single draw call.
+ */
+struct DrawUniforms {
+	glm::mat4 model;
+	// projection * view * model, so vertex shaders do not multiply the three for every vertex.
+	glm::mat4 modelViewProjection;
+	// The inverse transpose of the model matrix. A std140 mat3 has the same padding as a mat4,
+	// so it is stored as one.
+	glm::mat4 normalMatrix;
+	// The index of the draw's Material in the "Materials" block. std140 pads the block to a multiple
+	// of 16 bytes.
+	uint32_t materialIndex;
+	uint32_t padding[3]{};
+};
+
+/**
+ * @brief The std140 layout of one element of the "Materials" uniform block's array.
+ */
+struct MaterialUniforms {
+	// Ambient, diffuse, and specular coefficients and shininess.
+	glm::vec4 parameters;
+	// The scale (xy) and offset (zw) from the mesh's texture coordinates to the base texture's
+	// rectangle of its layer, and the layer of its texture array that it is in.
+	glm::vec4 baseTextureRect;
+	float baseTextureLayer;
+	// std140 pads an array element to a multiple of 16 bytes.
+	float padding[3]{};
+};
+
+/**
+ * @brief A uniform buffer holding the "Frame" block, bound once to FRAME_UNIFORM_BINDING so that
+ * every program sees the same camera without it being uploaded to each one.
+ */
+class FrameUniformBuffer {
+private:
+	uint32_t m_buffer;
+
+public:
+	FrameUniformBuffer();
+
+	/**
+	 * @brief Uploads new camera state. Draws issued afterward see the new values.
+	 */
+	void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos);
+};
+
+/**
+ * @brief A ring of "Draw" blocks in one uniform buffer. Each draw writes its block into the next slot
+ * and binds that slot's range to DRAW_UNIFORM_BINDING.
+ *
+ * The buffer is split into one region per frame in flight, guarded by fences, so the CPU never writes
+ * a slot the GPU may still be reading. With OpenGL 4.4 the buffer is persistently mapped and writing
+ * a block is a single memcpy; otherwise each block is uploaded with glBufferSubData.
+ */
+class DrawUniformRing {
+private:
+	static constexpr uint32_t FRAMES_IN_FLIGHT{ 3 };
+
+	uint32_t m_buffer;
+	// The distance between slots, rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+	uint32_t m_stride;
+	uint32_t m_slotsPerFrame;
+	uint32_t m_frame{ 0 };
+	uint32_t m_nextSlot{ 0 };
+	glm::mat4 m_viewProjection{ 1 };
+	// The persistent mapping of the whole buffer, or nullptr if glBufferSubData is used instead.
+	uint8_t* m_mapped{ nullptr };
+	// A fence after the last draw of each region; the region may be rewritten once it signals.
+	void* m_fences[FRAMES_IN_FLIGHT]{};
+
+public:
+	/**
+	 * @param slotsPerFrame the number of draws a frame is expected to make. If a frame makes more,
+	 * the ring waits for the GPU and starts over at the beginning of the frame's region.
+	 */
+	explicit DrawUniformRing(uint32_t slotsPerFrame = 4096);
+
+	/**
+	 * @brief Moves to the next frame's region of the ring, waiting for the GPU to finish with it.
+	 * @param viewProjection the world->clip matrix that the frame's draws are seen through.
+	 */
+	void beginFrame(const glm::mat4& viewProjection);
+	/**
+	 * @brief Changes the world->clip matrix for the draws pushed afterward within the frame, e.g. to
+	 * render a shadow map from a light's point of view.
+	 */
+	void setViewProjection(const glm::mat4& viewProjection);
+	/**
+	 * @brief Marks the end of the draws that use the current region.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief Writes the block for one draw and binds it. The model-view-projection and normal matrices
+	 * are computed from the model matrix.
+	 * @param materialIndex the Material::index of the material the draw is shaded with.
+	 */
+	void push(const glm::mat4& model, uint32_t materialIndex);
+};
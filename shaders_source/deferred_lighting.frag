@@ -0,0 +1,60 @@
+#version 330
+// A fragment shader for the lighting pass of the application's DeferredRenderer. Each pixel reads its
+// surface from the G-buffer and shades it as lighting.frag would have: without LIGHTING defined it
+// only takes the albedo, CLUSTERED_LIGHTS adds the point and spot lights of its cluster, and SHADOWS
+// shadows the directional light. The lighting functions are lighting.frag's, from lighting_common.glsl.
+layout (location=0) out vec4 FragColor;
+
+in vec2 TexCoord;
+
+// The G-buffer, written by gbuffer.frag.
+uniform sampler2D gBufferAlbedo;
+uniform sampler2D gBufferNormal;
+uniform sampler2D gBufferMaterial;
+uniform sampler2D gBufferDepth;
+// The inverse of the world->clip matrix, to rebuild each pixel's world position from its depth.
+uniform mat4 inverseViewProjection;
+
+// Reverses gbuffer.frag's encodeOctahedral.
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    float windowDepth = texture(gBufferDepth, TexCoord).r;
+    if (windowDepth == 1.0) {
+        // Nothing was drawn here; keep the cleared background.
+        discard;
+    }
+    vec4 albedo = texture(gBufferAlbedo, TexCoord);
+#ifdef LIGHTING
+    vec3 normal = decodeOctahedral(texture(gBufferNormal, TexCoord).xy * 2.0 - 1.0);
+    vec4 packedMaterial = texture(gBufferMaterial, TexCoord);
+    vec4 material = vec4(packedMaterial.xyz, exp2(packedMaterial.w * 8.0));
+    vec4 world = inverseViewProjection * vec4(TexCoord * 2.0 - 1.0, windowDepth * 2.0 - 1.0, 1.0);
+    vec3 position = world.xyz / world.w;
+    float occlusion = albedo.a;
+
+    vec3 ambientIntensity;
+    vec3 diffuseIntensity;
+    vec3 specularIntensity;
+    phongDirectional(position, normal, material, ambientIntensity, diffuseIntensity, specularIntensity);
+#ifdef SHADOWS
+    float shadow = directionalShadow(position, normal);
+    diffuseIntensity *= shadow;
+    specularIntensity *= shadow;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    addClusteredLights(position, normal, material, windowDepth, diffuseIntensity, specularIntensity);
+#endif
+
+    vec3 lightIntensity = ambientIntensity * occlusion + diffuseIntensity + specularIntensity;
+    FragColor = vec4(lightIntensity * albedo.rgb, 1.0);
+#else
+    FragColor = vec4(albedo.rgb, 1.0);
+#endif
+}
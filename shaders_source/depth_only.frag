@@ -0,0 +1,5 @@
+#version 330
+// A fragment shader for the depth prepass. Color writes are off; only the fixed-function depth is kept.
+
+void main() {
+}
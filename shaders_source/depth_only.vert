@@ -0,0 +1,29 @@
+#version 330
+// A vertex shader for the depth prepass, which reads only vertex positions. ShaderPermutations compiles
+// an INSTANCING variant of it. gl_Position must match light_perspective.vert's exactly, so RenderQueue
+// leaves draws of QUANTIZED_VERTICES and SKINNING programs, whose positions it does not move, out of
+// the prepass.
+layout (location=0) in vec3 vPosition;
+
+#ifdef INSTANCING
+// Each instance's model-view-projection matrix, at the location light_perspective.vert reads it from.
+layout (location=8) in mat4 instanceModelViewProjection;
+#endif
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
+
+invariant gl_Position;
+
+void main() {
+#ifdef INSTANCING
+    gl_Position = instanceModelViewProjection * vec4(vPosition, 1.0);
+#else
+    gl_Position = modelViewProjection * vec4(vPosition, 1.0);
+#endif
+}
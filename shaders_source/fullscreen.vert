@@ -0,0 +1,10 @@
+#version 330
+// A vertex shader for one triangle that covers the whole screen, drawn as 3 vertices with no attributes.
+out vec2 TexCoord;
+
+void main() {
+    // Vertices 0, 1, 2 are at (0, 0), (2, 0), (0, 2) in texture space, so [0, 1]^2 is inside.
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
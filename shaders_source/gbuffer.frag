@@ -0,0 +1,67 @@
+#version 330
+// A fragment shader for the geometry pass of the application's DeferredRenderer: writes the surface's
+// albedo, normal, and material to the G-buffer, to be lit afterward by deferred_lighting.frag.
+layout (location=0) out vec4 GBufferAlbedo;
+layout (location=1) out vec2 GBufferNormal;
+layout (location=2) out vec4 GBufferMaterial;
+
+in vec2 TexCoord;
+in vec3 Normal;
+in float Occlusion;
+
+// The mesh's base (diffuse) texture, packed by the application into a layer of a texture array or
+// into a rectangle of an atlas layer.
+uniform sampler2DArray baseTexture;
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    // The mesh's element of the Materials block.
+    uint materialIndex;
+};
+
+struct MaterialData {
+    // Material parameters: k_a, k_d, k_s, shininess.
+    vec4 parameters;
+    // The scale (xy) and offset (zw) from the mesh's texture coordinates to its base texture's
+    // rectangle of its layer, and that layer.
+    vec4 baseTextureRect;
+    float baseTextureLayer;
+};
+
+// Every material, from the application's MaterialLibrary. This length matches its MAX_MATERIALS.
+layout (std140) uniform Materials {
+    MaterialData materials[256];
+};
+
+// The parameters of the mesh's material, looked up at the start of main.
+vec4 material;
+
+// Samples the mesh's base texture, repeating it within its rectangle of its layer. The gradients of
+// the unwrapped coordinates keep the mip level from jumping where the coordinates wrap.
+vec4 sampleBaseTexture(vec2 uv) {
+    vec4 rect = materials[materialIndex].baseTextureRect;
+    vec2 wrapped = rect.zw + fract(uv) * rect.xy;
+    return textureGrad(baseTexture, vec3(wrapped, materials[materialIndex].baseTextureLayer),
+        dFdx(uv) * rect.xy, dFdy(uv) * rect.xy);
+}
+
+// Projects a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds its lower half over the
+// corners of the upper half's square, which maps every direction into [-1, 1]^2.
+vec2 encodeOctahedral(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy;
+}
+
+void main() {
+    material = materials[materialIndex].parameters;
+    GBufferAlbedo = vec4(sampleBaseTexture(TexCoord).rgb, Occlusion);
+    GBufferNormal = encodeOctahedral(normalize(Normal)) * 0.5 + 0.5;
+    // The coefficients are clamped to [0, 1]; shininess is stored as log2 / 8, which spans 1 to 256.
+    GBufferMaterial = vec4(clamp(material.xyz, 0.0, 1.0), log2(clamp(material.w, 1.0, 256.0)) / 8.0);
+}
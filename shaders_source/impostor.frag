@@ -0,0 +1,67 @@
+#version 330
+// A fragment shader that draws an impostor by blending the two captured views nearest to the
+// camera's direction, and writes the depth of the captured surface instead of the quad's. With
+// LIGHTING defined, the captured color is lit by the ambient and directional light through the
+// captured normals.
+layout (location=0) out vec4 FragColor;
+
+in vec2 QuadCoord;
+in vec3 FragWorldPos;
+
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+uniform float impostorRadius;
+
+uniform sampler2D impostorColor;
+uniform sampler2D impostorDepth;
+// The atlas offset (xy) and scale (zw) of the two views, and how far to blend from the first to the second.
+uniform vec4 tileA;
+uniform vec4 tileB;
+uniform float viewBlend;
+
+#ifdef LIGHTING
+// World-space normals packed into [0, 1], captured alongside the colors.
+uniform sampler2D impostorNormal;
+// Turns the captured normals to follow the object's rotation since it was captured.
+uniform mat3 impostorNormalRotation;
+
+// The same lights as lighting.frag's.
+uniform vec3 ambientColor;
+uniform vec3 directionalLight; // this is the "I" vector, not the "L" vector.
+uniform vec3 directionalColor;
+#endif
+
+void main() {
+    vec2 uvA = tileA.xy + QuadCoord * tileA.zw;
+    vec2 uvB = tileB.xy + QuadCoord * tileB.zw;
+    vec4 colorA = texture(impostorColor, uvA);
+    vec4 colorB = texture(impostorColor, uvB);
+    float weightA = colorA.a * (1.0 - viewBlend);
+    float weightB = colorB.a * viewBlend;
+    if (weightA + weightB < 0.5) {
+        discard;
+    }
+
+    // Captured depth runs from 0 at the front of the bounding sphere to 1 at its back. Push the
+    // fragment that far behind the quad, which passes through the sphere's center.
+    float depth = (texture(impostorDepth, uvA).r * weightA + texture(impostorDepth, uvB).r * weightB)
+        / (weightA + weightB);
+    vec3 toCamera = normalize(cameraPos.xyz - FragWorldPos);
+    vec3 surface = FragWorldPos - toCamera * (2.0 * depth - 1.0) * impostorRadius;
+    vec4 clip = projection * view * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    vec3 color = (colorA.rgb * weightA + colorB.rgb * weightB) / (weightA + weightB);
+#ifdef LIGHTING
+    vec3 normal = (texture(impostorNormal, uvA).xyz * 2.0 - 1.0) * weightA
+        + (texture(impostorNormal, uvB).xyz * 2.0 - 1.0) * weightB;
+    normal = normalize(impostorNormalRotation * normal);
+    color *= ambientColor + directionalColor * max(dot(normal, -directionalLight), 0.0);
+#endif
+    FragColor = vec4(color, 1.0);
+}
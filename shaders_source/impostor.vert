@@ -0,0 +1,25 @@
+#version 330
+// A vertex shader that expands a quad into a camera-facing square covering an impostor's bounding sphere.
+layout (location=0) in vec3 vPosition;
+
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+
+out vec2 QuadCoord;
+out vec3 FragWorldPos;
+
+void main() {
+    // The first two rows of the view matrix are the camera's right and up vectors in world space.
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    FragWorldPos = impostorCenter + (right * vPosition.x + up * vPosition.y) * impostorRadius;
+    QuadCoord = vPosition.xy * 0.5 + 0.5;
+    gl_Position = projection * view * vec4(FragWorldPos, 1.0);
+}
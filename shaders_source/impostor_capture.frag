@@ -0,0 +1,51 @@
+#version 330
+// A fragment shader for capturing an object into an impostor: writes the textured color and the
+// world-space normal to two render targets.
+layout (location=0) out vec4 FragColor;
+layout (location=1) out vec4 FragNormal;
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+// The mesh's base (diffuse) texture, packed by the application into a layer of a texture array or
+// into a rectangle of an atlas layer.
+uniform sampler2DArray baseTexture;
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    // The mesh's element of the Materials block.
+    uint materialIndex;
+};
+
+struct MaterialData {
+    // Material parameters: k_a, k_d, k_s, shininess.
+    vec4 parameters;
+    // The scale (xy) and offset (zw) from the mesh's texture coordinates to its base texture's
+    // rectangle of its layer, and that layer.
+    vec4 baseTextureRect;
+    float baseTextureLayer;
+};
+
+// Every material, from the application's MaterialLibrary. This length matches its MAX_MATERIALS.
+layout (std140) uniform Materials {
+    MaterialData materials[256];
+};
+
+// Samples the mesh's base texture, repeating it within its rectangle of its layer. The gradients of
+// the unwrapped coordinates keep the mip level from jumping where the coordinates wrap.
+vec4 sampleBaseTexture(vec2 uv) {
+    vec4 rect = materials[materialIndex].baseTextureRect;
+    vec2 wrapped = rect.zw + fract(uv) * rect.xy;
+    return textureGrad(baseTexture, vec3(wrapped, materials[materialIndex].baseTextureLayer),
+        dFdx(uv) * rect.xy, dFdy(uv) * rect.xy);
+}
+
+void main() {
+    // Every covered texel is opaque; the empty background keeps an alpha of 0.
+    FragColor = vec4(sampleBaseTexture(TexCoord).rgb, 1.0);
+    // Pack the normal from [-1, 1] into [0, 1].
+    FragNormal = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+}
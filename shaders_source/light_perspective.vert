@@ -1,27 +1,102 @@
 #version 330
 // A vertex shader for rendering vertices with normal vectors and texture coordinates,
 // which creates outputs needed for a Phong reflection fragment shader.
+// ShaderPermutations compiles variants of it by defining INSTANCING, QUANTIZED_VERTICES, SKINNING, or
+// LIGHTMAP on the line after #version.
 layout (location=0) in vec3 vPosition;
 layout (location=1) in vec3 vNormal;
 layout (location=2) in vec2 vTexCoord;
+layout (location=3) in float vOcclusion;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+#ifdef INSTANCING
+// Each instance's matrices, computed on the CPU. A mat4 attribute takes four locations and a
+// mat3 three, so these fill locations 4 through 14.
+layout (location=4) in mat4 instanceModel;
+layout (location=8) in mat4 instanceModelViewProjection;
+layout (location=12) in mat3 instanceNormalMatrix;
+#endif
+
+#ifdef SKINNING
+// Up to four bones per vertex, whose weights sum to 1. These take locations that instancing also
+// uses, so a variant cannot have both.
+layout (location=4) in uvec4 vBoneIndices;
+layout (location=5) in vec4 vBoneWeights;
+const int MAX_BONES = 64;
+// Each bone's bind-pose local space -> animated local space transformation.
+uniform mat4 bones[MAX_BONES];
+#endif
+
+#ifdef LIGHTMAP
+// Lightmap texture coordinates, after the locations of the instance attributes.
+layout (location=15) in vec2 vLightmapCoord;
+out vec2 LightmapCoord;
+#endif
+
+#ifdef QUANTIZED_VERTICES
+// Positions and normals are normalized 16-bit integers, which arrive in [-1, 1]. Positions are
+// relative to the center of the mesh's bounding box, scaled by its half extent.
+uniform vec3 quantizationCenter;
+uniform vec3 quantizationExtent;
+#endif
+
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
+
+// The depth prepass computes gl_Position in depth_only.vert; both must round it the same way for the
+// GL_EQUAL depth test after the prepass.
+invariant gl_Position;
 
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragWorldPos;
+out float Occlusion;
 
 void main() {
+    vec3 position = vPosition;
+    vec3 normal = vNormal;
+#ifdef QUANTIZED_VERTICES
+    position = quantizationCenter + position * quantizationExtent;
+    normal = normalize(normal);
+#endif
+#ifdef SKINNING
+    mat4 skin = bones[vBoneIndices.x] * vBoneWeights.x + bones[vBoneIndices.y] * vBoneWeights.y
+        + bones[vBoneIndices.z] * vBoneWeights.z + bones[vBoneIndices.w] * vBoneWeights.w;
+    position = vec3(skin * vec4(position, 1.0));
+    normal = mat3(skin) * normal;
+#endif
+
+    // The local->world matrices come from the Draw block, or from the instance attributes in an
+    // instanced variant. "model" is this vertex's local->world matrix in every variant.
+#ifdef INSTANCING
+    mat4 model = instanceModel;
+    mat4 modelViewProjection = instanceModelViewProjection;
+    mat3 normalMatrix = instanceNormalMatrix;
+#endif
+
     // Transform the vertex position from local space to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = modelViewProjection * vec4(position, 1.0);
     // Pass along the vertex texture coordinate.
     TexCoord = vTexCoord;
+    // Pass along the ambient occlusion baked at import time.
+    Occlusion = vOcclusion;
+#ifdef LIGHTMAP
+    LightmapCoord = vLightmapCoord;
+#endif
     // Transform the vertex normal from local space to world space, using the Normal matrix.
-    mat4 normalMatrix = transpose(inverse(model));
-    Normal = mat3(normalMatrix) * vNormal;
+    Normal = mat3(normalMatrix) * normal;
     
     // TODO: transform the vertex position into world space, and assign it to FragWorldPos.
 
-}
\ No newline at end of file
+}
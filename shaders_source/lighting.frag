@@ -1,5 +1,10 @@
 #version 330
 // A fragment shader for rendering fragments in the Phong reflection model.
+// ShaderPermutations compiles variants of it: without LIGHTING defined it only applies the base
+// texture, NORMAL_MAP perturbs the normal with the mesh's normal map, CLUSTERED_LIGHTS adds the
+// point and spot lights of the fragment's cluster, SHADOWS shadows the directional light, and LIGHTMAP
+// replaces the ambient and directional light with light baked into a texture. The lighting functions
+// and their uniforms are in lighting_common.glsl, which ShaderPermutations inserts after the #defines.
 layout (location=0) out vec4 FragColor;
 
 // Inputs: the texture coordinates, world-space normal, and world-space position
@@ -7,36 +12,110 @@ layout (location=0) out vec4 FragColor;
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragWorldPos;
+// The ambient occlusion baked into the mesh's vertices (1 if none was baked).
+in float Occlusion;
 
 // Uniforms: MUST BE PROVIDED BY THE APPLICATION.
 
-// The mesh's base (diffuse) texture.
-uniform sampler2D baseTexture;
+// The mesh's base (diffuse) texture, packed by the application into a layer of a texture array or
+// into a rectangle of an atlas layer.
+uniform sampler2DArray baseTexture;
 
-// Material parameters for the whole mesh: k_a, k_d, k_s, shininess.
-uniform vec4 material;
+#ifdef LIGHTMAP
+// The light baked by the application's LightmapBaker, and where this fragment reads it.
+uniform sampler2D lightmap;
+in vec2 LightmapCoord;
+#endif
 
-// Ambient light color.
-uniform vec3 ambientColor;
+#ifdef NORMAL_MAP
+// A tangent-space normal map.
+uniform sampler2D normalMap;
 
-// Direction and color of a single directional light.
-uniform vec3 directionalLight; // this is the "I" vector, not the "L" vector.
-uniform vec3 directionalColor;
+// Meshes have no tangents, so the tangent frame is rebuilt from screen-space derivatives of the
+// position and texture coordinates (Schuler, "Normal Mapping Without Precomputed Tangents").
+vec3 perturbNormal(vec3 normal) {
+    vec3 dPositionX = dFdx(FragWorldPos);
+    vec3 dPositionY = dFdy(FragWorldPos);
+    vec2 dTexCoordX = dFdx(TexCoord);
+    vec2 dTexCoordY = dFdy(TexCoord);
+    vec3 perpendicularY = cross(dPositionY, normal);
+    vec3 perpendicularX = cross(normal, dPositionX);
+    vec3 tangent = perpendicularY * dTexCoordX.x + perpendicularX * dTexCoordY.x;
+    vec3 bitangent = perpendicularY * dTexCoordX.y + perpendicularX * dTexCoordY.y;
+    float scale = inversesqrt(max(dot(tangent, tangent), dot(bitangent, bitangent)));
+    vec3 mapped = texture(normalMap, TexCoord).xyz * 2.0 - 1.0;
+    return normalize(mat3(tangent * scale, bitangent * scale, normal) * mapped);
+}
+#endif
 
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    // The mesh's element of the Materials block.
+    uint materialIndex;
+};
 
+struct MaterialData {
+    // Material parameters: k_a, k_d, k_s, shininess.
+    vec4 parameters;
+    // The scale (xy) and offset (zw) from the mesh's texture coordinates to its base texture's
+    // rectangle of its layer, and that layer.
+    vec4 baseTextureRect;
+    float baseTextureLayer;
+};
 
-// Location of the camera.
-uniform vec3 viewPos;
+// Every material, from the application's MaterialLibrary. This length matches its MAX_MATERIALS.
+layout (std140) uniform Materials {
+    MaterialData materials[256];
+};
+
+// The parameters of the mesh's material, looked up at the start of main.
+vec4 material;
+
+// Samples the mesh's base texture, repeating it within its rectangle of its layer. The gradients of
+// the unwrapped coordinates keep the mip level from jumping where the coordinates wrap.
+vec4 sampleBaseTexture(vec2 uv) {
+    vec4 rect = materials[materialIndex].baseTextureRect;
+    vec2 wrapped = rect.zw + fract(uv) * rect.xy;
+    return textureGrad(baseTexture, vec3(wrapped, materials[materialIndex].baseTextureLayer),
+        dFdx(uv) * rect.xy, dFdy(uv) * rect.xy);
+}
 
 
 void main() {
-    // TODO: using the lecture notes, compute ambientIntensity, diffuseIntensity, 
-    // and specularIntensity.
+    material = materials[materialIndex].parameters;
+#ifdef LIGHTING
+    // The fragment's unit normal; light the fragment with this rather than Normal.
+    vec3 normal = normalize(Normal);
+#ifdef NORMAL_MAP
+    normal = perturbNormal(normal);
+#endif
 
-    vec3 ambientIntensity = vec3(0);
-    vec3 diffuseIntensity = vec3(0);
-    vec3 specularIntensity = vec3(0);
+    vec3 ambientIntensity;
+    vec3 diffuseIntensity;
+    vec3 specularIntensity;
+    phongDirectional(FragWorldPos, normal, material, ambientIntensity, diffuseIntensity, specularIntensity);
+#ifdef SHADOWS
+    float shadow = directionalShadow(FragWorldPos, normal);
+    diffuseIntensity *= shadow;
+    specularIntensity *= shadow;
+#endif
+#ifdef LIGHTMAP
+    // The baked light already includes the ambient and directional light, with their shadows and
+    // bounces; the specular highlight and any clustered lights are still added here.
+    ambientIntensity = vec3(0);
+    diffuseIntensity = material.y * texture(lightmap, LightmapCoord).rgb;
+#endif
+#ifdef CLUSTERED_LIGHTS
+    addClusteredLights(FragWorldPos, normal, material, gl_FragCoord.z, diffuseIntensity, specularIntensity);
+#endif
 
-    vec3 lightIntensity = ambientIntensity + diffuseIntensity + specularIntensity;
-    FragColor = vec4(lightIntensity, 1) * texture(baseTexture, TexCoord);
+    // Baked occlusion only darkens the ambient term; direct light is not affected.
+    vec3 lightIntensity = ambientIntensity * Occlusion + diffuseIntensity + specularIntensity;
+    FragColor = vec4(lightIntensity, 1) * sampleBaseTexture(TexCoord);
+#else
+    FragColor = sampleBaseTexture(TexCoord);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+// Shading code shared by lighting.frag and deferred_lighting.frag. Their ShaderPermutations insert it
+// after the #version line and feature #defines, so the forward and deferred passes light surfaces
+// with the same functions: the ambient and directional Phong terms, the clustered point and spot
+// lights (CLUSTERED_LIGHTS), and the directional light's shadow (SHADOWS).
+
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    // Location of the camera.
+    vec4 cameraPos;
+};
+
+// Ambient light color.
+uniform vec3 ambientColor;
+
+// Direction and color of a single directional light.
+uniform vec3 directionalLight; // this is the "I" vector, not the "L" vector.
+uniform vec3 directionalColor;
+
+// Computes the Phong terms of the ambient and directional light at a surface, from its world-space
+// position, unit normal, and material parameters (k_a, k_d, k_s, shininess).
+void phongDirectional(vec3 position, vec3 normal, vec4 material,
+    out vec3 ambientIntensity, out vec3 diffuseIntensity, out vec3 specularIntensity) {
+    // TODO: using the lecture notes, compute ambientIntensity, diffuseIntensity, 
+    // and specularIntensity.
+
+    ambientIntensity = vec3(0);
+    diffuseIntensity = vec3(0);
+    specularIntensity = vec3(0);
+}
+
+#ifdef CLUSTERED_LIGHTS
+// The application's ClusteredLighting grid. These dimensions match its CLUSTERS_X/Y/Z.
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 9;
+const int CLUSTERS_Z = 24;
+
+// Three texels per light: position and range; color and outer cone cosine; direction and inner cone cosine.
+uniform samplerBuffer clusterLights;
+// The offset and count of each cluster's run of clusterLightIndices.
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+// The size in pixels of one screen tile of the grid.
+uniform vec2 clusterTileSize;
+// A view depth's slice is log(depth) * clusterDepthScale + clusterDepthBias.
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+
+// Adds the diffuse and specular light of every light assigned to the cluster of this pixel, whose
+// surface is at the given world-space position and window depth.
+void addClusteredLights(vec3 position, vec3 normal, vec4 material, float windowDepth,
+    inout vec3 diffuseIntensity, inout vec3 specularIntensity) {
+    // Undo the projection of the window depth to find the distance in front of the camera.
+    float ndcDepth = windowDepth * 2.0 - 1.0;
+    float depth = projection[3][2] / (ndcDepth + projection[2][2]);
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(log(depth) * clusterDepthScale + clusterDepthBias));
+    cluster = clamp(cluster, ivec3(0), ivec3(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z) - 1);
+    uvec2 run = texelFetch(clusterGrid, cluster.x + CLUSTERS_X * (cluster.y + CLUSTERS_Y * cluster.z)).xy;
+
+    vec3 toEye = normalize(cameraPos.xyz - position);
+    for (uint i = 0u; i < run.y; ++i) {
+        int texel = int(texelFetch(clusterLightIndices, int(run.x + i)).x) * 3;
+        vec4 positionRange = texelFetch(clusterLights, texel);
+        vec4 colorOuter = texelFetch(clusterLights, texel + 1);
+        vec4 directionInner = texelFetch(clusterLights, texel + 2);
+
+        vec3 toLight = positionRange.xyz - position;
+        float lightDistance = length(toLight);
+        vec3 L = toLight / lightDistance;
+        float lambert = dot(normal, L);
+        if (lambert <= 0.0 || lightDistance >= positionRange.w) {
+            continue;
+        }
+        float falloff = 1.0 - lightDistance / positionRange.w;
+        float cone = smoothstep(colorOuter.w, directionInner.w, dot(-L, directionInner.xyz));
+        vec3 radiance = colorOuter.rgb * (falloff * falloff * cone);
+        diffuseIntensity += material.y * lambert * radiance;
+        specularIntensity += material.z * pow(max(dot(reflect(-L, normal), toEye), 0.0), material.w) * radiance;
+    }
+}
+#endif
+
+#ifdef SHADOWS
+// The application's CascadedShadowMaps. This count matches its CASCADES.
+const int CASCADES = 4;
+
+// One depth layer per cascade, compared against a reference depth when sampled.
+uniform sampler2DArrayShadow shadowMap;
+// The world->shadow texture matrix of each cascade.
+uniform mat4 shadowMatrices[CASCADES];
+// The view depth where each cascade's slice ends, and the world-space size of one of its texels.
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeTexelSizes;
+
+// Returns how much of the directional light reaches a surface, from 0 (shadowed) to 1 (lit).
+float directionalShadow(vec3 position, vec3 normal) {
+    float depth = -(view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < CASCADES && depth > cascadeSplits[cascade]) {
+        ++cascade;
+    }
+    if (cascade == CASCADES) {
+        // Beyond the shadow distance.
+        return 1.0;
+    }
+    // Sampling a little above the surface keeps it from shadowing itself where it faces away from
+    // the light.
+    vec3 offsetPosition = position + normal * (1.5 * cascadeTexelSizes[cascade]);
+    vec3 shadowCoord = (shadowMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz;
+    // Four bilinear comparisons half a texel apart filter over a 3x3 texel footprint.
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        vec2 offset = (vec2(i & 1, i >> 1) - 0.5) * texel;
+        lit += texture(shadowMap, vec4(shadowCoord.xy + offset, float(cascade), shadowCoord.z));
+    }
+    return lit * 0.25;
+}
+#endif
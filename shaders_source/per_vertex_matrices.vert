@@ -0,0 +1,30 @@
+#version 330
+// texture_perspective.vert as it was before the matrices moved to the CPU: it builds the
+// model-view-projection and normal matrices for every vertex. Kept for the vertex throughput benchmark.
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec3 vNormal;
+layout (location=2) in vec2 vTexCoord;
+
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
+
+out vec2 TexCoord;
+out vec3 Normal;
+
+void main() {
+    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    TexCoord = vTexCoord;
+    Normal = transpose(inverse(mat3(model))) * vNormal;
+}
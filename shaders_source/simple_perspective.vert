@@ -1,11 +1,22 @@
 #version 330
 layout (location=0) in vec3 vPosition;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+// Camera state shared by every program, from the application's FrameUniformBuffer.
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+};
+
+// Per-draw state, from the application's DrawUniformRing.
+layout (std140) uniform Draw {
+    mat4 model;
+    mat4 modelViewProjection;
+    mat4 normalMatrix;
+    uint materialIndex;
+};
 
 void main() {
     // Project the position to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = modelViewProjection * vec4(vPosition, 1.0);
 }
\ No newline at end of file
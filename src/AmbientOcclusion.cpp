@@ -0,0 +1,83 @@
+#include "AmbientOcclusion.h"
+#include "Bvh.h"
+#include "Parallel.h"
+#include <cmath>
+#include <numbers>
+
+namespace {
+	// The i-th point of a 2D Hammersley set of the given size, in [0, 1)^2.
+	glm::vec2 hammersley(uint32_t i, uint32_t count) {
+		uint32_t bits{ i };
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		return glm::vec2{ (i + 0.5f) / count, bits * 2.3283064365386963e-10f };
+	}
+
+	// Hashes a vertex index to a value in [0, 1), used to rotate each vertex's sample pattern
+	// so that neighboring vertices do not share the same banding.
+	float hashToUnit(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+void bakeAmbientOcclusion(std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
+	uint32_t rayCount, float maxDistance) {
+	if (vertices.empty() || rayCount == 0) {
+		return;
+	}
+
+	std::vector<glm::vec3> positions{};
+	positions.reserve(vertices.size());
+	for (auto& v : vertices) {
+		positions.emplace_back(v.x, v.y, v.z);
+	}
+	Bvh bvh{ positions, faces };
+	BoundingBox bounds{ computeBoundingBox(&positions[0].x, positions.size(), sizeof(glm::vec3)) };
+
+	// Start each ray slightly above the surface, so it does not hit the triangles around its own vertex.
+	float bias{ 1e-4f * glm::length(bounds.max - bounds.min) };
+
+	parallelFor(vertices.size(), 256, [&](size_t begin, size_t end) {
+		for (size_t i{ begin }; i < end; ++i) {
+			auto& vertex{ vertices[i] };
+			glm::vec3 normal{ vertex.nx, vertex.ny, vertex.nz };
+			float normalLength{ glm::length(normal) };
+			if (normalLength == 0) {
+				vertex.occlusion = 1;
+				continue;
+			}
+			normal /= normalLength;
+
+			// An orthonormal basis around the normal.
+			glm::vec3 helper{ std::abs(normal.x) > 0.9f ? glm::vec3{ 0, 1, 0 } : glm::vec3{ 1, 0, 0 } };
+			glm::vec3 tangent{ glm::normalize(glm::cross(helper, normal)) };
+			glm::vec3 bitangent{ glm::cross(normal, tangent) };
+
+			glm::vec3 origin{ positions[i] + normal * bias };
+			float rotation{ hashToUnit(static_cast<uint32_t>(i)) };
+			uint32_t hits{ 0 };
+			for (uint32_t r{ 0 }; r < rayCount; ++r) {
+				// Cosine-weighted hemisphere direction, so the result matches diffuse (Lambertian) falloff.
+				glm::vec2 sample{ hammersley(r, rayCount) };
+				float phi{ 2 * std::numbers::pi_v<float> * std::fmod(sample.y + rotation, 1.0f) };
+				float radius{ std::sqrt(sample.x) };
+				glm::vec3 direction{
+					tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi))
+					+ normal * std::sqrt(1 - sample.x)
+				};
+				if (bvh.occluded(origin, direction, maxDistance)) {
+					++hits;
+				}
+			}
+			vertex.occlusion = 1 - static_cast<float>(hits) / rayCount;
+		}
+	});
+}
@@ -1,4 +1,7 @@
 #include "AssimpImport.h"
+#include "AmbientOcclusion.h"
+#include "Lightmap.h"
+#include "Occlusion.h"
 #include <iostream>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -36,7 +39,7 @@ std::vector<Texture> loadMaterialTextures(
 }
 
 Mesh fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures) {
+	std::unordered_map<std::string, Texture>& loadedTextures, const AssimpImportOptions& options) {
 	std::vector<Vertex3D> vertices;
 
 	for (size_t i{ 0 }; i < mesh->mNumVertices; i++) {
@@ -61,6 +64,19 @@ Mesh fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesys
 		faces.push_back(meshFace.mIndices[2]);
 	}
 
+	// Compute the bounds from assimp's own positions, which are always complete.
+	const float* positions{ mesh->mNumVertices > 0 ? &mesh->mVertices[0].x : nullptr };
+	BoundingBox bounds{ computeBoundingBox(positions, mesh->mNumVertices, sizeof(aiVector3D)) };
+
+	// The bake traces rays against the Vertex3D list, so it only runs once the loop above fills it.
+	if (options.bakeAmbientOcclusion && !vertices.empty()) {
+		bakeAmbientOcclusion(vertices, faces, options.occlusionRays,
+			options.occlusionDistance * glm::length(bounds.max - bounds.min));
+	}
+	if (options.lightmapResolution > 0 && !vertices.empty()) {
+		generateLightmapCharts(vertices, faces, options.lightmapResolution);
+	}
+
 	// Load any base textures, specular maps, and normal maps associated with the mesh.
 	std::vector<Texture> textures{};
 	if (mesh->mMaterialIndex >= 0) {
@@ -84,10 +100,22 @@ Mesh fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesys
 		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 	}
 
-	return Mesh{ vertices, faces, std::move(textures) };
+	// Meshes of the same aiMaterial, or of aiMaterials with the same textures, share one Material.
+	Mesh result{ vertices, faces, MaterialLibrary::intern(Material{}.parameters, std::move(textures)) };
+	result.setBounds(bounds, computeBoundingSphere(positions, mesh->mNumVertices, sizeof(aiVector3D), bounds));
+	// Without its vertices, the mesh has no triangles to ray cast.
+	if (options.retainGeometry && !vertices.empty()) {
+		result.retainGeometry(vertices, faces);
+	}
+	// Occluders only need positions, which assimp always has, even while the Vertex3D list is empty.
+	if (options.buildOccluders) {
+		result.setOccluder(std::make_shared<const OccluderProxy>(buildOccluderProxy(positions, mesh->mNumVertices,
+			sizeof(aiVector3D), faces, options.occluderGridResolution)));
+	}
+	return result;
 }
 
-Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
+Object3D assimpLoad(const std::string& path, bool flipTextureCoords, const AssimpImportOptions& importOptions) {
 	Assimp::Importer importer{};
 
 	auto options{ aiProcessPreset_TargetRealtime_MaxQuality };
@@ -104,7 +132,7 @@ Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
 	}
 	std::vector<Mesh> meshes{};
 	std::unordered_map<std::string, Texture> loadedTextures{};
-	return processAssimpNode(scene->mRootNode, scene, std::filesystem::path{ path }, loadedTextures);
+	return processAssimpNode(scene->mRootNode, scene, std::filesystem::path{ path }, loadedTextures, importOptions);
 }
 
 // A "Node" in assimp is an Object3D in our framework. It has one or more meshes,
@@ -113,13 +141,14 @@ Object3D processAssimpNode(
 	const aiNode* node, 
 	const aiScene* scene,
 	const std::filesystem::path& modelPath,
-	std::unordered_map<std::string, Texture>& loadedTextures
+	std::unordered_map<std::string, Texture>& loadedTextures,
+	const AssimpImportOptions& options
 ) {
 	// Load the aiNode's meshes.
 	std::vector<Mesh> meshes{};
 	for (size_t i{ 0 }; i < node->mNumMeshes; ++i) {
 		aiMesh* mesh{ scene->mMeshes[node->mMeshes[i]] };
-		meshes.emplace_back(fromAssimpMesh(mesh, scene, modelPath, loadedTextures));
+		meshes.emplace_back(fromAssimpMesh(mesh, scene, modelPath, loadedTextures, options));
 	}
 
 	// Load the node's textures.
@@ -141,7 +170,7 @@ Object3D processAssimpNode(
 
 	// Recursively process the children of the node and add them as child objects.
 	for (size_t i{ 0 }; i < node->mNumChildren; ++i) {
-		Object3D child{ processAssimpNode(node->mChildren[i], scene, modelPath, loadedTextures) };
+		Object3D child{ processAssimpNode(node->mChildren[i], scene, modelPath, loadedTextures, options) };
 		parent.addChild(std::move(child));
 	}
 
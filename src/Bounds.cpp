@@ -0,0 +1,111 @@
+#include "Bounds.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BOUNDS_USE_SSE 1
+#endif
+
+namespace {
+	const float* positionAt(const float* positions, size_t index, size_t stride) {
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * stride);
+	}
+}
+
+bool BoundingBox::isEmpty() const {
+	return min.x > max.x;
+}
+
+glm::vec3 BoundingBox::center() const {
+	return (min + max) * 0.5f;
+}
+
+glm::vec3 BoundingBox::halfExtent() const {
+	return (max - min) * 0.5f;
+}
+
+void BoundingBox::grow(const glm::vec3& point) {
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void BoundingBox::grow(const BoundingBox& other) {
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+BoundingBox BoundingBox::transformed(const glm::mat4& matrix) const {
+	if (isEmpty()) {
+		return *this;
+	}
+	// Transform the center, and find the new half extent from the absolute value of the matrix
+	// (Arvo, "Transforming Axis-Aligned Bounding Boxes").
+	glm::vec3 newCenter{ matrix * glm::vec4{ center(), 1 } };
+	glm::vec3 e{ halfExtent() };
+	glm::vec3 newExtent{
+		std::abs(matrix[0][0]) * e.x + std::abs(matrix[1][0]) * e.y + std::abs(matrix[2][0]) * e.z,
+		std::abs(matrix[0][1]) * e.x + std::abs(matrix[1][1]) * e.y + std::abs(matrix[2][1]) * e.z,
+		std::abs(matrix[0][2]) * e.x + std::abs(matrix[1][2]) * e.y + std::abs(matrix[2][2]) * e.z
+	};
+	return BoundingBox{ newCenter - newExtent, newCenter + newExtent };
+}
+
+BoundingBox computeBoundingBox(const float* positions, size_t count, size_t stride) {
+	BoundingBox box{};
+	if (count == 0) {
+		return box;
+	}
+#ifdef BOUNDS_USE_SSE
+	// Each position is loaded as four floats, the fourth of which belongs to whatever follows it.
+	// That lane is ignored, but the last position must not be loaded this way in case nothing follows it.
+	__m128 minA{ _mm_set1_ps(std::numeric_limits<float>::max()) };
+	__m128 maxA{ _mm_set1_ps(std::numeric_limits<float>::lowest()) };
+	__m128 minB{ minA };
+	__m128 maxB{ maxA };
+	size_t i{ 0 };
+	// Two independent accumulators, so consecutive min/max operations do not wait on each other.
+	for (; i + 2 < count; i += 2) {
+		__m128 a{ _mm_loadu_ps(positionAt(positions, i, stride)) };
+		__m128 b{ _mm_loadu_ps(positionAt(positions, i + 1, stride)) };
+		minA = _mm_min_ps(minA, a);
+		maxA = _mm_max_ps(maxA, a);
+		minB = _mm_min_ps(minB, b);
+		maxB = _mm_max_ps(maxB, b);
+	}
+	for (; i < count; ++i) {
+		const float* p{ positionAt(positions, i, stride) };
+		__m128 a{ _mm_setr_ps(p[0], p[1], p[2], p[2]) };
+		minA = _mm_min_ps(minA, a);
+		maxA = _mm_max_ps(maxA, a);
+	}
+	alignas(16) float minOut[4];
+	alignas(16) float maxOut[4];
+	_mm_store_ps(minOut, _mm_min_ps(minA, minB));
+	_mm_store_ps(maxOut, _mm_max_ps(maxA, maxB));
+	box.min = glm::vec3{ minOut[0], minOut[1], minOut[2] };
+	box.max = glm::vec3{ maxOut[0], maxOut[1], maxOut[2] };
+#else
+	for (size_t i{ 0 }; i < count; ++i) {
+		const float* p{ positionAt(positions, i, stride) };
+		box.grow(glm::vec3{ p[0], p[1], p[2] });
+	}
+#endif
+	return box;
+}
+
+BoundingSphere computeBoundingSphere(const float* positions, size_t count, size_t stride, const BoundingBox& box) {
+	if (count == 0 || box.isEmpty()) {
+		return BoundingSphere{};
+	}
+	// Centering the sphere on the box is not optimal, but it is usually much tighter than the
+	// box's own circumscribed sphere.
+	glm::vec3 center{ box.center() };
+	float radiusSquared{ 0 };
+	for (size_t i{ 0 }; i < count; ++i) {
+		const float* p{ positionAt(positions, i, stride) };
+		glm::vec3 offset{ glm::vec3{ p[0], p[1], p[2] } - center };
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	return BoundingSphere{ center, std::sqrt(radiusSquared) };
+}
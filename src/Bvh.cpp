@@ -0,0 +1,539 @@
+#include "Bvh.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BVH_USE_SSE 1
+#endif
+
+namespace {
+	constexpr uint32_t BIN_COUNT{ 16 };
+	constexpr uint32_t MAX_LEAF_TRIANGLES{ 8 };
+	// Subtrees with fewer triangles than this are built start to finish by one thread.
+	constexpr uint32_t PARALLEL_SUBTREE_TRIANGLES{ 16384 };
+	// The cost of visiting a node, relative to the cost of intersecting one triangle.
+	constexpr float TRAVERSAL_COST{ 1.0f };
+	// Below this depth, nodes are split at their median instead of by the SAH. This bounds the depth
+	// of the tree at 2 * 32 levels, which bounds the size of the traversal stack.
+	constexpr uint32_t MEDIAN_SPLIT_DEPTH{ 32 };
+	constexpr uint32_t STACK_SIZE{ 3 * 2 * MEDIAN_SPLIT_DEPTH + 1 };
+
+	struct Box {
+		glm::vec3 min{ std::numeric_limits<float>::max() };
+		glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+		void grow(const glm::vec3& p) {
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		void grow(const Box& b) {
+			min = glm::min(min, b.min);
+			max = glm::max(max, b.max);
+		}
+
+		float area() const {
+			if (min.x > max.x) {
+				return 0;
+			}
+			glm::vec3 d{ max - min };
+			return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+	};
+
+	struct StackEntry {
+		uint32_t node;
+		float distance;
+	};
+}
+
+struct Bvh::BuildNode {
+	glm::vec3 boundsMin{};
+	glm::vec3 boundsMax{};
+	// This node's triangles are BuildState::order[begin, end).
+	uint32_t begin{ 0 };
+	uint32_t end{ 0 };
+	uint32_t depth{ 0 };
+	std::unique_ptr<BuildNode> children[2]{};
+
+	bool isLeaf() const {
+		return children[0] == nullptr;
+	}
+};
+
+struct Bvh::BuildState {
+	std::vector<Triangle> triangles{};
+	std::vector<Box> triangleBounds{};
+	std::vector<glm::vec3> centroids{};
+	std::vector<uint32_t> order{};
+};
+
+Bvh::Bvh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& faces) {
+	uint32_t triangleCount{ static_cast<uint32_t>(faces.size() / 3) };
+	if (triangleCount == 0) {
+		return;
+	}
+	for (uint32_t index : faces) {
+		if (index >= positions.size()) {
+			throw std::runtime_error("BVH face index " + std::to_string(index) + " is out of range for "
+				+ std::to_string(positions.size()) + " vertices");
+		}
+	}
+
+	BuildState state{};
+	state.triangles.resize(triangleCount);
+	state.triangleBounds.resize(triangleCount);
+	state.centroids.resize(triangleCount);
+	state.order.resize(triangleCount);
+	parallelFor(triangleCount, 4096, [&](size_t begin, size_t end) {
+		for (size_t i{ begin }; i < end; ++i) {
+			const auto& a{ positions[faces[3 * i]] };
+			const auto& b{ positions[faces[3 * i + 1]] };
+			const auto& c{ positions[faces[3 * i + 2]] };
+			state.triangles[i] = Triangle{ a, b - a, c - a, static_cast<uint32_t>(i) };
+			Box bounds{};
+			bounds.grow(a);
+			bounds.grow(b);
+			bounds.grow(c);
+			state.triangleBounds[i] = bounds;
+			state.centroids[i] = (bounds.min + bounds.max) * 0.5f;
+			state.order[i] = static_cast<uint32_t>(i);
+		}
+	});
+
+	// Split the top of the tree on this thread, until the remaining subtrees are small enough to
+	// hand out to worker threads.
+	BuildNode root{};
+	root.end = triangleCount;
+	std::vector<BuildNode*> subtrees{};
+	buildSubtree(root, state, &subtrees);
+	parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i{ begin }; i < end; ++i) {
+			buildSubtree(*subtrees[i], state, nullptr);
+		}
+	});
+
+	m_triangles.reserve(triangleCount);
+	flatten(root, state);
+}
+
+void Bvh::buildSubtree(BuildNode& root, BuildState& state, std::vector<BuildNode*>* parallelSubtrees) {
+	std::vector<BuildNode*> pending{ &root };
+	while (!pending.empty()) {
+		BuildNode* node{ pending.back() };
+		pending.pop_back();
+		if (parallelSubtrees != nullptr && node->end - node->begin < PARALLEL_SUBTREE_TRIANGLES) {
+			parallelSubtrees->push_back(node);
+			continue;
+		}
+		if (splitNode(*node, state)) {
+			pending.push_back(node->children[0].get());
+			pending.push_back(node->children[1].get());
+		}
+	}
+}
+
+bool Bvh::splitNode(BuildNode& node, BuildState& state) {
+	Box bounds{};
+	Box centroidBounds{};
+	for (uint32_t i{ node.begin }; i < node.end; ++i) {
+		bounds.grow(state.triangleBounds[state.order[i]]);
+		centroidBounds.grow(state.centroids[state.order[i]]);
+	}
+	node.boundsMin = bounds.min;
+	node.boundsMax = bounds.max;
+
+	uint32_t count{ node.end - node.begin };
+	if (count <= 2) {
+		return false;
+	}
+
+	glm::vec3 extent{ centroidBounds.max - centroidBounds.min };
+	int longestAxis{ extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2) };
+	auto* order{ state.order.data() };
+	uint32_t middle{ node.begin + count / 2 };
+
+	if (extent[longestAxis] <= 0 || node.depth >= MEDIAN_SPLIT_DEPTH) {
+		// All centroids coincide, or the tree is getting deep: split the triangles in half.
+		if (count <= MAX_LEAF_TRIANGLES && extent[longestAxis] <= 0) {
+			return false;
+		}
+		std::nth_element(order + node.begin, order + middle, order + node.end,
+			[&](uint32_t a, uint32_t b) { return state.centroids[a][longestAxis] < state.centroids[b][longestAxis]; });
+	}
+	else {
+		// Bin the centroids along each axis, and find the bin boundary with the lowest SAH cost.
+		float bestCost{ std::numeric_limits<float>::max() };
+		int bestAxis{ longestAxis };
+		uint32_t bestSplit{ BIN_COUNT / 2 };
+		for (int axis{ 0 }; axis < 3; ++axis) {
+			if (extent[axis] <= 0) {
+				continue;
+			}
+			Box bins[BIN_COUNT]{};
+			uint32_t binCounts[BIN_COUNT]{};
+			float scale{ BIN_COUNT * (1 - 1e-5f) / extent[axis] };
+			for (uint32_t i{ node.begin }; i < node.end; ++i) {
+				uint32_t b{ static_cast<uint32_t>((state.centroids[order[i]][axis] - centroidBounds.min[axis]) * scale) };
+				b = std::min(b, BIN_COUNT - 1);
+				++binCounts[b];
+				bins[b].grow(state.triangleBounds[order[i]]);
+			}
+
+			// Sweep from the left to get the cost of everything left of each boundary, then from the right.
+			float leftCost[BIN_COUNT - 1];
+			Box left{};
+			uint32_t leftCount{ 0 };
+			for (uint32_t b{ 0 }; b < BIN_COUNT - 1; ++b) {
+				left.grow(bins[b]);
+				leftCount += binCounts[b];
+				leftCost[b] = left.area() * leftCount;
+			}
+			Box right{};
+			uint32_t rightCount{ 0 };
+			for (uint32_t b{ BIN_COUNT - 1 }; b > 0; --b) {
+				right.grow(bins[b]);
+				rightCount += binCounts[b];
+				float cost{ leftCost[b - 1] + right.area() * rightCount };
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		float leafCost{ static_cast<float>(count) };
+		float splitCost{ TRAVERSAL_COST + bestCost / bounds.area() };
+		if (bounds.area() > 0 && splitCost >= leafCost && count <= MAX_LEAF_TRIANGLES) {
+			return false;
+		}
+
+		float scale{ BIN_COUNT * (1 - 1e-5f) / extent[bestAxis] };
+		float splitMin{ centroidBounds.min[bestAxis] };
+		auto* partition{ std::partition(order + node.begin, order + node.end, [&](uint32_t t) {
+			uint32_t b{ static_cast<uint32_t>((state.centroids[t][bestAxis] - splitMin) * scale) };
+			return std::min(b, BIN_COUNT - 1) < bestSplit;
+		}) };
+		middle = static_cast<uint32_t>(partition - order);
+		if (middle == node.begin || middle == node.end) {
+			middle = node.begin + count / 2;
+		}
+	}
+
+	for (int c{ 0 }; c < 2; ++c) {
+		node.children[c] = std::make_unique<BuildNode>();
+		node.children[c]->begin = c == 0 ? node.begin : middle;
+		node.children[c]->end = c == 0 ? middle : node.end;
+		node.children[c]->depth = node.depth + 1;
+	}
+	return true;
+}
+
+uint32_t Bvh::flatten(const BuildNode& node, const BuildState& state) {
+	// Gather up to four children, by repeatedly opening up the interior child with the largest area.
+	const BuildNode* slots[4]{ &node };
+	uint32_t slotCount{ 1 };
+	if (!node.isLeaf()) {
+		slots[0] = node.children[0].get();
+		slots[1] = node.children[1].get();
+		slotCount = 2;
+	}
+	while (slotCount < 4) {
+		int largest{ -1 };
+		float largestArea{ -1 };
+		for (uint32_t i{ 0 }; i < slotCount; ++i) {
+			float area{ Box{ slots[i]->boundsMin, slots[i]->boundsMax }.area() };
+			if (!slots[i]->isLeaf() && area > largestArea) {
+				largest = static_cast<int>(i);
+				largestArea = area;
+			}
+		}
+		if (largest < 0) {
+			break;
+		}
+		const BuildNode* opened{ slots[largest] };
+		slots[largest] = opened->children[0].get();
+		slots[slotCount++] = opened->children[1].get();
+	}
+
+	uint32_t index{ static_cast<uint32_t>(m_nodes.size()) };
+	m_nodes.emplace_back();
+	// Child nodes are appended while this node is being filled in, so fill in a copy.
+	Node result{};
+	for (uint32_t i{ 0 }; i < 4; ++i) {
+		if (i >= slotCount) {
+			result.child[i] = EMPTY;
+			continue;
+		}
+		const BuildNode& child{ *slots[i] };
+		result.minX[i] = child.boundsMin.x;
+		result.minY[i] = child.boundsMin.y;
+		result.minZ[i] = child.boundsMin.z;
+		result.maxX[i] = child.boundsMax.x;
+		result.maxY[i] = child.boundsMax.y;
+		result.maxZ[i] = child.boundsMax.z;
+		if (child.isLeaf()) {
+			result.child[i] = static_cast<uint32_t>(m_triangles.size());
+			result.count[i] = child.end - child.begin;
+			for (uint32_t t{ child.begin }; t < child.end; ++t) {
+				m_triangles.push_back(state.triangles[state.order[t]]);
+			}
+		}
+		else {
+			result.child[i] = flatten(child, state);
+			result.count[i] = 0;
+		}
+	}
+	m_nodes[index] = result;
+	return index;
+}
+
+uint32_t Bvh::rayHitsChildren(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+	float maxDistance, float entryDistances[4]) {
+#ifdef BVH_USE_SSE
+	__m128 tx0{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverseDirection.x)) };
+	__m128 tx1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), _mm_set1_ps(origin.x)), _mm_set1_ps(inverseDirection.x)) };
+	__m128 ty0{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverseDirection.y)) };
+	__m128 ty1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), _mm_set1_ps(origin.y)), _mm_set1_ps(inverseDirection.y)) };
+	__m128 tz0{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverseDirection.z)) };
+	__m128 tz1{ _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), _mm_set1_ps(origin.z)), _mm_set1_ps(inverseDirection.z)) };
+	__m128 enter{ _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+		_mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps())) };
+	__m128 exit{ _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+		_mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(maxDistance))) };
+	_mm_storeu_ps(entryDistances, enter);
+	return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(enter, exit)));
+#else
+	uint32_t mask{ 0 };
+	for (int i{ 0 }; i < 4; ++i) {
+		glm::vec3 t0{ (glm::vec3{ node.minX[i], node.minY[i], node.minZ[i] } - origin) * inverseDirection };
+		glm::vec3 t1{ (glm::vec3{ node.maxX[i], node.maxY[i], node.maxZ[i] } - origin) * inverseDirection };
+		glm::vec3 tNear{ glm::min(t0, t1) };
+		glm::vec3 tFar{ glm::max(t0, t1) };
+		float enter{ std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f)) };
+		float exit{ std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance)) };
+		entryDistances[i] = enter;
+		mask |= (enter <= exit ? 1u : 0u) << i;
+	}
+	return mask;
+#endif
+}
+
+uint32_t Bvh::sphereHitsChildren(const Node& node, const glm::vec3& center, float radius) {
+#ifdef BVH_USE_SSE
+	// The squared distance from the center to each box, summed over the axes where it lies outside the box.
+	__m128 zero{ _mm_setzero_ps() };
+	__m128 distanceSquared{ zero };
+	const float* mins[3]{ node.minX, node.minY, node.minZ };
+	const float* maxs[3]{ node.maxX, node.maxY, node.maxZ };
+	for (int axis{ 0 }; axis < 3; ++axis) {
+		__m128 c{ _mm_set1_ps(center[axis]) };
+		__m128 outside{ _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(mins[axis]), c), zero),
+			_mm_max_ps(_mm_sub_ps(c, _mm_load_ps(maxs[axis])), zero)) };
+		distanceSquared = _mm_add_ps(distanceSquared, _mm_mul_ps(outside, outside));
+	}
+	return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_set1_ps(radius * radius))));
+#else
+	uint32_t mask{ 0 };
+	for (int i{ 0 }; i < 4; ++i) {
+		glm::vec3 outside{
+			glm::max(glm::vec3{ node.minX[i], node.minY[i], node.minZ[i] } - center, glm::vec3{ 0 })
+			+ glm::max(center - glm::vec3{ node.maxX[i], node.maxY[i], node.maxZ[i] }, glm::vec3{ 0 })
+		};
+		mask |= (glm::dot(outside, outside) <= radius * radius ? 1u : 0u) << i;
+	}
+	return mask;
+#endif
+}
+
+bool Bvh::intersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction,
+	float& distance, float& u, float& v) {
+	// Moller-Trumbore ray/triangle intersection.
+	glm::vec3 p{ glm::cross(direction, triangle.edge2) };
+	float determinant{ glm::dot(triangle.edge1, p) };
+	if (std::abs(determinant) < 1e-12f) {
+		return false;
+	}
+	float inverseDeterminant{ 1.0f / determinant };
+	glm::vec3 s{ origin - triangle.v0 };
+	u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0 || u > 1) {
+		return false;
+	}
+	glm::vec3 q{ glm::cross(s, triangle.edge1) };
+	v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0 || u + v > 1) {
+		return false;
+	}
+	distance = glm::dot(triangle.edge2, q) * inverseDeterminant;
+	return distance > 0;
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const {
+	if (m_nodes.empty()) {
+		return false;
+	}
+	glm::vec3 inverseDirection{ 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+	bool found{ false };
+	float closest{ maxDistance };
+
+	StackEntry stack[STACK_SIZE];
+	uint32_t stackSize{ 0 };
+	stack[stackSize++] = StackEntry{ 0, 0 };
+	while (stackSize > 0) {
+		StackEntry entry{ stack[--stackSize] };
+		if (entry.distance > closest) {
+			continue;
+		}
+		const Node& node{ m_nodes[entry.node] };
+		float entryDistances[4];
+		uint32_t mask{ rayHitsChildren(node, origin, inverseDirection, closest, entryDistances) };
+
+		StackEntry interior[4];
+		uint32_t interiorCount{ 0 };
+		for (uint32_t i{ 0 }; i < 4; ++i) {
+			if (!(mask & (1u << i)) || node.child[i] == EMPTY) {
+				continue;
+			}
+			if (node.count[i] == 0) {
+				interior[interiorCount++] = StackEntry{ node.child[i], entryDistances[i] };
+				continue;
+			}
+			for (uint32_t t{ node.child[i] }; t < node.child[i] + node.count[i]; ++t) {
+				float distance, u, v;
+				if (intersectTriangle(m_triangles[t], origin, direction, distance, u, v) && distance < closest) {
+					closest = distance;
+					hit = BvhHit{ distance, m_triangles[t].id, u, v };
+					found = true;
+				}
+			}
+		}
+
+		// Push the farthest child first, so the nearest is visited next.
+		std::sort(interior, interior + interiorCount,
+			[](const StackEntry& a, const StackEntry& b) { return a.distance > b.distance; });
+		for (uint32_t i{ 0 }; i < interiorCount; ++i) {
+			stack[stackSize++] = interior[i];
+		}
+	}
+	return found;
+}
+
+bool Bvh::intersectSegment(const glm::vec3& start, const glm::vec3& end, BvhHit& hit) const {
+	return raycast(start, end - start, 1.0f, hit);
+}
+
+bool Bvh::occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const {
+	if (m_nodes.empty()) {
+		return false;
+	}
+	glm::vec3 inverseDirection{ 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+	uint32_t stack[STACK_SIZE];
+	uint32_t stackSize{ 0 };
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node{ m_nodes[stack[--stackSize]] };
+		float entryDistances[4];
+		uint32_t mask{ rayHitsChildren(node, origin, inverseDirection, maxDistance, entryDistances) };
+		for (uint32_t i{ 0 }; i < 4; ++i) {
+			if (!(mask & (1u << i)) || node.child[i] == EMPTY) {
+				continue;
+			}
+			if (node.count[i] == 0) {
+				stack[stackSize++] = node.child[i];
+				continue;
+			}
+			for (uint32_t t{ node.child[i] }; t < node.child[i] + node.count[i]; ++t) {
+				float distance, u, v;
+				if (intersectTriangle(m_triangles[t], origin, direction, distance, u, v) && distance < maxDistance) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void Bvh::overlapSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& triangles) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+	uint32_t stack[STACK_SIZE];
+	uint32_t stackSize{ 0 };
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node{ m_nodes[stack[--stackSize]] };
+		uint32_t mask{ sphereHitsChildren(node, center, radius) };
+		for (uint32_t i{ 0 }; i < 4; ++i) {
+			if (!(mask & (1u << i)) || node.child[i] == EMPTY) {
+				continue;
+			}
+			if (node.count[i] == 0) {
+				stack[stackSize++] = node.child[i];
+				continue;
+			}
+			for (uint32_t t{ node.child[i] }; t < node.child[i] + node.count[i]; ++t) {
+				const Triangle& triangle{ m_triangles[t] };
+				glm::vec3 closest{ closestPointOnTriangle(center, triangle.v0, triangle.v0 + triangle.edge1,
+					triangle.v0 + triangle.edge2) };
+				glm::vec3 offset{ closest - center };
+				if (glm::dot(offset, offset) <= radius * radius) {
+					triangles.push_back(triangle.id);
+				}
+			}
+		}
+	}
+}
+
+glm::vec3 Bvh::closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+	const glm::vec3& c) {
+	// Find which Voronoi region of the triangle p lies in (Ericson, Real-Time Collision Detection 5.1.5).
+	glm::vec3 ab{ b - a };
+	glm::vec3 ac{ c - a };
+	glm::vec3 ap{ p - a };
+	float d1{ glm::dot(ab, ap) };
+	float d2{ glm::dot(ac, ap) };
+	if (d1 <= 0 && d2 <= 0) {
+		return a;
+	}
+
+	glm::vec3 bp{ p - b };
+	float d3{ glm::dot(ab, bp) };
+	float d4{ glm::dot(ac, bp) };
+	if (d3 >= 0 && d4 <= d3) {
+		return b;
+	}
+
+	float vc{ d1 * d4 - d3 * d2 };
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	glm::vec3 cp{ p - c };
+	float d5{ glm::dot(ab, cp) };
+	float d6{ glm::dot(ac, cp) };
+	if (d6 >= 0 && d5 <= d6) {
+		return c;
+	}
+
+	float vb{ d5 * d2 - d1 * d6 };
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va{ d3 * d6 - d5 * d4 };
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denominator{ 1.0f / (va + vb + vc) };
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
@@ -0,0 +1,211 @@
+#include "CascadedShadowMaps.h"
+#include "Frustum.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// How far the cascades' split depths lean from evenly spaced toward logarithmically spaced.
+	constexpr float SPLIT_LAMBDA{ 0.75f };
+
+	uint32_t createDepthArray(uint32_t resolution, uint32_t layers, bool compare) {
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(CascadedShadowMaps::SHADOW_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, layers, 0,
+			GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// A comparing texture filters the results of the depth test, not the depths.
+		GLint filter{ compare ? GL_LINEAR : GL_NEAREST };
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+		if (compare) {
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		return texture;
+	}
+
+	uint32_t createDepthOnlyFramebuffer() {
+		uint32_t framebuffer;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return framebuffer;
+	}
+}
+
+CascadedShadowMaps::CascadedShadowMaps(ShaderProgram& depthProgram, ShaderProgram& instancedDepthProgram,
+	uint32_t resolution, float shadowDistance)
+	: m_depthProgram{ &depthProgram }, m_instancedDepthProgram{ &instancedDepthProgram },
+	m_resolution{ resolution }, m_shadowDistance{ shadowDistance } {
+	m_shadowTexture = createDepthArray(resolution, CASCADES, true);
+	m_staticTexture = createDepthArray(resolution, CASCADES, false);
+	m_drawFramebuffer = createDepthOnlyFramebuffer();
+	m_readFramebuffer = createDepthOnlyFramebuffer();
+	setLightDirection(m_lightDirection);
+}
+
+void CascadedShadowMaps::setLightDirection(const glm::vec3& direction) {
+	m_lightDirection = glm::normalize(direction);
+	glm::vec3 up{ std::abs(m_lightDirection.y) > 0.99f ? glm::vec3{ 0, 0, 1 } : glm::vec3{ 0, 1, 0 } };
+	glm::mat4 lightView{ glm::lookAt(glm::vec3{ 0 }, m_lightDirection, up) };
+	if (lightView != m_lightView) {
+		m_lightView = lightView;
+		invalidateStatic();
+	}
+}
+
+void CascadedShadowMaps::invalidateStatic() {
+	for (auto& cascade : m_cascades) {
+		cascade.staticValid = false;
+	}
+}
+
+bool CascadedShadowMaps::fitCascade(uint32_t index, const glm::mat4& inverseView, const glm::mat4& projection,
+	float nearDepth, float farDepth) {
+	// The world-space corners of the slice; a point at NDC (x, y) and depth d is at view-space
+	// (x * d / P[0][0], y * d / P[1][1], -d).
+	glm::vec3 corners[8];
+	glm::vec3 center{ 0 };
+	for (uint32_t i{ 0 }; i < 8; ++i) {
+		float depth{ i < 4 ? nearDepth : farDepth };
+		float x{ (i & 1) ? 1.0f : -1.0f };
+		float y{ (i & 2) ? 1.0f : -1.0f };
+		corners[i] = glm::vec3{ inverseView * glm::vec4{ x * depth / projection[0][0], y * depth / projection[1][1], -depth, 1 } };
+		center += corners[i] / 8.0f;
+	}
+	// The sphere's radius depends only on the projection, so the region's size does not change as the
+	// camera turns.
+	float radius{ 0 };
+	for (auto& corner : corners) {
+		radius = std::max(radius, glm::length(corner - center));
+	}
+	radius = std::ceil(radius * 16) / 16;
+
+	// Pad the region so that its center can be snapped to a grid of whole texels, up to a quarter of
+	// the radius apart, and still cover the sphere.
+	float halfSize{ radius * 1.25f };
+	float texel{ 2 * halfSize / m_resolution };
+	float step{ std::max(std::floor(radius * 0.25f / texel), 1.0f) * texel };
+	glm::vec3 lightCenter{ m_lightView * glm::vec4{ center, 1 } };
+	glm::vec3 snapped{ glm::floor(lightCenter / step + 0.5f) * step };
+
+	Cascade& cascade{ m_cascades[index] };
+	bool moved{ snapped != cascade.center || halfSize != cascade.halfSize };
+	cascade.center = snapped;
+	cascade.halfSize = halfSize;
+	// The light looks down -z; casters up to the shadow distance in front of the region are included.
+	cascade.projection = glm::ortho(snapped.x - halfSize, snapped.x + halfSize, snapped.y - halfSize,
+		snapped.y + halfSize, -snapped.z - halfSize - m_shadowDistance, -snapped.z + halfSize);
+	cascade.viewProjection = cascade.projection * m_lightView;
+	return moved;
+}
+
+void CascadedShadowMaps::drawCasters(uint32_t texture, uint32_t layer, const Cascade& cascade,
+	std::vector<Object3D>& objects, bool staticCasters, bool clear, DrawUniformRing& drawUniforms) {
+	glBindFramebuffer(GL_FRAMEBUFFER, m_drawFramebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+	if (clear) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	drawUniforms.setViewProjection(cascade.viewProjection);
+	m_queue.clear(m_lightView, cascade.projection);
+	Frustum frustum{ cascade.viewProjection };
+	CullingStats culling{};
+	for (auto& o : objects) {
+		if (o.isStatic() == staticCasters) {
+			o.collect(m_queue, *m_depthProgram, frustum, nullptr, culling);
+		}
+	}
+	m_queue.submit(drawUniforms);
+}
+
+void CascadedShadowMaps::update(const glm::mat4& view, const glm::mat4& projection, std::vector<Object3D>& objects,
+	DrawUniformRing& drawUniforms) {
+	++m_frame;
+	// Programs may have been rebuilt with new IDs since the last frame.
+	m_queue.clearInstancedPrograms();
+	m_queue.setInstancedProgram(*m_depthProgram, *m_instancedDepthProgram);
+
+	// The near and far distances of the camera's perspective projection, from its depth row.
+	float nearPlane{ projection[3][2] / (projection[2][2] - 1) };
+	float farPlane{ std::min(projection[3][2] / (projection[2][2] + 1), m_shadowDistance) };
+	glm::mat4 inverseView{ glm::inverse(view) };
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	bool drawing{ false };
+	float sliceNear{ nearPlane };
+	for (uint32_t i{ 0 }; i < CASCADES; ++i) {
+		float fraction{ static_cast<float>(i + 1) / CASCADES };
+		float evenSplit{ nearPlane + (farPlane - nearPlane) * fraction };
+		float logSplit{ nearPlane * std::pow(farPlane / nearPlane, fraction) };
+		float split{ evenSplit + (logSplit - evenSplit) * SPLIT_LAMBDA };
+		Cascade& cascade{ m_cascades[i] };
+		cascade.splitDepth = split;
+		if (fitCascade(i, inverseView, projection, sliceNear, split)) {
+			cascade.staticValid = false;
+		}
+		sliceNear = split;
+
+		// Staggered, so the far cascades' refreshes fall on different frames.
+		bool due{ !cascade.staticValid || (m_frame + i) % UPDATE_INTERVALS[i] == 0 };
+		if (!due) {
+			continue;
+		}
+		if (!drawing) {
+			drawing = true;
+			glViewport(0, 0, m_resolution, m_resolution);
+			// Push the casters' depths back a little, so lit surfaces do not shadow themselves.
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(1.5f, 4.0f);
+		}
+		if (!cascade.staticValid) {
+			drawCasters(m_staticTexture, i, cascade, objects, true, true, drawUniforms);
+			cascade.staticValid = true;
+		}
+		// Start the shadow layer from the cached static casters, then draw the dynamic ones over them.
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFramebuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_staticTexture, 0, i);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_drawFramebuffer);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_shadowTexture, 0, i);
+		glBlitFramebuffer(0, 0, m_resolution, m_resolution, 0, 0, m_resolution, m_resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		drawCasters(m_shadowTexture, i, cascade, objects, false, false, drawUniforms);
+	}
+
+	if (drawing) {
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		drawUniforms.setViewProjection(projection * view);
+	}
+}
+
+void CascadedShadowMaps::bind(ShaderProgram& program) const {
+	RenderState::bindTexture(SHADOW_UNIT, GL_TEXTURE_2D_ARRAY, m_shadowTexture);
+
+	// Shadow maps are sampled in [0, 1] texture space rather than [-1, 1] clip space.
+	const glm::mat4 clipToTexture{
+		glm::vec4{ 0.5f, 0, 0, 0 }, glm::vec4{ 0, 0.5f, 0, 0 }, glm::vec4{ 0, 0, 0.5f, 0 }, glm::vec4{ 0.5f, 0.5f, 0.5f, 1 }
+	};
+	glm::mat4 matrices[CASCADES];
+	glm::vec4 splits{};
+	glm::vec4 texelSizes{};
+	for (uint32_t i{ 0 }; i < CASCADES; ++i) {
+		matrices[i] = clipToTexture * m_cascades[i].viewProjection;
+		splits[i] = m_cascades[i].splitDepth;
+		texelSizes[i] = 2 * m_cascades[i].halfSize / m_resolution;
+	}
+
+	program.activate();
+	program.setUniform("shadowMap", static_cast<int32_t>(SHADOW_UNIT));
+	program.setUniform(program.getUniform<glm::mat4>("shadowMatrices"), matrices, CASCADES);
+	program.setUniform("cascadeSplits", splits);
+	program.setUniform("cascadeTexelSizes", texelSizes);
+}
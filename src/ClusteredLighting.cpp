@@ -0,0 +1,198 @@
+#include "ClusteredLighting.h"
+#include "Parallel.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define CLUSTERED_LIGHTING_USE_SSE 1
+#endif
+
+namespace {
+	// Below this many lights, assigning every slice on the calling thread is cheaper than waking workers.
+	constexpr size_t PARALLEL_LIGHT_COUNT{ 64 };
+
+	// A texture buffer with a buffer object for its storage.
+	void createTextureBuffer(uint32_t& buffer, uint32_t& texture, uint32_t unit, uint32_t format) {
+		glGenBuffers(1, &buffer);
+		RenderState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(unit, GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	}
+}
+
+ClusteredLighting::ClusteredLighting() {
+	for (auto* component : { &m_bounds.minX, &m_bounds.minY, &m_bounds.minDepth,
+		&m_bounds.maxX, &m_bounds.maxY, &m_bounds.maxDepth }) {
+		component->resize(CLUSTER_COUNT);
+	}
+	m_clusterLights.resize(static_cast<size_t>(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER);
+	m_clusterCounts.resize(CLUSTER_COUNT);
+	m_grid.resize(2 * CLUSTER_COUNT);
+
+	createTextureBuffer(m_lightBuffer, m_lightTexture, LIGHTS_UNIT, GL_RGBA32F);
+	createTextureBuffer(m_gridBuffer, m_gridTexture, GRID_UNIT, GL_RG32UI);
+	createTextureBuffer(m_indexBuffer, m_indexTexture, INDICES_UNIT, GL_R32UI);
+}
+
+void ClusteredLighting::buildBounds(const glm::mat4& projection) {
+	// The near and far distances of a perspective projection, from its depth row.
+	m_near = projection[3][2] / (projection[2][2] - 1);
+	m_far = projection[3][2] / (projection[2][2] + 1);
+
+	for (uint32_t z{ 0 }; z < CLUSTERS_Z; ++z) {
+		float sliceNear{ m_near * std::pow(m_far / m_near, static_cast<float>(z) / CLUSTERS_Z) };
+		float sliceFar{ m_near * std::pow(m_far / m_near, static_cast<float>(z + 1) / CLUSTERS_Z) };
+		for (uint32_t y{ 0 }; y < CLUSTERS_Y; ++y) {
+			// A point at NDC (x, y) and depth d is at view-space (x * d / P[0][0], y * d / P[1][1]).
+			float bottom{ (-1 + 2.0f * y / CLUSTERS_Y) / projection[1][1] };
+			float top{ (-1 + 2.0f * (y + 1) / CLUSTERS_Y) / projection[1][1] };
+			for (uint32_t x{ 0 }; x < CLUSTERS_X; ++x) {
+				float left{ (-1 + 2.0f * x / CLUSTERS_X) / projection[0][0] };
+				float right{ (-1 + 2.0f * (x + 1) / CLUSTERS_X) / projection[0][0] };
+				uint32_t cluster{ x + CLUSTERS_X * (y + CLUSTERS_Y * z) };
+				// The tile widens with depth, so each edge is farthest out on one of the two depth planes.
+				m_bounds.minX[cluster] = std::min(left * sliceNear, left * sliceFar);
+				m_bounds.maxX[cluster] = std::max(right * sliceNear, right * sliceFar);
+				m_bounds.minY[cluster] = std::min(bottom * sliceNear, bottom * sliceFar);
+				m_bounds.maxY[cluster] = std::max(top * sliceNear, top * sliceFar);
+				m_bounds.minDepth[cluster] = sliceNear;
+				m_bounds.maxDepth[cluster] = sliceFar;
+			}
+		}
+	}
+}
+
+void ClusteredLighting::assignSlice(uint32_t slice) {
+	uint32_t first{ slice * CLUSTERS_PER_SLICE };
+	std::fill_n(m_clusterCounts.begin() + first, CLUSTERS_PER_SLICE, 0);
+	float sliceNear{ m_bounds.minDepth[first] };
+	float sliceFar{ m_bounds.maxDepth[first] };
+
+	for (uint32_t light{ 0 }; light < m_viewSpheres.size(); ++light) {
+		const glm::vec4& sphere{ m_viewSpheres[light] };
+		if (sphere.z + sphere.w < sliceNear || sphere.z - sphere.w > sliceFar) {
+			continue;
+		}
+		// The squared distance from the sphere's center to each box, compared against the squared radius.
+#ifdef CLUSTERED_LIGHTING_USE_SSE
+		__m128 centerX{ _mm_set1_ps(sphere.x) };
+		__m128 centerY{ _mm_set1_ps(sphere.y) };
+		__m128 centerDepth{ _mm_set1_ps(sphere.z) };
+		__m128 radiusSquared{ _mm_set1_ps(sphere.w * sphere.w) };
+		__m128 zero{ _mm_setzero_ps() };
+		auto axisDistance{ [&](const std::vector<float>& min, const std::vector<float>& max, uint32_t cluster, __m128 center) {
+			__m128 below{ _mm_sub_ps(_mm_loadu_ps(&min[cluster]), center) };
+			__m128 above{ _mm_sub_ps(center, _mm_loadu_ps(&max[cluster])) };
+			__m128 outside{ _mm_max_ps(_mm_max_ps(below, above), zero) };
+			return _mm_mul_ps(outside, outside);
+		} };
+		// CLUSTERS_PER_SLICE is a multiple of 4.
+		for (uint32_t cluster{ first }; cluster < first + CLUSTERS_PER_SLICE; cluster += 4) {
+			__m128 distanceSquared{ _mm_add_ps(
+				_mm_add_ps(axisDistance(m_bounds.minX, m_bounds.maxX, cluster, centerX),
+					axisDistance(m_bounds.minY, m_bounds.maxY, cluster, centerY)),
+				axisDistance(m_bounds.minDepth, m_bounds.maxDepth, cluster, centerDepth)) };
+			uint32_t hits{ static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared))) };
+			while (hits != 0) {
+				uint32_t hit{ cluster + std::countr_zero(hits) };
+				hits &= hits - 1;
+				uint32_t& count{ m_clusterCounts[hit] };
+				if (count < MAX_LIGHTS_PER_CLUSTER) {
+					m_clusterLights[static_cast<size_t>(hit) * MAX_LIGHTS_PER_CLUSTER + count++] = light;
+				}
+			}
+		}
+#else
+		for (uint32_t cluster{ first }; cluster < first + CLUSTERS_PER_SLICE; ++cluster) {
+			glm::vec3 min{ m_bounds.minX[cluster], m_bounds.minY[cluster], m_bounds.minDepth[cluster] };
+			glm::vec3 max{ m_bounds.maxX[cluster], m_bounds.maxY[cluster], m_bounds.maxDepth[cluster] };
+			glm::vec3 center{ sphere };
+			glm::vec3 outside{ glm::max(glm::max(min - center, center - max), glm::vec3{ 0 }) };
+			uint32_t& count{ m_clusterCounts[cluster] };
+			if (glm::dot(outside, outside) <= sphere.w * sphere.w && count < MAX_LIGHTS_PER_CLUSTER) {
+				m_clusterLights[static_cast<size_t>(cluster) * MAX_LIGHTS_PER_CLUSTER + count++] = light;
+			}
+		}
+#endif
+	}
+}
+
+void ClusteredLighting::upload(uint32_t buffer, const void* data, size_t size) {
+	RenderState::bindBuffer(GL_TEXTURE_BUFFER, buffer);
+	// Respecifying the whole buffer orphans the previous frame's storage instead of waiting on it.
+	// An empty buffer still gets one texel, since a texture buffer cannot have no storage.
+	if (size == 0) {
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+	}
+	else {
+		glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+	}
+}
+
+void ClusteredLighting::update(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+	const glm::uvec2& viewport) {
+	if (projection != m_boundsProjection) {
+		buildBounds(projection);
+		m_boundsProjection = projection;
+	}
+	m_tileSize = glm::vec2{ viewport } / glm::vec2{ CLUSTERS_X, CLUSTERS_Y };
+
+	// Spot lights are bounded by the sphere of their range too; the shader fades them out of the cone.
+	m_viewSpheres.clear();
+	m_lightTexels.clear();
+	for (auto& light : lights) {
+		glm::vec3 center{ view * glm::vec4{ light.position, 1 } };
+		m_viewSpheres.emplace_back(center.x, center.y, -center.z, light.range);
+		// smoothstep needs the outer cosine strictly below the inner one.
+		float outerCosine{ std::min(light.outerCosine, light.innerCosine - 1e-4f) };
+		m_lightTexels.emplace_back(light.position, light.range);
+		m_lightTexels.emplace_back(light.color, outerCosine);
+		m_lightTexels.emplace_back(light.direction, light.innerCosine);
+	}
+
+	size_t grain{ lights.size() < PARALLEL_LIGHT_COUNT ? CLUSTERS_Z : 1 };
+	parallelFor(CLUSTERS_Z, grain, [this](size_t begin, size_t end) {
+		for (size_t slice{ begin }; slice < end; ++slice) {
+			assignSlice(static_cast<uint32_t>(slice));
+		}
+	});
+
+	// Pack the clusters' lists end to end.
+	m_indices.clear();
+	for (uint32_t cluster{ 0 }; cluster < CLUSTER_COUNT; ++cluster) {
+		auto list{ m_clusterLights.begin() + static_cast<size_t>(cluster) * MAX_LIGHTS_PER_CLUSTER };
+		m_grid[2 * cluster] = static_cast<uint32_t>(m_indices.size());
+		m_grid[2 * cluster + 1] = m_clusterCounts[cluster];
+		m_indices.insert(m_indices.end(), list, list + m_clusterCounts[cluster]);
+	}
+
+	upload(m_lightBuffer, m_lightTexels.data(), m_lightTexels.size() * sizeof(glm::vec4));
+	upload(m_gridBuffer, m_grid.data(), m_grid.size() * sizeof(uint32_t));
+	upload(m_indexBuffer, m_indices.data(), m_indices.size() * sizeof(uint32_t));
+}
+
+void ClusteredLighting::bind(ShaderProgram& program) const {
+	RenderState::bindTexture(LIGHTS_UNIT, GL_TEXTURE_BUFFER, m_lightTexture);
+	RenderState::bindTexture(GRID_UNIT, GL_TEXTURE_BUFFER, m_gridTexture);
+	RenderState::bindTexture(INDICES_UNIT, GL_TEXTURE_BUFFER, m_indexTexture);
+
+	// slice = log(depth / near) / log(far / near) * CLUSTERS_Z, split into a scale and bias of log(depth).
+	float depthScale{ CLUSTERS_Z / std::log(m_far / m_near) };
+	program.activate();
+	program.setUniform("clusterLights", static_cast<int32_t>(LIGHTS_UNIT));
+	program.setUniform("clusterGrid", static_cast<int32_t>(GRID_UNIT));
+	program.setUniform("clusterLightIndices", static_cast<int32_t>(INDICES_UNIT));
+	program.setUniform("clusterTileSize", m_tileSize);
+	program.setUniform("clusterDepthScale", depthScale);
+	program.setUniform("clusterDepthBias", -std::log(m_near) * depthScale);
+}
+
+size_t ClusteredLighting::getAssignmentCount() const {
+	return m_indices.size();
+}
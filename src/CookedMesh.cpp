@@ -0,0 +1,295 @@
+#include "CookedMesh.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	// "CMSH", read as a little-endian integer.
+	constexpr uint32_t COOKED_MAGIC{ 0x48534d43 };
+	constexpr uint32_t COOKED_VERSION{ 2 };
+
+	// A Vertex3D is coded as this many 32-bit words.
+	constexpr uint32_t VERTEX_WORDS{ sizeof(Vertex3D) / sizeof(uint32_t) };
+	static_assert(sizeof(Vertex3D) % sizeof(uint32_t) == 0, "Vertex3D must be made of 32-bit fields");
+
+	// The longest a single varint can be. The data buffer always ends with one vertex's worth of
+	// zero padding, so a decoder overrunning a corrupt block stays inside the buffer.
+	constexpr size_t MAX_VARINT_BYTES{ 5 };
+	constexpr size_t DATA_PADDING{ VERTEX_WORDS * MAX_VARINT_BYTES };
+
+	struct CookedHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexWords;
+		uint32_t vertexCount;
+		uint32_t faceCount;
+		uint32_t vertexBlockCount;
+		uint32_t faceBlockCount;
+		uint32_t reserved;
+		uint64_t dataSize;
+		float boundsMin[3];
+		float boundsMax[3];
+		float sphereCenter[3];
+		float sphereRadius;
+	};
+
+	uint32_t zigzag(uint32_t delta) {
+		return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+	}
+
+	uint32_t unzigzag(uint32_t value) {
+		return (value >> 1) ^ (0 - (value & 1));
+	}
+
+	void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	uint32_t readVarint(const uint8_t*& in) {
+		// Most deltas fit in one byte, so check for that before looping.
+		uint32_t byte{ *in++ };
+		if (byte < 0x80) {
+			return byte;
+		}
+		uint32_t value{ byte & 0x7f };
+		uint32_t shift{ 7 };
+		do {
+			byte = *in++;
+			value |= (byte & 0x7f) << shift;
+			shift += 7;
+		} while ((byte & 0x80) && shift < 35);
+		return value;
+	}
+
+	// Each decoder returns false if the block's bytes do not decode to exactly the expected count.
+	bool decodeVertexBlock(const uint8_t* in, const uint8_t* end, uint32_t count, Vertex3D* out, glm::vec3* positions) {
+		uint32_t previous[VERTEX_WORDS]{};
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			if (in > end) {
+				return false;
+			}
+			uint32_t vertex[VERTEX_WORDS];
+			for (uint32_t w{ 0 }; w < VERTEX_WORDS; ++w) {
+				previous[w] += unzigzag(readVarint(in));
+				vertex[w] = previous[w];
+			}
+			// Write the whole vertex at once; the destination is usually mapped GPU memory.
+			std::memcpy(out + i, vertex, sizeof(Vertex3D));
+			if (positions != nullptr) {
+				std::memcpy(positions + i, vertex, sizeof(glm::vec3));
+			}
+		}
+		return in == end;
+	}
+
+	// Also returns false for an index of a vertex past vertexCount, before writing it.
+	bool decodeFaceBlock(const uint8_t* in, const uint8_t* end, uint32_t count, uint32_t vertexCount, uint32_t* out) {
+		uint32_t previous{ 0 };
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			if (in > end) {
+				return false;
+			}
+			previous += unzigzag(readVarint(in));
+			if (previous >= vertexCount) {
+				return false;
+			}
+			out[i] = previous;
+		}
+		return in == end;
+	}
+
+	// The number of blocks in a block table. A default-constructed CookedMesh has empty tables.
+	size_t blockCount(const std::vector<uint64_t>& blocks) {
+		return blocks.empty() ? 0 : blocks.size() - 1;
+	}
+
+	void checkBlocks(const std::vector<uint64_t>& blocks, uint64_t dataSize) {
+		for (size_t i{ 1 }; i < blocks.size(); ++i) {
+			if (blocks[i] < blocks[i - 1] || blocks[i] > dataSize) {
+				throw std::runtime_error("Cooked mesh has an invalid block table");
+			}
+		}
+	}
+}
+
+CookedMesh CookedMesh::encode(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces) {
+	CookedMesh cooked{};
+	cooked.m_vertexCount = static_cast<uint32_t>(vertices.size());
+	cooked.m_faceCount = static_cast<uint32_t>(faces.size());
+	const float* positions{ vertices.empty() ? nullptr : &vertices[0].x };
+	cooked.m_bounds = computeBoundingBox(positions, vertices.size(), sizeof(Vertex3D));
+	cooked.m_boundingSphere = computeBoundingSphere(positions, vertices.size(), sizeof(Vertex3D), cooked.m_bounds);
+	auto& data{ cooked.m_data };
+
+	for (uint32_t start{ 0 }; start < cooked.m_vertexCount; start += VERTICES_PER_BLOCK) {
+		cooked.m_vertexBlocks.push_back(data.size());
+		uint32_t previous[VERTEX_WORDS]{};
+		uint32_t end{ std::min(start + VERTICES_PER_BLOCK, cooked.m_vertexCount) };
+		for (uint32_t i{ start }; i < end; ++i) {
+			uint32_t vertex[VERTEX_WORDS];
+			std::memcpy(vertex, &vertices[i], sizeof(Vertex3D));
+			for (uint32_t w{ 0 }; w < VERTEX_WORDS; ++w) {
+				writeVarint(data, zigzag(vertex[w] - previous[w]));
+				previous[w] = vertex[w];
+			}
+		}
+	}
+	cooked.m_vertexBlocks.push_back(data.size());
+
+	for (uint32_t start{ 0 }; start < cooked.m_faceCount; start += INDICES_PER_BLOCK) {
+		cooked.m_faceBlocks.push_back(data.size());
+		uint32_t previous{ 0 };
+		uint32_t end{ std::min(start + INDICES_PER_BLOCK, cooked.m_faceCount) };
+		for (uint32_t i{ start }; i < end; ++i) {
+			writeVarint(data, zigzag(faces[i] - previous));
+			previous = faces[i];
+		}
+	}
+	cooked.m_faceBlocks.push_back(data.size());
+
+	data.resize(data.size() + DATA_PADDING);
+	return cooked;
+}
+
+CookedMesh CookedMesh::loadFromFile(const std::filesystem::path& path) {
+	std::ifstream file{ path, std::ios::binary | std::ios::ate };
+	if (!file) {
+		throw std::runtime_error("Could not open cooked mesh " + path.string());
+	}
+	uint64_t fileSize{ static_cast<uint64_t>(file.tellg()) };
+	file.seekg(0);
+
+	CookedHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != COOKED_MAGIC || header.version != COOKED_VERSION) {
+		throw std::runtime_error("Not a cooked mesh file: " + path.string());
+	}
+	if (header.vertexWords != VERTEX_WORDS) {
+		throw std::runtime_error("Cooked mesh " + path.string() + " has a different vertex layout; re-cook it");
+	}
+
+	// Check the sizes in the header before allocating anything from them.
+	size_t vertexBlockCount{ static_cast<size_t>(header.vertexBlockCount) };
+	size_t faceBlockCount{ static_cast<size_t>(header.faceBlockCount) };
+	if (vertexBlockCount != (static_cast<size_t>(header.vertexCount) + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK
+		|| faceBlockCount != (static_cast<size_t>(header.faceCount) + INDICES_PER_BLOCK - 1) / INDICES_PER_BLOCK) {
+		throw std::runtime_error("Cooked mesh " + path.string() + " has an invalid block table");
+	}
+	uint64_t tableSize{ (vertexBlockCount + 1 + faceBlockCount + 1) * sizeof(uint64_t) };
+	if (sizeof(header) + tableSize > fileSize || header.dataSize > fileSize - sizeof(header) - tableSize) {
+		throw std::runtime_error("Cooked mesh " + path.string() + " is truncated");
+	}
+
+	CookedMesh cooked{};
+	cooked.m_vertexCount = header.vertexCount;
+	cooked.m_faceCount = header.faceCount;
+	cooked.m_bounds = BoundingBox{
+		glm::vec3{ header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] },
+		glm::vec3{ header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] }
+	};
+	cooked.m_boundingSphere = BoundingSphere{
+		glm::vec3{ header.sphereCenter[0], header.sphereCenter[1], header.sphereCenter[2] },
+		header.sphereRadius
+	};
+	cooked.m_vertexBlocks.resize(vertexBlockCount + 1);
+	cooked.m_faceBlocks.resize(faceBlockCount + 1);
+	file.read(reinterpret_cast<char*>(cooked.m_vertexBlocks.data()), cooked.m_vertexBlocks.size() * sizeof(uint64_t));
+	file.read(reinterpret_cast<char*>(cooked.m_faceBlocks.data()), cooked.m_faceBlocks.size() * sizeof(uint64_t));
+
+	cooked.m_data.resize(header.dataSize + DATA_PADDING);
+	file.read(reinterpret_cast<char*>(cooked.m_data.data()), header.dataSize);
+	if (!file) {
+		throw std::runtime_error("Cooked mesh " + path.string() + " is truncated");
+	}
+
+	checkBlocks(cooked.m_vertexBlocks, header.dataSize);
+	checkBlocks(cooked.m_faceBlocks, header.dataSize);
+	return cooked;
+}
+
+void CookedMesh::saveToFile(const std::filesystem::path& path) const {
+	std::ofstream file{ path, std::ios::binary };
+	if (!file) {
+		throw std::runtime_error("Could not write cooked mesh " + path.string());
+	}
+
+	// A default-constructed mesh is written with the tables of an empty stream, which is one end offset.
+	const std::vector<uint64_t> emptyTable{ 0 };
+	const auto& vertexBlocks{ m_vertexBlocks.empty() ? emptyTable : m_vertexBlocks };
+	const auto& faceBlocks{ m_faceBlocks.empty() ? emptyTable : m_faceBlocks };
+	CookedHeader header{
+		COOKED_MAGIC, COOKED_VERSION, VERTEX_WORDS, m_vertexCount, m_faceCount,
+		static_cast<uint32_t>(blockCount(vertexBlocks)), static_cast<uint32_t>(blockCount(faceBlocks)),
+		0, getEncodedSize(),
+		{ m_bounds.min.x, m_bounds.min.y, m_bounds.min.z },
+		{ m_bounds.max.x, m_bounds.max.y, m_bounds.max.z },
+		{ m_boundingSphere.center.x, m_boundingSphere.center.y, m_boundingSphere.center.z },
+		m_boundingSphere.radius
+	};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(vertexBlocks.data()), vertexBlocks.size() * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(faceBlocks.data()), faceBlocks.size() * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(m_data.data()), getEncodedSize());
+}
+
+uint32_t CookedMesh::getVertexCount() const {
+	return m_vertexCount;
+}
+
+uint32_t CookedMesh::getFaceCount() const {
+	return m_faceCount;
+}
+
+const BoundingBox& CookedMesh::getBounds() const {
+	return m_bounds;
+}
+
+const BoundingSphere& CookedMesh::getBoundingSphere() const {
+	return m_boundingSphere;
+}
+
+size_t CookedMesh::getEncodedSize() const {
+	return m_data.size() > DATA_PADDING ? m_data.size() - DATA_PADDING : 0;
+}
+
+void CookedMesh::decodeVertices(Vertex3D* destination, glm::vec3* positions) const {
+	std::atomic<bool> valid{ true };
+	const uint8_t* data{ m_data.data() };
+	parallelFor(blockCount(m_vertexBlocks), 1, [&](size_t begin, size_t end) {
+		for (size_t b{ begin }; b < end; ++b) {
+			uint32_t first{ static_cast<uint32_t>(b) * VERTICES_PER_BLOCK };
+			uint32_t count{ std::min(VERTICES_PER_BLOCK, m_vertexCount - first) };
+			glm::vec3* blockPositions{ positions == nullptr ? nullptr : positions + first };
+			if (!decodeVertexBlock(data + m_vertexBlocks[b], data + m_vertexBlocks[b + 1], count, destination + first, blockPositions)) {
+				valid = false;
+			}
+		}
+	});
+	if (!valid) {
+		throw std::runtime_error("Cooked mesh vertex data is corrupt");
+	}
+}
+
+void CookedMesh::decodeFaces(uint32_t* destination) const {
+	std::atomic<bool> valid{ true };
+	const uint8_t* data{ m_data.data() };
+	parallelFor(blockCount(m_faceBlocks), 1, [&](size_t begin, size_t end) {
+		for (size_t b{ begin }; b < end; ++b) {
+			uint32_t first{ static_cast<uint32_t>(b) * INDICES_PER_BLOCK };
+			uint32_t count{ std::min(INDICES_PER_BLOCK, m_faceCount - first) };
+			if (!decodeFaceBlock(data + m_faceBlocks[b], data + m_faceBlocks[b + 1], count, m_vertexCount, destination + first)) {
+				valid = false;
+			}
+		}
+	});
+	if (!valid) {
+		throw std::runtime_error("Cooked mesh face data is corrupt");
+	}
+}
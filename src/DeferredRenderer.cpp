@@ -0,0 +1,93 @@
+#include "DeferredRenderer.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <stdexcept>
+
+namespace {
+	// The texture unit of each G-buffer texture in the lighting pass.
+	constexpr uint32_t ALBEDO_UNIT{ 0 };
+	constexpr uint32_t NORMAL_UNIT{ 1 };
+	constexpr uint32_t MATERIAL_UNIT{ 2 };
+	constexpr uint32_t DEPTH_UNIT{ 3 };
+
+	uint32_t createTarget() {
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// The lighting pass reads exactly one texel per pixel.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return texture;
+	}
+
+	void allocateTarget(uint32_t texture, GLint internalFormat, GLenum format, GLenum type, const glm::uvec2& size) {
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.x, size.y, 0, format, type, nullptr);
+	}
+}
+
+DeferredRenderer::DeferredRenderer() {
+	m_albedoTexture = createTarget();
+	m_normalTexture = createTarget();
+	m_materialTexture = createTarget();
+	m_depthTexture = createTarget();
+	glGenFramebuffers(1, &m_framebuffer);
+	glGenVertexArrays(1, &m_emptyVertexArray);
+}
+
+void DeferredRenderer::resize(const glm::uvec2& size) {
+	m_size = size;
+	allocateTarget(m_albedoTexture, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, size);
+	allocateTarget(m_normalTexture, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, size);
+	allocateTarget(m_materialTexture, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, size);
+	// The same format as the window's depth buffer, so that shade() can blit it there.
+	allocateTarget(m_depthTexture, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, size);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_materialTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	const GLenum drawBuffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		throw std::runtime_error("G-buffer framebuffer is incomplete");
+	}
+}
+
+void DeferredRenderer::beginGeometryPass(const glm::uvec2& size) {
+	if (size != m_size) {
+		resize(size);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, size.x, size.y);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::shade(ShaderProgram& lightingProgram, const glm::mat4& viewProjection) {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	RenderState::bindTexture(ALBEDO_UNIT, GL_TEXTURE_2D, m_albedoTexture);
+	RenderState::bindTexture(NORMAL_UNIT, GL_TEXTURE_2D, m_normalTexture);
+	RenderState::bindTexture(MATERIAL_UNIT, GL_TEXTURE_2D, m_materialTexture);
+	RenderState::bindTexture(DEPTH_UNIT, GL_TEXTURE_2D, m_depthTexture);
+
+	lightingProgram.activate();
+	lightingProgram.setUniform("gBufferAlbedo", static_cast<int32_t>(ALBEDO_UNIT));
+	lightingProgram.setUniform("gBufferNormal", static_cast<int32_t>(NORMAL_UNIT));
+	lightingProgram.setUniform("gBufferMaterial", static_cast<int32_t>(MATERIAL_UNIT));
+	lightingProgram.setUniform("gBufferDepth", static_cast<int32_t>(DEPTH_UNIT));
+	lightingProgram.setUniform("inverseViewProjection", glm::inverse(viewProjection));
+
+	// Every pixel is shaded exactly once, so the triangle needs no depth test.
+	glDisable(GL_DEPTH_TEST);
+	RenderState::bindVertexArray(m_emptyVertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glBlitFramebuffer(0, 0, m_size.x, m_size.y, 0, 0, m_size.x, m_size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,107 @@
+#include "Frustum.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FRUSTUM_USE_SSE 1
+#endif
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+	// Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix".
+	glm::vec4 rows[4];
+	for (int32_t i{ 0 }; i < 4; ++i) {
+		rows[i] = glm::vec4{ viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] };
+	}
+	m_planes[0] = rows[3] + rows[0];
+	m_planes[1] = rows[3] - rows[0];
+	m_planes[2] = rows[3] + rows[1];
+	m_planes[3] = rows[3] - rows[1];
+	m_planes[4] = rows[3] + rows[2];
+	m_planes[5] = rows[3] - rows[2];
+	for (auto& plane : m_planes) {
+		plane /= glm::length(glm::vec3{ plane });
+	}
+}
+
+Containment Frustum::classify(const BoundingBox& box) const {
+	if (box.isEmpty()) {
+		return Containment::Outside;
+	}
+	glm::vec3 center{ box.center() };
+	glm::vec3 extent{ box.halfExtent() };
+	Containment result{ Containment::Inside };
+	for (auto& plane : m_planes) {
+		glm::vec3 normal{ plane };
+		float distance{ glm::dot(normal, center) + plane.w };
+		// The box's "radius" in the direction of the plane normal.
+		float radius{ glm::dot(glm::abs(normal), extent) };
+		if (distance < -radius) {
+			return Containment::Outside;
+		}
+		if (distance < radius) {
+			result = Containment::Intersecting;
+		}
+	}
+	return result;
+}
+
+void Frustum::classify4(const BoundingBox* const boxes[4], uint32_t count, Containment results[4]) const {
+#ifdef FRUSTUM_USE_SSE
+	// Transpose the boxes into one register per coordinate. Unused and empty lanes are filled with
+	// zeros, and reported as Outside below.
+	alignas(16) float cx[4], cy[4], cz[4], ex[4], ey[4], ez[4];
+	uint32_t emptyMask{ 0 };
+	for (uint32_t i{ 0 }; i < 4; ++i) {
+		if (i >= count || boxes[i]->isEmpty()) {
+			cx[i] = cy[i] = cz[i] = ex[i] = ey[i] = ez[i] = 0;
+			emptyMask |= 1u << i;
+			continue;
+		}
+		glm::vec3 center{ boxes[i]->center() };
+		glm::vec3 extent{ boxes[i]->halfExtent() };
+		cx[i] = center.x;
+		cy[i] = center.y;
+		cz[i] = center.z;
+		ex[i] = extent.x;
+		ey[i] = extent.y;
+		ez[i] = extent.z;
+	}
+	__m128 centerX{ _mm_load_ps(cx) };
+	__m128 centerY{ _mm_load_ps(cy) };
+	__m128 centerZ{ _mm_load_ps(cz) };
+	__m128 extentX{ _mm_load_ps(ex) };
+	__m128 extentY{ _mm_load_ps(ey) };
+	__m128 extentZ{ _mm_load_ps(ez) };
+
+	__m128 outside{ _mm_setzero_ps() };
+	__m128 intersecting{ _mm_setzero_ps() };
+	for (auto& plane : m_planes) {
+		__m128 distance{ _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)), _mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+			_mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))) };
+		__m128 radius{ _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y)))),
+			_mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z)))) };
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+		intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(distance, radius));
+	}
+	uint32_t outsideMask{ static_cast<uint32_t>(_mm_movemask_ps(outside)) | emptyMask };
+	uint32_t intersectingMask{ static_cast<uint32_t>(_mm_movemask_ps(intersecting)) };
+	for (uint32_t i{ 0 }; i < count; ++i) {
+		if (outsideMask & (1u << i)) {
+			results[i] = Containment::Outside;
+		}
+		else {
+			results[i] = (intersectingMask & (1u << i)) ? Containment::Intersecting : Containment::Inside;
+		}
+	}
+#else
+	for (uint32_t i{ 0 }; i < count; ++i) {
+		results[i] = classify(*boxes[i]);
+	}
+#endif
+}
+
+const glm::vec4* Frustum::getPlanes() const {
+	return m_planes;
+}
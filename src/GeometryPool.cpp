@@ -0,0 +1,97 @@
+#include "GeometryPool.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+	// Creates a buffer of newSize bytes and copies the first usedSize bytes of the old buffer into it.
+	uint32_t growBuffer(uint32_t buffer, size_t usedSize, size_t newSize) {
+		uint32_t grown;
+		glGenBuffers(1, &grown);
+		RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+		if (buffer != 0) {
+			RenderState::bindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+			RenderState::deleteBuffer(buffer);
+		}
+		return grown;
+	}
+}
+
+void GeometryPool::reserve(uint32_t vertices, uint32_t indices) {
+	if (m_vao == 0) {
+		glGenVertexArrays(1, &m_vao);
+		glGenVertexArrays(1, &m_positionVao);
+	}
+
+	if (m_vertexCount + vertices > m_vertexCapacity) {
+		m_vertexCapacity = std::max({ m_vertexCount + vertices, m_vertexCapacity * 2, 65536u });
+		m_positionBuffer = growBuffer(m_positionBuffer, m_vertexCount * sizeof(glm::vec3), m_vertexCapacity * sizeof(glm::vec3));
+		RenderState::bindVertexArray(m_positionVao);
+		RenderState::bindBuffer(GL_ARRAY_BUFFER, m_positionBuffer);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+		glEnableVertexAttribArray(0);
+
+		m_vertexBuffer = growBuffer(m_vertexBuffer, m_vertexCount * sizeof(Vertex3D), m_vertexCapacity * sizeof(Vertex3D));
+		RenderState::bindVertexArray(m_vao);
+		RenderState::bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, x)));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, nx)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, u)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, occlusion)));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(15, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, lu)));
+		glEnableVertexAttribArray(15);
+	}
+	if (m_indexCount + indices > m_indexCapacity) {
+		m_indexCapacity = std::max({ m_indexCount + indices, m_indexCapacity * 2, 3u * 65536u });
+		m_elementBuffer = growBuffer(m_elementBuffer, m_indexCount * sizeof(uint32_t), m_indexCapacity * sizeof(uint32_t));
+		// Binding the element buffer while one of the pool's vertex arrays is bound attaches it.
+		RenderState::bindVertexArray(m_vao);
+		RenderState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBuffer);
+		RenderState::bindVertexArray(m_positionVao);
+		RenderState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBuffer);
+	}
+}
+
+const GeometryRange& GeometryPool::add(const Mesh& mesh) {
+	auto found{ m_ranges.find(mesh.getVertexArray()) };
+	if (found != m_ranges.end()) {
+		return found->second;
+	}
+
+	uint32_t vertices{ mesh.getVertexCount() };
+	uint32_t indices{ mesh.getFaceCount() };
+	reserve(vertices, indices);
+	RenderState::bindBuffer(GL_COPY_READ_BUFFER, mesh.getVertexBuffer());
+	RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, m_vertexBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m_vertexCount * sizeof(Vertex3D),
+		vertices * sizeof(Vertex3D));
+	RenderState::bindBuffer(GL_COPY_READ_BUFFER, mesh.getPositionBuffer());
+	RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, m_positionBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m_vertexCount * sizeof(glm::vec3),
+		vertices * sizeof(glm::vec3));
+	RenderState::bindBuffer(GL_COPY_READ_BUFFER, mesh.getElementBuffer());
+	RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, m_elementBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m_indexCount * sizeof(uint32_t),
+		indices * sizeof(uint32_t));
+
+	// Indices stay relative to their own mesh; baseVertex offsets them at draw time.
+	GeometryRange range{ m_indexCount, static_cast<int32_t>(m_vertexCount), indices };
+	m_vertexCount += vertices;
+	m_indexCount += indices;
+	return m_ranges.emplace(mesh.getVertexArray(), range).first->second;
+}
+
+uint32_t GeometryPool::getVertexArray() const {
+	return m_vao;
+}
+
+uint32_t GeometryPool::getPositionVertexArray() const {
+	return m_positionVao;
+}
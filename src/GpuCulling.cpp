@@ -0,0 +1,157 @@
+#include "GpuCulling.h"
+#include "Frustum.h"
+#include "RenderState.h"
+#include "InstanceTransforms.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace {
+	constexpr uint32_t CULL_GROUP_SIZE{ 64 };
+	constexpr uint32_t PYRAMID_GROUP_SIZE{ 8 };
+
+	// Shader storage binding points, matching cull_instances.comp.
+	constexpr uint32_t INSTANCES_BINDING{ 0 };
+	constexpr uint32_t INSTANCE_TRANSFORMS_BINDING{ 1 };
+	constexpr uint32_t COMMANDS_BINDING{ 2 };
+	constexpr uint32_t VISIBLE_TRANSFORMS_BINDING{ 3 };
+
+	uint32_t groupCount(uint32_t size, uint32_t groupSize) {
+		return (size + groupSize - 1) / groupSize;
+	}
+}
+
+bool GpuCulling::isSupported() {
+#ifdef GL_VERSION_4_3
+	return GLAD_GL_VERSION_4_3;
+#else
+	return false;
+#endif
+}
+
+GpuCulling::GpuCulling(ShaderProgram cullProgram, ShaderProgram pyramidProgram)
+	: m_cullProgram{ std::move(cullProgram) }, m_pyramidProgram{ std::move(pyramidProgram) } {
+	m_instanceCountUniform = m_cullProgram.getUniform<int32_t>("instanceCount");
+	m_frustumPlanesUniform = m_cullProgram.getUniform<glm::vec4>("frustumPlanes");
+	m_useDepthPyramidUniform = m_cullProgram.getUniform<bool>("useDepthPyramid");
+	m_depthPyramidLevelsUniform = m_cullProgram.getUniform<int32_t>("depthPyramidLevels");
+	m_previousViewProjectionUniform = m_cullProgram.getUniform<glm::mat4>("previousViewProjection");
+	m_sourceLevelUniform = m_pyramidProgram.getUniform<int32_t>("sourceLevel");
+	m_copyDepthUniform = m_pyramidProgram.getUniform<bool>("copyDepth");
+}
+
+void GpuCulling::clear() {
+	m_instances.clear();
+}
+
+void GpuCulling::addInstance(const glm::vec4& sphere, uint32_t command) {
+	m_instances.push_back(Instance{ sphere, command, {} });
+}
+
+uint32_t GpuCulling::cull(const glm::mat4& viewProjection, uint32_t instanceTransforms, uint32_t commandBuffer) {
+#ifdef GL_VERSION_4_3
+	if (m_instanceBuffer == 0) {
+		glGenBuffers(1, &m_instanceBuffer);
+		glGenBuffers(1, &m_visibleBuffer);
+	}
+	// Both buffers are orphaned each frame, like the queue's instance buffer, so the previous
+	// frame's draws are not waited on.
+	size_t instanceSize{ m_instances.size() * sizeof(Instance) };
+	m_instanceCapacity = std::max(m_instanceCapacity, instanceSize);
+	RenderState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_instanceCapacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceSize, m_instances.data());
+	m_visibleCapacity = std::max(m_visibleCapacity, m_instances.size() * sizeof(InstanceTransform));
+	RenderState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_visibleCapacity, nullptr, GL_DYNAMIC_COPY);
+
+	m_cullProgram.activate();
+	Frustum frustum{ viewProjection };
+	m_cullProgram.setUniform(m_frustumPlanesUniform, frustum.getPlanes(), 6);
+	m_cullProgram.setUniform(m_instanceCountUniform, static_cast<int32_t>(m_instances.size()));
+	m_cullProgram.setUniform(m_useDepthPyramidUniform, m_hasPyramid);
+	if (m_hasPyramid) {
+		m_cullProgram.setUniform(m_depthPyramidLevelsUniform, static_cast<int32_t>(m_levels));
+		m_cullProgram.setUniform(m_previousViewProjectionUniform, m_pyramidViewProjection);
+		RenderState::bindTexture(0, GL_TEXTURE_2D, m_pyramidTexture);
+	}
+	RenderState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, m_instanceBuffer);
+	RenderState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_TRANSFORMS_BINDING, instanceTransforms);
+	RenderState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, commandBuffer);
+	RenderState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_TRANSFORMS_BINDING, m_visibleBuffer);
+	glDispatchCompute(groupCount(static_cast<uint32_t>(m_instances.size()), CULL_GROUP_SIZE), 1, 1);
+	// The draws read the counts as indirect commands and the matrices as vertex attributes.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+#endif
+	return m_visibleBuffer;
+}
+
+void GpuCulling::resize(uint32_t width, uint32_t height) {
+#ifdef GL_VERSION_4_3
+	if (m_depthFramebuffer == 0) {
+		glGenFramebuffers(1, &m_depthFramebuffer);
+	}
+	else {
+		glDeleteTextures(1, &m_depthTexture);
+		glDeleteTextures(1, &m_pyramidTexture);
+		// Deleted textures are unbound from every unit, which the cache cannot see.
+		RenderState::invalidate();
+	}
+	m_width = width;
+	m_height = height;
+	m_levels = std::bit_width(std::max(width, height));
+
+	// The blit source is the default framebuffer's 24-bit depth, 8-bit stencil buffer, whose format
+	// the copy must match.
+	glGenTextures(1, &m_depthTexture);
+	RenderState::bindTexture(0, GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &m_pyramidTexture);
+	RenderState::bindTexture(0, GL_TEXTURE_2D, m_pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_depthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	m_hasPyramid = false;
+#endif
+}
+
+void GpuCulling::buildDepthPyramid(uint32_t width, uint32_t height, const glm::mat4& viewProjection) {
+#ifdef GL_VERSION_4_3
+	if (width == 0 || height == 0) {
+		return;
+	}
+	if (width != m_width || height != m_height) {
+		resize(width, height);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	m_pyramidProgram.activate();
+	for (uint32_t level{ 0 }; level < m_levels; ++level) {
+		// Level 0 copies the depth texture; each later level reduces the one before it.
+		m_pyramidProgram.setUniform(m_copyDepthUniform, level == 0);
+		m_pyramidProgram.setUniform(m_sourceLevelUniform, static_cast<int32_t>(level == 0 ? 0 : level - 1));
+		RenderState::bindTexture(0, GL_TEXTURE_2D, level == 0 ? m_depthTexture : m_pyramidTexture);
+		glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		uint32_t levelWidth{ std::max(width >> level, 1u) };
+		uint32_t levelHeight{ std::max(height >> level, 1u) };
+		glDispatchCompute(groupCount(levelWidth, PYRAMID_GROUP_SIZE), groupCount(levelHeight, PYRAMID_GROUP_SIZE), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	m_pyramidViewProjection = viewProjection;
+	m_hasPyramid = true;
+#endif
+}
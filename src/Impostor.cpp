@@ -0,0 +1,173 @@
+#include "Impostor.h"
+#include "Object3D.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+namespace {
+	// A quad with corners at (+-1, +-1), drawn as a triangle strip and shared by every impostor.
+	uint32_t quadVao() {
+		static uint32_t vao{ 0 };
+		if (vao == 0) {
+			const float corners[]{
+				-1, -1, 0,
+				 1, -1, 0,
+				-1,  1, 0,
+				 1,  1, 0,
+			};
+			uint32_t vbo;
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &vbo);
+			RenderState::bindVertexArray(vao);
+			RenderState::bindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+			glEnableVertexAttribArray(0);
+		}
+		return vao;
+	}
+
+	uint32_t createAtlasTexture(GLint internalFormat, GLenum format, GLenum type, uint32_t size) {
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// Linear filtering would blend neighboring tiles and the empty background into the edges.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size, size, 0, format, type, nullptr);
+		return texture;
+	}
+
+	// The angle of view i around the ring, measured around the local y axis from the local +z axis.
+	float viewAngle(uint32_t view, uint32_t viewCount) {
+		return 2 * std::numbers::pi_v<float> * view / viewCount;
+	}
+}
+
+Impostor::Impostor(uint32_t colorTexture, uint32_t normalTexture, uint32_t depthTexture, uint32_t viewCount,
+	uint32_t columns, const glm::mat3& captureNormalInverse)
+	: m_colorTexture{ colorTexture }, m_normalTexture{ normalTexture }, m_depthTexture{ depthTexture },
+	m_viewCount{ viewCount }, m_columns{ columns }, m_captureNormalInverse{ captureNormalInverse } {
+}
+
+glm::vec4 Impostor::tileOf(uint32_t view) const {
+	float scale{ 1.0f / m_columns };
+	return glm::vec4{ (view % m_columns) * scale, (view / m_columns) * scale, scale, scale };
+}
+
+Impostor Impostor::capture(Object3D& object, ShaderProgram& captureProgram, FrameUniformBuffer& frameUniforms,
+	DrawUniformRing& drawUniforms, uint32_t viewCount,
+	uint32_t viewResolution) {
+	if (viewCount == 0) {
+		throw std::runtime_error("An impostor needs at least one view");
+	}
+	object.updateHierarchy();
+	BoundingSphere sphere{ object.getWorldBoundingSphere() };
+	if (sphere.radius <= 0) {
+		throw std::runtime_error("Cannot capture an impostor of an object with no geometry");
+	}
+
+	uint32_t columns{ static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(viewCount)))) };
+	uint32_t atlasSize{ columns * viewResolution };
+	uint32_t color{ createAtlasTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, atlasSize) };
+	uint32_t normal{ createAtlasTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, atlasSize) };
+	uint32_t depth{ createAtlasTexture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, atlasSize) };
+
+	uint32_t framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	const GLenum drawBuffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		throw std::runtime_error("Impostor framebuffer is incomplete");
+	}
+
+	GLint previousViewport[4];
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	glViewport(0, 0, atlasSize, atlasSize);
+	// Empty texels keep an alpha of 0, which the impostor shader discards.
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Views are spaced around the object's own up axis, so the ring turns with the object.
+	glm::mat3 world{ object.getWorldMatrix() };
+	glm::vec3 up{ glm::normalize(world * glm::vec3{ 0, 1, 0 }) };
+	float r{ sphere.radius };
+	// Each view is an orthographic projection of the bounding sphere, from a camera 2r from its
+	// center, so depth 0..1 spans the sphere from front to back.
+	glm::mat4 projection{ glm::ortho(-r, r, -r, r, r, 3 * r) };
+
+	captureProgram.activate();
+	for (uint32_t i{ 0 }; i < viewCount; ++i) {
+		float angle{ viewAngle(i, viewCount) };
+		glm::vec3 direction{ glm::normalize(world * glm::vec3{ std::sin(angle), 0, std::cos(angle) }) };
+		glm::vec3 eye{ sphere.center + direction * (2 * r) };
+		glm::mat4 view{ glm::lookAt(eye, sphere.center, up) };
+		frameUniforms.update(view, projection, eye);
+		glViewport((i % columns) * viewResolution, (i / columns) * viewResolution, viewResolution, viewResolution);
+		drawUniforms.beginFrame(projection * view);
+		object.render(captureProgram, drawUniforms);
+		drawUniforms.endFrame();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	// The normal matrix is the inverse transpose of world, so its inverse is world's transpose.
+	return Impostor{ color, normal, depth, viewCount, columns, glm::transpose(world) };
+}
+
+void Impostor::render(ShaderProgram& impostorProgram, const Object3D& object, const glm::vec3& cameraPos) const {
+	BoundingSphere sphere{ object.getWorldBoundingSphere() };
+
+	// Find the direction to the camera in the object's local frame, and the two captured views on
+	// either side of it.
+	glm::mat3 worldInverse{ glm::inverse(glm::mat3{ object.getWorldMatrix() }) };
+	glm::vec3 local{ worldInverse * (cameraPos - sphere.center) };
+	float angle{ std::atan2(local.x, local.z) };
+	if (angle < 0) {
+		angle += 2 * std::numbers::pi_v<float>;
+	}
+	float position{ angle / (2 * std::numbers::pi_v<float>) * m_viewCount };
+	uint32_t first{ static_cast<uint32_t>(position) % m_viewCount };
+	uint32_t second{ (first + 1) % m_viewCount };
+
+	impostorProgram.setUniform("impostorCenter", sphere.center);
+	impostorProgram.setUniform("impostorRadius", sphere.radius);
+	impostorProgram.setUniform("tileA", tileOf(first));
+	impostorProgram.setUniform("tileB", tileOf(second));
+	impostorProgram.setUniform("viewBlend", position - std::floor(position));
+	// The normals were captured in world space; turn them by however the object has turned since.
+	impostorProgram.setUniform("impostorNormalRotation", glm::transpose(worldInverse) * m_captureNormalInverse);
+
+	RenderState::bindTexture(0, GL_TEXTURE_2D, m_colorTexture);
+	impostorProgram.setUniform("impostorColor", 0);
+	RenderState::bindTexture(1, GL_TEXTURE_2D, m_depthTexture);
+	impostorProgram.setUniform("impostorDepth", 1);
+	RenderState::bindTexture(2, GL_TEXTURE_2D, m_normalTexture);
+	impostorProgram.setUniform("impostorNormal", 2);
+
+	RenderState::bindVertexArray(quadVao());
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+uint32_t Impostor::getColorTexture() const {
+	return m_colorTexture;
+}
+
+uint32_t Impostor::getNormalTexture() const {
+	return m_normalTexture;
+}
+
+uint32_t Impostor::getDepthTexture() const {
+	return m_depthTexture;
+}
@@ -0,0 +1,78 @@
+#include "InstanceTransforms.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define INSTANCE_TRANSFORMS_USE_SSE 1
+#endif
+
+glm::mat3 computeNormalMatrix(const glm::mat4& model) {
+	// The inverse of a 3x3 matrix with columns a, b, c has rows b x c, c x a, and a x b, divided by
+	// the determinant; its transpose has them as columns.
+	glm::vec3 a{ model[0] };
+	glm::vec3 b{ model[1] };
+	glm::vec3 c{ model[2] };
+	glm::vec3 bc{ glm::cross(b, c) };
+	float inverseDeterminant{ 1 / glm::dot(a, bc) };
+	return glm::mat3{ bc * inverseDeterminant, glm::cross(c, a) * inverseDeterminant, glm::cross(a, b) * inverseDeterminant };
+}
+
+#ifdef INSTANCE_TRANSFORMS_USE_SSE
+namespace {
+	// Rotates the x, y, z lanes to y, z, x, leaving w in place.
+	__m128 yzx(__m128 v) {
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	// The cross product of the xyz lanes; the w lane is 0.
+	__m128 cross(__m128 a, __m128 b) {
+		return yzx(_mm_sub_ps(_mm_mul_ps(a, yzx(b)), _mm_mul_ps(yzx(a), b)));
+	}
+
+	// The sum of all four lanes, in every lane.
+	__m128 horizontalSum(__m128 v) {
+		__m128 pairs{ _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))) };
+		return _mm_add_ps(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2)));
+	}
+}
+#endif
+
+void computeInstanceTransforms(const glm::mat4& viewProjection, const glm::mat4* models, size_t count,
+	InstanceTransform* transforms) {
+#ifdef INSTANCE_TRANSFORMS_USE_SSE
+	__m128 viewProjectionColumns[4];
+	for (int32_t column{ 0 }; column < 4; ++column) {
+		viewProjectionColumns[column] = _mm_loadu_ps(&viewProjection[column][0]);
+	}
+	for (size_t i{ 0 }; i < count; ++i) {
+		const glm::mat4& model{ models[i] };
+		InstanceTransform& transform{ transforms[i] };
+		transform.model = model;
+
+		// Each column of the product is the view-projection's columns weighted by the model column.
+		for (int32_t column{ 0 }; column < 4; ++column) {
+			__m128 product{ _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(viewProjectionColumns[0], _mm_set1_ps(model[column][0])),
+					_mm_mul_ps(viewProjectionColumns[1], _mm_set1_ps(model[column][1]))),
+				_mm_add_ps(_mm_mul_ps(viewProjectionColumns[2], _mm_set1_ps(model[column][2])),
+					_mm_mul_ps(viewProjectionColumns[3], _mm_set1_ps(model[column][3])))) };
+			_mm_storeu_ps(&transform.modelViewProjection[column][0], product);
+		}
+
+		// Only the xyz lanes of the model's columns feed the crosses, and their w lanes come out 0.
+		__m128 a{ _mm_loadu_ps(&model[0][0]) };
+		__m128 b{ _mm_loadu_ps(&model[1][0]) };
+		__m128 c{ _mm_loadu_ps(&model[2][0]) };
+		__m128 bc{ cross(b, c) };
+		__m128 inverseDeterminant{ _mm_div_ps(_mm_set1_ps(1), horizontalSum(_mm_mul_ps(a, bc))) };
+		_mm_storeu_ps(&transform.normalMatrix[0][0], _mm_mul_ps(bc, inverseDeterminant));
+		_mm_storeu_ps(&transform.normalMatrix[1][0], _mm_mul_ps(cross(c, a), inverseDeterminant));
+		_mm_storeu_ps(&transform.normalMatrix[2][0], _mm_mul_ps(cross(a, b), inverseDeterminant));
+	}
+#else
+	for (size_t i{ 0 }; i < count; ++i) {
+		glm::mat3 normalMatrix{ computeNormalMatrix(models[i]) };
+		transforms[i] = InstanceTransform{ models[i], viewProjection * models[i],
+			{ glm::vec4{ normalMatrix[0], 0 }, glm::vec4{ normalMatrix[1], 0 }, glm::vec4{ normalMatrix[2], 0 } } };
+	}
+#endif
+}
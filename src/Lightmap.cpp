@@ -0,0 +1,440 @@
+#include "Lightmap.h"
+#include "Bvh.h"
+#include "InstanceTransforms.h"
+#include "Parallel.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+	constexpr uint32_t NONE{ 0xffffffff };
+	// A triangle joins a chart if its normal is within about 35 degrees of the chart's.
+	constexpr float CHART_COSINE{ 0.82f };
+	// The empty texels around each chart's rectangle.
+	constexpr uint32_t CHART_PADDING{ 2 };
+	// The number of times the edges of the charts are grown into the empty texels around them.
+	constexpr uint32_t DILATION_PASSES{ 2 };
+
+	struct Chart {
+		glm::vec3 normal;
+		std::vector<uint32_t> triangles{};
+		// The chart's extent in its plane, and where its rectangle was packed, in texels.
+		glm::vec2 min{ 0 };
+		glm::vec2 max{ 0 };
+		glm::uvec2 offset{ 0, 0 };
+	};
+
+	glm::uvec2 packedSize(const Chart& chart, float scale) {
+		glm::vec2 size{ glm::max(glm::ceil((chart.max - chart.min) * scale), glm::vec2{ 1 }) };
+		return glm::uvec2{ static_cast<uint32_t>(size.x) + 2 * CHART_PADDING, static_cast<uint32_t>(size.y) + 2 * CHART_PADDING };
+	}
+
+	// Packs the charts' rectangles into rows, tallest first, returning false if they do not fit.
+	bool packCharts(std::vector<Chart>& charts, const std::vector<uint32_t>& order, float scale, uint32_t resolution) {
+		glm::uvec2 cursor{ 0, 0 };
+		uint32_t rowHeight{ 0 };
+		for (uint32_t index : order) {
+			glm::uvec2 size{ packedSize(charts[index], scale) };
+			if (cursor.x + size.x > resolution) {
+				cursor = glm::uvec2{ 0, cursor.y + rowHeight };
+				rowHeight = 0;
+			}
+			if (cursor.x + size.x > resolution || cursor.y + size.y > resolution) {
+				return false;
+			}
+			charts[index].offset = cursor;
+			cursor.x += size.x;
+			rowHeight = std::max(rowHeight, size.y);
+		}
+		return true;
+	}
+
+	glm::vec3 perpendicular(const glm::vec3& normal) {
+		glm::vec3 helper{ std::abs(normal.x) > 0.9f ? glm::vec3{ 0, 1, 0 } : glm::vec3{ 1, 0, 0 } };
+		return glm::normalize(glm::cross(helper, normal));
+	}
+
+	// A cosine-distributed direction over the hemisphere around a unit normal, from a point in [0, 1)^2.
+	glm::vec3 cosineDirection(const glm::vec3& normal, const glm::vec2& sample) {
+		glm::vec3 tangent{ perpendicular(normal) };
+		glm::vec3 bitangent{ glm::cross(normal, tangent) };
+		float phi{ 2 * std::numbers::pi_v<float> * sample.y };
+		float radius{ std::sqrt(sample.x) };
+		return tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi))
+			+ normal * std::sqrt(1 - sample.x);
+	}
+
+	// The i-th point of a 2D Hammersley set of the given size, in [0, 1)^2.
+	glm::vec2 hammersley(uint32_t i, uint32_t count) {
+		uint32_t bits{ i };
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		return glm::vec2{ (i + 0.5f) / count, bits * 2.3283064365386963e-10f };
+	}
+
+	uint32_t hash(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// Advances a random state and returns a value in [0, 1).
+	float nextRandom(uint32_t& state) {
+		state = hash(state + 0x9e3779b9u);
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+void generateLightmapCharts(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& faces, uint32_t resolution) {
+	size_t triangleCount{ faces.size() / 3 };
+	if (triangleCount == 0 || resolution == 0 || vertices.empty()) {
+		return;
+	}
+	for (uint32_t index : faces) {
+		if (index >= vertices.size()) {
+			throw std::runtime_error("A face refers to vertex " + std::to_string(index) + " of a mesh with "
+				+ std::to_string(vertices.size()) + " vertices");
+		}
+	}
+	auto position{ [&](uint32_t index) {
+		return glm::vec3{ vertices[index].x, vertices[index].y, vertices[index].z };
+	} };
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (size_t t{ 0 }; t < triangleCount; ++t) {
+		glm::vec3 a{ position(faces[3 * t]) };
+		glm::vec3 normal{ glm::cross(position(faces[3 * t + 1]) - a, position(faces[3 * t + 2]) - a) };
+		float length{ glm::length(normal) };
+		normals[t] = length > 0 ? normal / length : glm::vec3{ 0, 0, 1 };
+	}
+
+	// Every triangle's edges, keyed by their vertices and sorted so that triangles sharing an edge are adjacent.
+	auto edgeKey{ [](uint32_t a, uint32_t b) {
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	} };
+	std::vector<std::pair<uint64_t, uint32_t>> edges{};
+	edges.reserve(faces.size());
+	for (uint32_t t{ 0 }; t < triangleCount; ++t) {
+		for (uint32_t e{ 0 }; e < 3; ++e) {
+			edges.emplace_back(edgeKey(faces[3 * t + e], faces[3 * t + (e + 1) % 3]), t);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	// Grow each chart from its first triangle across shared edges.
+	std::vector<uint32_t> chartOf(triangleCount, NONE);
+	std::vector<Chart> charts{};
+	std::vector<uint32_t> stack{};
+	for (uint32_t seed{ 0 }; seed < triangleCount; ++seed) {
+		if (chartOf[seed] != NONE) {
+			continue;
+		}
+		uint32_t chartIndex{ static_cast<uint32_t>(charts.size()) };
+		Chart chart{ normals[seed] };
+		chartOf[seed] = chartIndex;
+		stack.push_back(seed);
+		while (!stack.empty()) {
+			uint32_t t{ stack.back() };
+			stack.pop_back();
+			chart.triangles.push_back(t);
+			for (uint32_t e{ 0 }; e < 3; ++e) {
+				uint64_t key{ edgeKey(faces[3 * t + e], faces[3 * t + (e + 1) % 3]) };
+				for (auto it{ std::lower_bound(edges.begin(), edges.end(), std::pair<uint64_t, uint32_t>{ key, 0 }) };
+					it != edges.end() && it->first == key; ++it) {
+					uint32_t neighbor{ it->second };
+					if (chartOf[neighbor] == NONE && glm::dot(normals[neighbor], chart.normal) > CHART_COSINE) {
+						chartOf[neighbor] = chartIndex;
+						stack.push_back(neighbor);
+					}
+				}
+			}
+		}
+		charts.push_back(std::move(chart));
+	}
+
+	// Give each chart its own copies of its vertices, projected onto the chart's plane.
+	std::vector<Vertex3D> chartVertices{};
+	std::vector<glm::vec2> planeCoords{};
+	std::vector<uint32_t> chartVertexFaces(faces.size());
+	std::vector<uint32_t> vertexChart(vertices.size(), NONE);
+	std::vector<uint32_t> remap(vertices.size());
+	for (uint32_t c{ 0 }; c < charts.size(); ++c) {
+		Chart& chart{ charts[c] };
+		glm::vec3 tangent{ perpendicular(chart.normal) };
+		glm::vec3 bitangent{ glm::cross(chart.normal, tangent) };
+		chart.min = glm::vec2{ std::numeric_limits<float>::max() };
+		chart.max = glm::vec2{ std::numeric_limits<float>::lowest() };
+		for (uint32_t t : chart.triangles) {
+			for (uint32_t k{ 0 }; k < 3; ++k) {
+				uint32_t index{ faces[3 * t + k] };
+				if (vertexChart[index] != c) {
+					vertexChart[index] = c;
+					remap[index] = static_cast<uint32_t>(chartVertices.size());
+					chartVertices.push_back(vertices[index]);
+					glm::vec3 p{ position(index) };
+					glm::vec2 coord{ glm::dot(p, tangent), glm::dot(p, bitangent) };
+					planeCoords.push_back(coord);
+					chart.min = glm::min(chart.min, coord);
+					chart.max = glm::max(chart.max, coord);
+				}
+				chartVertexFaces[3 * t + k] = remap[index];
+			}
+		}
+	}
+
+	// Pack at the largest scale that fits, starting from the scale at which the charts would exactly
+	// cover the lightmap.
+	float area{ 0 };
+	for (auto& chart : charts) {
+		glm::vec2 size{ chart.max - chart.min };
+		area += std::max(size.x * size.y, 1e-12f);
+	}
+	std::vector<uint32_t> order(charts.size());
+	for (uint32_t i{ 0 }; i < order.size(); ++i) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return charts[a].max.y - charts[a].min.y > charts[b].max.y - charts[b].min.y;
+	});
+	float scale{ resolution / std::sqrt(area) };
+	while (!packCharts(charts, order, scale, resolution)) {
+		scale *= 0.9f;
+		if (scale * std::sqrt(area) < 1) {
+			throw std::runtime_error("A lightmap of " + std::to_string(resolution) + " texels is too small for "
+				+ std::to_string(charts.size()) + " charts");
+		}
+	}
+
+	for (uint32_t c{ 0 }; c < charts.size(); ++c) {
+		const Chart& chart{ charts[c] };
+		for (uint32_t t : chart.triangles) {
+			for (uint32_t k{ 0 }; k < 3; ++k) {
+				uint32_t index{ chartVertexFaces[3 * t + k] };
+				glm::vec2 texel{ glm::vec2{ chart.offset } + static_cast<float>(CHART_PADDING) + (planeCoords[index] - chart.min) * scale };
+				chartVertices[index].lu = texel.x / resolution;
+				chartVertices[index].lv = texel.y / resolution;
+			}
+		}
+	}
+	vertices = std::move(chartVertices);
+	faces = std::move(chartVertexFaces);
+}
+
+LightmapBaker::LightmapBaker(const LightmapBakeSettings& settings) : m_settings{ settings } {
+}
+
+void LightmapBaker::add(Object3D& object, uint32_t resolution) {
+	addRecursive(object, resolution);
+}
+
+void LightmapBaker::addRecursive(Object3D& object, uint32_t resolution) {
+	for (size_t i{ 0 }; i < object.numberOfMeshes(); ++i) {
+		Mesh& mesh{ object.getMesh(i) };
+		// A mesh without vertices has nothing to receive or block light.
+		if (mesh.getVertexCount() == 0) {
+			continue;
+		}
+		const RetainedGeometry* geometry{ mesh.getGeometry() };
+		if (geometry == nullptr) {
+			throw std::runtime_error("A lightmapped mesh must retain its geometry");
+		}
+		const glm::mat4& world{ object.getWorldMatrix() };
+		uint32_t first{ static_cast<uint32_t>(m_positions.size()) };
+		for (auto& p : geometry->positions) {
+			m_positions.emplace_back(world * glm::vec4{ p, 1 });
+		}
+		for (uint32_t index : geometry->faces) {
+			m_faces.push_back(first + index);
+		}
+		m_receivers.push_back(Receiver{ &mesh, world, resolution });
+	}
+	for (size_t i{ 0 }; i < object.numberOfChildren(); ++i) {
+		addRecursive(object.getChild(i), resolution);
+	}
+}
+
+std::vector<LightmapBaker::TexelSample> LightmapBaker::rasterize(const Receiver& receiver,
+	std::vector<uint8_t>& covered) const {
+	const RetainedGeometry& geometry{ *receiver.mesh->getGeometry() };
+	glm::mat3 normalMatrix{ computeNormalMatrix(receiver.world) };
+	int32_t resolution{ static_cast<int32_t>(receiver.resolution) };
+	std::vector<TexelSample> samples{};
+
+	for (size_t t{ 0 }; t + 2 < geometry.faces.size(); t += 3) {
+		uint32_t indices[3]{ geometry.faces[t], geometry.faces[t + 1], geometry.faces[t + 2] };
+		// Texel centers are at whole numbers.
+		glm::vec2 corners[3];
+		for (uint32_t k{ 0 }; k < 3; ++k) {
+			corners[k] = geometry.lightmapCoords[indices[k]] * static_cast<float>(resolution) - 0.5f;
+		}
+		auto edge{ [](const glm::vec2& a, const glm::vec2& b, const glm::vec2& p) {
+			return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+		} };
+		float area{ edge(corners[0], corners[1], corners[2]) };
+		if (std::abs(area) < 1e-12f) {
+			continue;
+		}
+		glm::vec2 lower{ glm::min(glm::min(corners[0], corners[1]), corners[2]) };
+		glm::vec2 upper{ glm::max(glm::max(corners[0], corners[1]), corners[2]) };
+		int32_t minX{ std::max(static_cast<int32_t>(std::ceil(lower.x)), 0) };
+		int32_t minY{ std::max(static_cast<int32_t>(std::ceil(lower.y)), 0) };
+		int32_t maxX{ std::min(static_cast<int32_t>(std::floor(upper.x)), resolution - 1) };
+		int32_t maxY{ std::min(static_cast<int32_t>(std::floor(upper.y)), resolution - 1) };
+		for (int32_t y{ minY }; y <= maxY; ++y) {
+			for (int32_t x{ minX }; x <= maxX; ++x) {
+				glm::vec2 p{ static_cast<float>(x), static_cast<float>(y) };
+				glm::vec3 weights{ edge(corners[1], corners[2], p), edge(corners[2], corners[0], p), edge(corners[0], corners[1], p) };
+				weights /= area;
+				uint32_t texel{ static_cast<uint32_t>(y * resolution + x) };
+				if (weights.x < -1e-5f || weights.y < -1e-5f || weights.z < -1e-5f || covered[texel]) {
+					continue;
+				}
+				covered[texel] = 1;
+				glm::vec3 localPosition{ geometry.positions[indices[0]] * weights.x
+					+ geometry.positions[indices[1]] * weights.y + geometry.positions[indices[2]] * weights.z };
+				glm::vec3 localNormal{ geometry.normals[indices[0]] * weights.x
+					+ geometry.normals[indices[1]] * weights.y + geometry.normals[indices[2]] * weights.z };
+				samples.push_back(TexelSample{ texel, glm::vec3{ receiver.world * glm::vec4{ localPosition, 1 } },
+					glm::normalize(normalMatrix * localNormal) });
+			}
+		}
+	}
+	return samples;
+}
+
+void LightmapBaker::bake() {
+	if (m_faces.empty()) {
+		return;
+	}
+	Bvh bvh{ m_positions, m_faces };
+	std::vector<glm::vec3> faceNormals(m_faces.size() / 3);
+	glm::vec3 boundsMin{ m_positions[0] };
+	glm::vec3 boundsMax{ boundsMin };
+	for (auto& p : m_positions) {
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+	for (size_t t{ 0 }; t < faceNormals.size(); ++t) {
+		glm::vec3 a{ m_positions[m_faces[3 * t]] };
+		glm::vec3 normal{ glm::cross(m_positions[m_faces[3 * t + 1]] - a, m_positions[m_faces[3 * t + 2]] - a) };
+		float length{ glm::length(normal) };
+		faceNormals[t] = length > 0 ? normal / length : glm::vec3{ 0, 1, 0 };
+	}
+	float sceneSize{ glm::length(boundsMax - boundsMin) };
+	// Rays start slightly above the surface, so they do not hit the triangle they start from.
+	float bias{ 1e-4f * sceneSize };
+	float maxDistance{ 2 * sceneSize };
+	glm::vec3 toSun{ -glm::normalize(m_settings.sunDirection) };
+
+	auto sunlight{ [&](const glm::vec3& position, const glm::vec3& normal) {
+		float cosine{ glm::dot(normal, toSun) };
+		if (cosine <= 0 || bvh.occluded(position + normal * bias, toSun, maxDistance)) {
+			return glm::vec3{ 0 };
+		}
+		return m_settings.sunColor * cosine;
+	} };
+	// The light arriving at a point along a direction, after up to m_settings.bounces reflections.
+	auto tracePath{ [&](glm::vec3 position, glm::vec3 normal, glm::vec3 direction, uint32_t& random) {
+		glm::vec3 light{ 0 };
+		glm::vec3 throughput{ 1 };
+		for (uint32_t bounce{ 0 }; ; ++bounce) {
+			BvhHit hit{};
+			if (!bvh.raycast(position + normal * bias, direction, maxDistance, hit)) {
+				return light + throughput * m_settings.skyColor;
+			}
+			if (bounce == m_settings.bounces) {
+				return light;
+			}
+			position = position + normal * bias + direction * hit.distance;
+			normal = faceNormals[hit.triangle];
+			if (glm::dot(normal, direction) > 0) {
+				normal = -normal;
+			}
+			throughput *= m_settings.bounceAlbedo;
+			light += throughput * sunlight(position, normal);
+			direction = cosineDirection(normal, glm::vec2{ nextRandom(random), nextRandom(random) });
+		}
+	} };
+
+	for (auto& receiver : m_receivers) {
+		uint32_t resolution{ receiver.resolution };
+		std::vector<uint8_t> covered(static_cast<size_t>(resolution) * resolution, 0);
+		std::vector<glm::vec3> texels(covered.size(), glm::vec3{ 0 });
+		std::vector<TexelSample> samples{ rasterize(receiver, covered) };
+
+		// Each sample writes only its own texel.
+		uint32_t sampleCount{ std::max(m_settings.samplesPerTexel, 1u) };
+		parallelFor(samples.size(), 64, [&](size_t begin, size_t end) {
+			for (size_t i{ begin }; i < end; ++i) {
+				const TexelSample& sample{ samples[i] };
+				uint32_t random{ hash(sample.texel) };
+				// Rotate each texel's pattern, so neighboring texels do not share the same banding.
+				float rotation{ nextRandom(random) };
+				glm::vec3 indirect{ 0 };
+				for (uint32_t s{ 0 }; s < sampleCount; ++s) {
+					glm::vec2 point{ hammersley(s, sampleCount) };
+					point.y = std::fmod(point.y + rotation, 1.0f);
+					indirect += tracePath(sample.position, sample.normal, cosineDirection(sample.normal, point), random);
+				}
+				texels[sample.texel] = sunlight(sample.position, sample.normal) + indirect / static_cast<float>(sampleCount);
+			}
+		});
+
+		// Grow the charts' edges outward, so filtering at their borders does not blend in black.
+		for (uint32_t pass{ 0 }; pass < DILATION_PASSES; ++pass) {
+			std::vector<uint8_t> grown{ covered };
+			for (int32_t y{ 0 }; y < static_cast<int32_t>(resolution); ++y) {
+				for (int32_t x{ 0 }; x < static_cast<int32_t>(resolution); ++x) {
+					size_t texel{ static_cast<size_t>(y) * resolution + x };
+					if (covered[texel]) {
+						continue;
+					}
+					glm::vec3 sum{ 0 };
+					uint32_t count{ 0 };
+					for (int32_t dy{ -1 }; dy <= 1; ++dy) {
+						for (int32_t dx{ -1 }; dx <= 1; ++dx) {
+							int32_t nx{ x + dx };
+							int32_t ny{ y + dy };
+							if (nx < 0 || ny < 0 || nx >= static_cast<int32_t>(resolution) || ny >= static_cast<int32_t>(resolution)) {
+								continue;
+							}
+							size_t neighbor{ static_cast<size_t>(ny) * resolution + nx };
+							if (covered[neighbor]) {
+								sum += texels[neighbor];
+								++count;
+							}
+						}
+					}
+					if (count > 0) {
+						texels[texel] = sum / static_cast<float>(count);
+						grown[texel] = 1;
+					}
+				}
+			}
+			covered = std::move(grown);
+		}
+
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// Half floats keep light brighter than 1, which the shader still scales by the material.
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, resolution, resolution, 0, GL_RGB, GL_FLOAT, texels.data());
+		receiver.mesh->addTexture(Texture{ texture, "lightmap" });
+	}
+}
@@ -0,0 +1,154 @@
+#include "Material.h"
+#include "RenderState.h"
+#include "TextureArrays.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	bool sameTexture(const Texture& a, const Texture& b) {
+		return a.textureId == b.textureId && a.samplerName == b.samplerName && a.target == b.target
+			&& a.layer == b.layer && a.rect == b.rect;
+	}
+
+	bool isBaseTexture(const Texture& texture) {
+		return texture.samplerName == MaterialLibrary::BASE_TEXTURE_SAMPLER;
+	}
+}
+
+void Material::bindTextures(ShaderProgram& program) const {
+	for (int32_t i{ 0 }; i < textures.size(); ++i) {
+		program.setUniform(textures[i].samplerName, i);
+		RenderState::bindTexture(i, textures[i].target, textures[i].textureId);
+	}
+}
+
+bool Material::sameBindings(const Material& other) const {
+	if (textures.size() != other.textures.size()) {
+		return false;
+	}
+	for (size_t i{ 0 }; i < textures.size(); ++i) {
+		if (textures[i].textureId != other.textures[i].textureId || textures[i].target != other.textures[i].target
+			|| textures[i].samplerName != other.textures[i].samplerName) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::shared_ptr<const Material> MaterialLibrary::intern(const glm::vec4& parameters, std::vector<Texture> textures) {
+	// Scenes have few materials, so a linear search is fast enough.
+	for (auto& material : s_materials) {
+		if (material->parameters != parameters || material->textures.size() != textures.size()) {
+			continue;
+		}
+		bool same{ true };
+		for (size_t i{ 0 }; i < textures.size() && same; ++i) {
+			same = sameTexture(material->textures[i], textures[i]);
+		}
+		if (same) {
+			return material;
+		}
+	}
+
+	if (s_materials.size() == MAX_MATERIALS) {
+		throw std::runtime_error("Too many materials; the Materials uniform block holds "
+			+ std::to_string(MAX_MATERIALS));
+	}
+	auto material{ std::make_shared<Material>(Material{
+		parameters, std::move(textures), static_cast<uint32_t>(s_materials.size())
+	}) };
+	assignBindingGroup(*material);
+	s_materials.push_back(material);
+	return material;
+}
+
+void MaterialLibrary::assignBindingGroup(Material& material) {
+	material.bindingGroup = material.index;
+	for (uint32_t i{ 0 }; i < material.index; ++i) {
+		if (s_materials[i]->sameBindings(material)) {
+			material.bindingGroup = s_materials[i]->bindingGroup;
+			return;
+		}
+	}
+}
+
+void MaterialLibrary::packNewTextures() {
+	std::vector<Texture> unpacked{};
+	for (size_t i{ s_packed }; i < s_materials.size(); ++i) {
+		for (auto& t : s_materials[i]->textures) {
+			bool seen{ std::any_of(unpacked.begin(), unpacked.end(),
+				[&](const Texture& u) { return u.textureId == t.textureId; }) };
+			if (isBaseTexture(t) && t.target == GL_TEXTURE_2D && !seen) {
+				unpacked.push_back(t);
+			}
+		}
+	}
+
+	if (!unpacked.empty()) {
+		std::vector<Texture> packed{ packTextureArrays(unpacked) };
+		for (size_t i{ s_packed }; i < s_materials.size(); ++i) {
+			for (auto& t : s_materials[i]->textures) {
+				if (!isBaseTexture(t) || t.target != GL_TEXTURE_2D) {
+					continue;
+				}
+				for (size_t j{ 0 }; j < unpacked.size(); ++j) {
+					if (unpacked[j].textureId == t.textureId) {
+						t = packed[j];
+						break;
+					}
+				}
+			}
+		}
+		// Free the originals, unless a material still binds one to some other sampler.
+		for (auto& original : unpacked) {
+			bool bound{ std::any_of(s_materials.begin(), s_materials.end(), [&](const std::shared_ptr<Material>& m) {
+				return std::any_of(m->textures.begin(), m->textures.end(),
+					[&](const Texture& t) { return t.textureId == original.textureId && t.target == GL_TEXTURE_2D; });
+			}) };
+			if (!bound) {
+				RenderState::deleteTexture(original.textureId);
+			}
+		}
+	}
+
+	for (size_t i{ s_packed }; i < s_materials.size(); ++i) {
+		assignBindingGroup(*s_materials[i]);
+	}
+	s_uploaded = std::min(s_uploaded, s_packed);
+	s_packed = s_materials.size();
+}
+
+void MaterialLibrary::bind() {
+	if (s_buffer == 0) {
+		glGenBuffers(1, &s_buffer);
+		RenderState::bindBuffer(GL_UNIFORM_BUFFER, s_buffer);
+		// The whole array is allocated, so that elements the shaders never read are still backed.
+		glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialUniforms), nullptr, GL_DYNAMIC_DRAW);
+	}
+	if (s_packed < s_materials.size()) {
+		packNewTextures();
+	}
+	if (s_uploaded < s_materials.size()) {
+		std::vector<MaterialUniforms> elements{};
+		for (size_t i{ s_uploaded }; i < s_materials.size(); ++i) {
+			const Material& material{ *s_materials[i] };
+			MaterialUniforms element{ material.parameters, glm::vec4{ 1, 1, 0, 0 }, 0 };
+			auto base{ std::find_if(material.textures.begin(), material.textures.end(), isBaseTexture) };
+			if (base != material.textures.end()) {
+				element.baseTextureRect = base->rect;
+				element.baseTextureLayer = static_cast<float>(base->layer);
+			}
+			elements.push_back(element);
+		}
+		RenderState::bindBuffer(GL_UNIFORM_BUFFER, s_buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, s_uploaded * sizeof(MaterialUniforms), elements.size() * sizeof(MaterialUniforms),
+			elements.data());
+		s_uploaded = s_materials.size();
+	}
+	RenderState::bindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_UNIFORM_BINDING, s_buffer);
+}
+
+size_t MaterialLibrary::size() {
+	return s_materials.size();
+}
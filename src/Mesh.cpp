@@ -1,30 +1,62 @@
 #include <glad/glad.h>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
 #include "Mesh.h"
+#include "CookedMesh.h"
+#include "RenderState.h"
 
 Mesh::Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces)
 	: Mesh{ vertices, faces, std::vector<Texture>{} } {
 }
 
 Mesh::Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
-	std::vector<Texture> textures) :
+	std::vector<Texture> textures)
+	: Mesh{ vertices, faces, MaterialLibrary::intern(Material{}.parameters, std::move(textures)) } {
+}
+
+Mesh::Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces,
+	std::shared_ptr<const Material> material) :
 	m_vertexCount{ static_cast<uint32_t>(vertices.size()) }, 
 	m_faceCount{ static_cast<uint32_t>(faces.size()) }, 
-	m_textures{ std::move(textures) } {
+	m_material{ std::move(material) } {
+
+	const float* positions{ vertices.empty() ? nullptr : &vertices[0].x };
+	m_bounds = computeBoundingBox(positions, vertices.size(), sizeof(Vertex3D));
+	m_boundingSphere = computeBoundingSphere(positions, vertices.size(), sizeof(Vertex3D), m_bounds);
+	createBuffers(vertices.data(), faces.data());
+
+	std::vector<glm::vec3> positionStream{};
+	positionStream.reserve(vertices.size());
+	for (auto& v : vertices) {
+		positionStream.emplace_back(v.x, v.y, v.z);
+	}
+	createPositionStream(positionStream.data());
+}
+
+Mesh::Mesh(uint32_t vertexCount, uint32_t faceCount, std::vector<Texture> textures) :
+	m_vertexCount{ vertexCount },
+	m_faceCount{ faceCount },
+	m_material{ MaterialLibrary::intern(Material{}.parameters, std::move(textures)) } {
+
+	createBuffers(nullptr, nullptr);
+	createPositionStream(nullptr);
+}
 
+void Mesh::createBuffers(const Vertex3D* vertices, const uint32_t* faces) {
 	// Generate a vertex array object on the GPU.
 	glGenVertexArrays(1, &m_vao);
 	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
-	glBindVertexArray(m_vao);
+	RenderState::bindVertexArray(m_vao);
 
 	// Generate a vertex buffer object on the GPU.
-	uint32_t vbo;
-	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &m_vbo);
 
 	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, m_vbo);
 	// This vbo is now associated with m_vao.
 	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex3D), &vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(Vertex3D), vertices, GL_STATIC_DRAW);
 	
 	
 	// TODO: use glVertexAttribPointer and glEnableVertexAttribArray to inform OpenGL about our
@@ -36,54 +68,240 @@ Mesh::Mesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& f
 	//glVertexAttribPointer(2, ...);
 	//glEnableVertexAttribArray(2);
 
+	// Attribute 3 is the baked ambient occlusion (1 float).
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, occlusion)));
+	glEnableVertexAttribArray(3);
+	// Attribute 15 is the lightmap texture coordinates (2 floats), after the instance attributes.
+	glVertexAttribPointer(15, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, lu)));
+	glEnableVertexAttribArray(15);
+
 	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	uint32_t ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &m_ebo);
+	RenderState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_faceCount * sizeof(uint32_t), faces, GL_STATIC_DRAW);
 
 	// Unbind the vertex array, so no one else can accidentally mess with it.
-	glBindVertexArray(0);
+	RenderState::bindVertexArray(0);
+}
+
+void Mesh::createPositionStream(const glm::vec3* positions) {
+	glGenVertexArrays(1, &m_positionVao);
+	RenderState::bindVertexArray(m_positionVao);
+	glGenBuffers(1, &m_positionVbo);
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, m_positionVbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(glm::vec3), positions, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+	glEnableVertexAttribArray(0);
+	// Share the triangles of the main vertex array.
+	RenderState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	RenderState::bindVertexArray(0);
 }
 
 void Mesh::addTexture(Texture texture) {
-	m_textures.emplace_back(std::move(texture));
+	addTextures(std::vector<Texture>{ std::move(texture) });
 }
 
 void Mesh::addTextures(std::vector<Texture> textures) {
+	std::vector<Texture> combined{ m_material->textures };
 	for (auto& t : textures) {
-		m_textures.emplace_back(std::move(t));
+		combined.emplace_back(std::move(t));
 	}
+	m_material = MaterialLibrary::intern(m_material->parameters, std::move(combined));
 }
 
-void Mesh::render(ShaderProgram& program) const {
-	glBindVertexArray(m_vao);
-	for (int32_t i{ 0 }; i < m_textures.size(); ++i) {
-		program.setUniform(m_textures[i].samplerName, i);
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textures[i].textureId);
+const Material& Mesh::getMaterial() const {
+	return *m_material;
+}
+
+void Mesh::setMaterial(std::shared_ptr<const Material> material) {
+	m_material = std::move(material);
+}
+
+void Mesh::setMaterialParameters(const glm::vec4& parameters) {
+	if (parameters != m_material->parameters) {
+		m_material = MaterialLibrary::intern(parameters, m_material->textures);
 	}
+}
+
+const BoundingBox& Mesh::getBounds() const {
+	return m_bounds;
+}
+
+const BoundingSphere& Mesh::getBoundingSphere() const {
+	return m_boundingSphere;
+}
+
+void Mesh::setBounds(const BoundingBox& bounds, const BoundingSphere& sphere) {
+	m_bounds = bounds;
+	m_boundingSphere = sphere;
+}
+
+void Mesh::retainGeometry(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& faces) {
+	std::vector<glm::vec3> positions{};
+	std::vector<glm::vec3> normals{};
+	std::vector<glm::vec2> lightmapCoords{};
+	positions.reserve(vertices.size());
+	normals.reserve(vertices.size());
+	lightmapCoords.reserve(vertices.size());
+	for (auto& v : vertices) {
+		positions.emplace_back(v.x, v.y, v.z);
+		normals.emplace_back(v.nx, v.ny, v.nz);
+		lightmapCoords.emplace_back(v.lu, v.lv);
+	}
+	Bvh bvh{ positions, faces };
+	m_geometry = std::make_shared<const RetainedGeometry>(RetainedGeometry{
+		std::move(positions), std::move(normals), std::move(lightmapCoords), faces, std::move(bvh)
+	});
+}
+
+const RetainedGeometry* Mesh::getGeometry() const {
+	return m_geometry.get();
+}
+
+void Mesh::setOccluder(std::shared_ptr<const OccluderProxy> occluder) {
+	m_occluder = std::move(occluder);
+}
+
+const OccluderProxy* Mesh::getOccluder() const {
+	return m_occluder.get();
+}
+
+uint32_t Mesh::getVertexArray() const {
+	return m_vao;
+}
+
+uint32_t Mesh::getVertexBuffer() const {
+	return m_vbo;
+}
+
+uint32_t Mesh::getElementBuffer() const {
+	return m_ebo;
+}
+
+uint32_t Mesh::getPositionVertexArray() const {
+	return m_positionVao;
+}
+
+uint32_t Mesh::getPositionBuffer() const {
+	return m_positionVbo;
+}
+
+uint32_t Mesh::getVertexCount() const {
+	return m_vertexCount;
+}
+
+uint32_t Mesh::getFaceCount() const {
+	return m_faceCount;
+}
+
+const std::vector<Texture>& Mesh::getTextures() const {
+	return m_material->textures;
+}
+
+void Mesh::render(ShaderProgram& program) const {
+	// Bindings are left in place after the draw; the next mesh only rebinds what differs.
+	RenderState::bindVertexArray(m_vao);
+	bindTextures(program);
 
 	// Draw the vertex array, using its "element buffer" to identify the faces.
 	glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
-	// Deactivate the mesh's vertex array and texture.
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Mesh::bindTextures(ShaderProgram& program) const {
+	m_material->bindTextures(program);
+}
+
+void Mesh::renderInstanced(ShaderProgram& program, uint32_t instanceCount) const {
+	RenderState::bindVertexArray(m_vao);
+	bindTextures(program);
+	glDrawElementsInstanced(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr, instanceCount);
+}
+
+void Mesh::renderWithoutTextures(uint32_t instanceCount) const {
+	RenderState::bindVertexArray(m_vao);
+	if (instanceCount > 0) {
+		glDrawElementsInstanced(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr, instanceCount);
+	}
+	else {
+		glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
+	}
+}
+
+void Mesh::renderDepth(uint32_t instanceCount) const {
+	RenderState::bindVertexArray(m_positionVao);
+	if (instanceCount > 0) {
+		glDrawElementsInstanced(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr, instanceCount);
+	}
+	else {
+		glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
+	}
+}
+
+Mesh Mesh::fromCooked(const CookedMesh& cooked, std::vector<Texture> textures) {
+	Mesh m{ cooked.getVertexCount(), cooked.getFaceCount(), std::move(textures) };
+	m.setBounds(cooked.getBounds(), cooked.getBoundingSphere());
+	if (m.m_vertexCount == 0 || m.m_faceCount == 0) {
+		return m;
+	}
+
+	// Map the buffers, then decode the two streams on loader threads while this thread waits. The
+	// positions are written to the position-only stream as they are decoded.
+	// The element buffer is part of the VAO's state, so the VAO must be bound to map it.
+	RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, m.m_positionVbo);
+	auto* positions{ static_cast<glm::vec3*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m.m_vertexCount * sizeof(glm::vec3),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) };
+	RenderState::bindVertexArray(m.m_vao);
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, m.m_vbo);
+	auto* vertices{ static_cast<Vertex3D*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, m.m_vertexCount * sizeof(Vertex3D),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) };
+	auto* faces{ static_cast<uint32_t*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, m.m_faceCount * sizeof(uint32_t),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) };
+
+	bool verticesDecoded{ false };
+	bool facesDecoded{ false };
+	if (vertices != nullptr && faces != nullptr && positions != nullptr) {
+		std::jthread faceLoader{ [&]() {
+			try {
+				cooked.decodeFaces(faces);
+				facesDecoded = true;
+			}
+			catch (std::runtime_error&) {
+			}
+		} };
+		try {
+			cooked.decodeVertices(vertices, positions);
+			verticesDecoded = true;
+		}
+		catch (std::runtime_error&) {
+		}
+	}
+
+	// glUnmapBuffer reports false if the buffer contents were lost while mapped.
+	bool vertexUnmapped{ vertices == nullptr || glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE };
+	bool faceUnmapped{ faces == nullptr || glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE };
+	RenderState::bindBuffer(GL_COPY_WRITE_BUFFER, m.m_positionVbo);
+	bool positionUnmapped{ positions == nullptr || glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE };
+	RenderState::bindVertexArray(0);
+	if (!verticesDecoded || !facesDecoded || !vertexUnmapped || !faceUnmapped || !positionUnmapped) {
+		throw std::runtime_error("Failed to decode cooked mesh into its buffers");
+	}
+	return m;
 }
 
 Mesh Mesh::square(std::vector<Texture> textures) {
-	Mesh m{
-		{
-			{ 0.5, 0.5, 0, 0, 0, 1, 1, 0 },    // TR
-			{ 0.5, -0.5, 0, 0, 0, 1, 1, 1 },   // BR
-			{ -0.5, -0.5, 0, 0, 0, 1, 0, 1 },  // BL
-			{ -0.5, 0.5, 0, 0, 0, 1, 0, 0 },   // TL
-		},
-		{
-			2, 1, 3,
-			3, 1, 0,
-		},
-		std::move(textures)
+	// The whole square is one lightmap chart.
+	std::vector<Vertex3D> vertices{
+		{ 0.5, 0.5, 0, 0, 0, 1, 1, 0, 1, 1, 0 },    // TR
+		{ 0.5, -0.5, 0, 0, 0, 1, 1, 1, 1, 1, 1 },   // BR
+		{ -0.5, -0.5, 0, 0, 0, 1, 0, 1, 1, 0, 1 },  // BL
+		{ -0.5, 0.5, 0, 0, 0, 1, 0, 0, 1, 0, 0 },   // TL
+	};
+	std::vector<uint32_t> faces{
+		2, 1, 3,
+		3, 1, 0,
 	};
+	Mesh m{ vertices, faces, std::move(textures) };
+	// Two triangles are cheap to keep, and let the square be ray cast and lightmapped.
+	m.retainGeometry(vertices, faces);
 	return m;
 }
\ No newline at end of file
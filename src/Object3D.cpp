@@ -1,6 +1,9 @@
 #include "Object3D.h"
 #include "ShaderProgram.h"
+#include "Impostor.h"
+#include "RenderQueue.h"
 #include <glm/ext.hpp>
+#include <algorithm>
 
 glm::mat4 Object3D::buildModelMatrix() const {
 	auto m = glm::translate(glm::mat4{ 1 }, m_position);
@@ -50,6 +53,18 @@ const glm::vec4& Object3D::getMaterial() const {
 	return m_material;
 }
 
+size_t Object3D::numberOfMeshes() const {
+	return m_meshes.size();
+}
+
+const Mesh& Object3D::getMesh(size_t index) const {
+	return m_meshes[index];
+}
+
+Mesh& Object3D::getMesh(size_t index) {
+	return m_meshes[index];
+}
+
 size_t Object3D::numberOfChildren() const {
 	return m_children.size();
 }
@@ -64,14 +79,17 @@ Object3D& Object3D::getChild(size_t index) {
 
 void Object3D::setPosition(glm::vec3 position) {
 	m_position = position;
+	m_transformDirty = true;
 }
 
 void Object3D::setOrientation(glm::vec3 orientation) {
 	m_orientation = orientation;
+	m_transformDirty = true;
 }
 
 void Object3D::setScale(glm::vec3 scale) {
 	m_scale = scale;
+	m_transformDirty = true;
 }
 
 /**
@@ -81,6 +99,7 @@ void Object3D::setScale(glm::vec3 scale) {
 void Object3D::setCenter(glm::vec3 center)
 {
 	m_center = center;
+	m_transformDirty = true;
 }
 
 void Object3D::setName(std::string name) {
@@ -89,33 +108,312 @@ void Object3D::setName(std::string name) {
 
 void Object3D::setMaterial(glm::vec4 material) {
 	m_material = material;
+	for (auto& mesh : m_meshes) {
+		mesh.setMaterialParameters(material);
+	}
+}
+
+void Object3D::setStatic(bool isStatic) {
+	m_static = isStatic;
+	for (auto& child : m_children) {
+		child.setStatic(isStatic);
+	}
+}
+
+bool Object3D::isStatic() const {
+	return m_static;
 }
 
 void Object3D::move(const glm::vec3& offset) {
 	m_position = m_position + offset;
+	m_transformDirty = true;
 }
 
 void Object3D::rotate(const glm::vec3& rotation) {
 	m_orientation = m_orientation + rotation;
+	m_transformDirty = true;
 }
 
 void Object3D::grow(const glm::vec3& growth) {
 	m_scale = m_scale * growth;
+	m_transformDirty = true;
 }
 
 void Object3D::addChild(Object3D child) {
 	m_children.emplace_back(std::move(child));
+	m_transformDirty = true;
+}
+
+bool Object3D::updateHierarchy() {
+	return updateHierarchy(glm::mat4{ 1 }, false);
+}
+
+bool Object3D::updateHierarchy(const glm::mat4& parentWorld, bool parentChanged) {
+	bool changed{ parentChanged || m_transformDirty };
+	if (changed) {
+		m_worldMatrix = parentWorld * buildModelMatrix();
+		m_transformDirty = false;
+	}
+
+	bool childChanged{ false };
+	for (auto& child : m_children) {
+		if (child.updateHierarchy(m_worldMatrix, changed)) {
+			childChanged = true;
+		}
+	}
+
+	if (!changed && !childChanged) {
+		return false;
+	}
+	m_worldBounds = BoundingBox{};
+	if (changed) {
+		m_meshWorldBounds.clear();
+		for (auto& mesh : m_meshes) {
+			m_meshWorldBounds.push_back(mesh.getBounds().transformed(m_worldMatrix));
+		}
+	}
+	for (auto& bounds : m_meshWorldBounds) {
+		m_worldBounds.grow(bounds);
+	}
+	for (auto& child : m_children) {
+		m_worldBounds.grow(child.m_worldBounds);
+	}
+	return true;
+}
+
+const glm::mat4& Object3D::getWorldMatrix() const {
+	return m_worldMatrix;
+}
+
+const BoundingBox& Object3D::getWorldBounds() const {
+	return m_worldBounds;
+}
+
+BoundingSphere Object3D::getWorldBoundingSphere() const {
+	if (m_worldBounds.isEmpty()) {
+		return BoundingSphere{};
+	}
+	return BoundingSphere{ m_worldBounds.center(), glm::length(m_worldBounds.halfExtent()) };
+}
+
+bool Object3D::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+	return raycastRecursive(origin, glm::normalize(direction), maxDistance, hit, glm::mat4{ 1 });
+}
+
+bool Object3D::intersectSegment(const glm::vec3& start, const glm::vec3& end, RayHit& hit) const {
+	float length{ glm::length(end - start) };
+	if (length == 0) {
+		return false;
+	}
+	return raycastRecursive(start, (end - start) / length, length, hit, glm::mat4{ 1 });
+}
+
+void Object3D::overlapSphere(const glm::vec3& center, float radius, std::vector<SphereHit>& hits) const {
+	overlapSphereRecursive(center, radius, hits, glm::mat4{ 1 });
+}
+
+/**
+ * @brief Ray casts the object and its children. maxDistance is lowered to the distance of each hit
+ * that is found, so later meshes only report closer hits.
+ */
+bool Object3D::raycastRecursive(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance,
+	RayHit& hit, const glm::mat4& parentModel) const {
+	glm::mat4 model{ parentModel * buildModelMatrix() };
+	glm::mat4 inverseModel{ glm::inverse(model) };
+	// The ray is moved into local space without renormalizing its direction, so a distance along
+	// the local ray is the same as the distance along the world ray.
+	glm::vec3 localOrigin{ inverseModel * glm::vec4{ origin, 1 } };
+	glm::vec3 localDirection{ inverseModel * glm::vec4{ direction, 0 } };
+
+	bool found{ false };
+	for (auto& mesh : m_meshes) {
+		const RetainedGeometry* geometry{ mesh.getGeometry() };
+		BvhHit local{};
+		if (geometry == nullptr || !geometry->bvh.raycast(localOrigin, localDirection, maxDistance, local)) {
+			continue;
+		}
+
+		const auto& faces{ geometry->faces };
+		const auto& a{ geometry->positions[faces[3 * local.triangle]] };
+		const auto& b{ geometry->positions[faces[3 * local.triangle + 1]] };
+		const auto& c{ geometry->positions[faces[3 * local.triangle + 2]] };
+		glm::mat3 normalMatrix{ glm::transpose(glm::inverse(glm::mat3{ model })) };
+
+		maxDistance = local.distance;
+		hit = RayHit{
+			local.distance,
+			origin + direction * local.distance,
+			glm::normalize(normalMatrix * glm::cross(b - a, c - a)),
+			this,
+			&mesh,
+			local.triangle
+		};
+		found = true;
+	}
+
+	for (auto& child : m_children) {
+		if (child.raycastRecursive(origin, direction, maxDistance, hit, model)) {
+			found = true;
+		}
+	}
+	return found;
+}
+
+void Object3D::overlapSphereRecursive(const glm::vec3& center, float radius, std::vector<SphereHit>& hits,
+	const glm::mat4& parentModel) const {
+	glm::mat4 model{ parentModel * buildModelMatrix() };
+	glm::mat4 inverseModel{ glm::inverse(model) };
+
+	// A non-uniform scale turns the sphere into an ellipsoid in local space, so query the BVH with a
+	// local sphere large enough to contain it, and then test each candidate exactly in world space.
+	glm::vec3 localCenter{ inverseModel * glm::vec4{ center, 1 } };
+	float inverseScale{ std::max({ glm::length(glm::vec3{ inverseModel[0] }), glm::length(glm::vec3{ inverseModel[1] }),
+		glm::length(glm::vec3{ inverseModel[2] }) }) };
+
+	std::vector<uint32_t> candidates{};
+	for (auto& mesh : m_meshes) {
+		const RetainedGeometry* geometry{ mesh.getGeometry() };
+		if (geometry == nullptr) {
+			continue;
+		}
+		candidates.clear();
+		geometry->bvh.overlapSphere(localCenter, radius * inverseScale, candidates);
+		for (uint32_t triangle : candidates) {
+			glm::vec3 corners[3];
+			for (int i{ 0 }; i < 3; ++i) {
+				corners[i] = glm::vec3{ model * glm::vec4{ geometry->positions[geometry->faces[3 * triangle + i]], 1 } };
+			}
+			glm::vec3 offset{ Bvh::closestPointOnTriangle(center, corners[0], corners[1], corners[2]) - center };
+			if (glm::dot(offset, offset) <= radius * radius) {
+				hits.push_back(SphereHit{ this, &mesh, triangle });
+			}
+		}
+	}
+
+	for (auto& child : m_children) {
+		child.overlapSphereRecursive(center, radius, hits, model);
+	}
+}
+
+void Object3D::setImpostor(std::shared_ptr<const Impostor> impostor, float distance) {
+	m_impostor = std::move(impostor);
+	m_impostorDistance = distance;
+}
+
+const Impostor* Object3D::getImpostor() const {
+	return m_impostor.get();
+}
+
+bool Object3D::useImpostor(const glm::vec3& cameraPos) const {
+	if (m_impostor == nullptr || m_worldBounds.isEmpty()) {
+		return false;
+	}
+	return glm::distance(cameraPos, getWorldBoundingSphere().center) > m_impostorDistance;
+}
+
+void Object3D::collect(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum,
+	const OcclusionBuffer* occlusion, CullingStats& stats) const {
+	++stats.tested;
+	Containment containment{ frustum.classify(m_worldBounds) };
+	if (containment == Containment::Outside) {
+		++stats.culled;
+		return;
+	}
+	if (containment == Containment::Inside) {
+		++stats.accepted;
+	}
+	if (occlusion != nullptr && occlusion->isOccluded(m_worldBounds)) {
+		++stats.occluded;
+		return;
+	}
+	collectVisible(queue, shaderProgram, frustum, occlusion, stats, containment == Containment::Inside);
+}
+
+void Object3D::collectVisible(RenderQueue& queue, ShaderProgram& shaderProgram, const Frustum& frustum,
+	const OcclusionBuffer* occlusion, CullingStats& stats, bool inside) const {
+	// Tests the meshes or children of a straddling object against the frustum four at a time. Every
+	// box of an object that is inside the frustum is inside too.
+	const BoundingBox* boxes[4];
+	Containment results[4];
+	auto classify{ [&](uint32_t count) {
+		if (inside) {
+			std::fill_n(results, count, Containment::Inside);
+			return;
+		}
+		frustum.classify4(boxes, count, results);
+		stats.tested += count;
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			if (results[i] == Containment::Outside) {
+				++stats.culled;
+			}
+			else if (results[i] == Containment::Inside) {
+				++stats.accepted;
+			}
+		}
+	} };
+	auto isOccluded{ [&](const BoundingBox& box) {
+		if (occlusion != nullptr && occlusion->isOccluded(box)) {
+			++stats.occluded;
+			return true;
+		}
+		return false;
+	} };
+
+	for (size_t first{ 0 }; first < m_meshes.size(); first += 4) {
+		uint32_t count{ static_cast<uint32_t>(std::min<size_t>(4, m_meshes.size() - first)) };
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			boxes[i] = &m_meshWorldBounds[first + i];
+		}
+		classify(count);
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			// A lone mesh has the same bounds as its object, which was already tested.
+			bool tested{ m_meshes.size() == 1 && m_children.empty() };
+			if (results[i] != Containment::Outside && (tested || !isOccluded(*boxes[i]))) {
+				queue.add(shaderProgram, m_meshes[first + i], m_worldMatrix);
+			}
+		}
+	}
+	for (size_t first{ 0 }; first < m_children.size(); first += 4) {
+		uint32_t count{ static_cast<uint32_t>(std::min<size_t>(4, m_children.size() - first)) };
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			boxes[i] = &m_children[first + i].m_worldBounds;
+		}
+		classify(count);
+		for (uint32_t i{ 0 }; i < count; ++i) {
+			if (results[i] != Containment::Outside && !isOccluded(*boxes[i])) {
+				m_children[first + i].collectVisible(queue, shaderProgram, frustum, occlusion, stats,
+					results[i] == Containment::Inside);
+			}
+		}
+	}
+}
+
+void Object3D::collectOccluders(OcclusionBuffer& occlusion, const Frustum& frustum) const {
+	if (frustum.classify(m_worldBounds) == Containment::Outside) {
+		return;
+	}
+	for (size_t i{ 0 }; i < m_meshes.size(); ++i) {
+		const OccluderProxy* occluder{ m_meshes[i].getOccluder() };
+		if (occluder != nullptr && frustum.classify(m_meshWorldBounds[i]) != Containment::Outside) {
+			occlusion.addOccluder(*occluder, m_worldMatrix);
+		}
+	}
+	for (auto& child : m_children) {
+		child.collectOccluders(occlusion, frustum);
+	}
 }
 
-void Object3D::render(ShaderProgram& shaderProgram) const {
-	renderRecursive(shaderProgram, glm::mat4{ 1 });
+void Object3D::render(ShaderProgram& shaderProgram, DrawUniformRing& drawUniforms) const {
+	MaterialLibrary::bind();
+	renderRecursive(shaderProgram, drawUniforms, glm::mat4{ 1 });
 }
 
 /**
  * @brief Renders the object and its children, recursively.
  * @param parentMatrix the model matrix of this object's parent in the model hierarchy.
  */
-void Object3D::renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentModel) const {
+void Object3D::renderRecursive(ShaderProgram& shaderProgram, DrawUniformRing& drawUniforms,
+	const glm::mat4& parentModel) const {
 	// Build the local model matrix, which is relative to the parent model matrix.
 	glm::mat4 localModel{ buildModelMatrix() };
 
@@ -130,9 +428,9 @@ void Object3D::renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& pa
 
 
 
-	shaderProgram.setUniform("model", trueModel);
-	// Render each *mesh* in the object.
+	// Render each *mesh* in the object, with its own material.
 	for (auto& mesh : m_meshes) {
+		drawUniforms.push(trueModel, mesh.getMaterial().index);
 		mesh.render(shaderProgram);
 	}
 
@@ -0,0 +1,334 @@
+#include "Occlusion.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OCCLUSION_USE_SSE 1
+#endif
+
+namespace {
+	// Clip-space w below which a vertex counts as being on or behind the near plane.
+	constexpr float NEAR_W{ 1e-4f };
+
+	uint32_t roundUp(uint32_t value, uint32_t multiple) {
+		return std::max(1u, (value + multiple - 1) / multiple) * multiple;
+	}
+}
+
+OccluderProxy buildOccluderProxy(const float* positions, size_t vertexCount, size_t stride,
+	const std::vector<uint32_t>& faces, uint32_t gridResolution) {
+	OccluderProxy proxy{};
+	if (vertexCount == 0 || gridResolution == 0) {
+		return proxy;
+	}
+	for (uint32_t index : faces) {
+		if (index >= vertexCount) {
+			throw std::runtime_error("Occluder face index " + std::to_string(index) + " is out of range for "
+				+ std::to_string(vertexCount) + " vertices");
+		}
+	}
+	BoundingBox box{ computeBoundingBox(positions, vertexCount, stride) };
+	glm::vec3 size{ box.max - box.min };
+	float longest{ std::max({ size.x, size.y, size.z }) };
+	if (longest <= 0) {
+		return proxy;
+	}
+	float cellSize{ longest / gridResolution };
+	uint32_t cellsX{ std::max(1u, static_cast<uint32_t>(std::ceil(size.x / cellSize))) };
+	uint32_t cellsY{ std::max(1u, static_cast<uint32_t>(std::ceil(size.y / cellSize))) };
+	uint32_t cellsZ{ std::max(1u, static_cast<uint32_t>(std::ceil(size.z / cellSize))) };
+	auto cellIndex{ [&](float coordinate, float minimum, uint32_t cells) {
+		return std::min(static_cast<uint32_t>((coordinate - minimum) / cellSize), cells - 1);
+	} };
+
+	// Merge the vertices of each cell, accumulating their positions to average afterward.
+	std::unordered_map<uint64_t, uint32_t> cellVertices{};
+	std::vector<uint32_t> counts{};
+	std::vector<uint32_t> remap(vertexCount);
+	for (size_t i{ 0 }; i < vertexCount; ++i) {
+		const float* p{ reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + i * stride) };
+		glm::vec3 position{ p[0], p[1], p[2] };
+		uint64_t cell{ (static_cast<uint64_t>(cellIndex(position.x, box.min.x, cellsX)) * cellsY
+			+ cellIndex(position.y, box.min.y, cellsY)) * cellsZ + cellIndex(position.z, box.min.z, cellsZ) };
+		auto [found, inserted] { cellVertices.try_emplace(cell, static_cast<uint32_t>(proxy.positions.size())) };
+		if (inserted) {
+			proxy.positions.push_back(glm::vec3{ 0 });
+			counts.push_back(0);
+		}
+		proxy.positions[found->second] += position;
+		++counts[found->second];
+		remap[i] = found->second;
+	}
+	for (size_t i{ 0 }; i < proxy.positions.size(); ++i) {
+		proxy.positions[i] /= static_cast<float>(counts[i]);
+	}
+
+	for (size_t i{ 0 }; i + 2 < faces.size(); i += 3) {
+		uint32_t a{ remap[faces[i]] };
+		uint32_t b{ remap[faces[i + 1]] };
+		uint32_t c{ remap[faces[i + 2]] };
+		if (a != b && b != c && a != c) {
+			proxy.faces.insert(proxy.faces.end(), { a, b, c });
+		}
+	}
+	return proxy;
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+	: m_width{ roundUp(width, TILE_WIDTH) }, m_height{ roundUp(height, TILE_HEIGHT) },
+	m_tilesX{ m_width / TILE_WIDTH }, m_tilesY{ m_height / TILE_HEIGHT } {
+	m_bins.resize(m_tilesX * m_tilesY);
+	uint32_t levelWidth{ m_width };
+	uint32_t levelHeight{ m_height };
+	while (true) {
+		m_levels.emplace_back(levelWidth * levelHeight, 1.0f);
+		m_levelWidths.push_back(levelWidth);
+		m_levelHeights.push_back(levelHeight);
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+void OcclusionBuffer::clear(const glm::mat4& viewProjection) {
+	m_viewProjection = viewProjection;
+	m_triangles.clear();
+	for (auto& bin : m_bins) {
+		bin.clear();
+	}
+	m_hasOccluders = false;
+}
+
+void OcclusionBuffer::addOccluder(const OccluderProxy& occluder, const glm::mat4& world) {
+	glm::mat4 toClip{ m_viewProjection * world };
+	m_clipPositions.clear();
+	for (auto& position : occluder.positions) {
+		m_clipPositions.push_back(toClip * glm::vec4{ position, 1 });
+	}
+
+	for (size_t i{ 0 }; i + 2 < occluder.faces.size(); i += 3) {
+		const glm::vec4& c0{ m_clipPositions[occluder.faces[i]] };
+		const glm::vec4& c1{ m_clipPositions[occluder.faces[i + 1]] };
+		const glm::vec4& c2{ m_clipPositions[occluder.faces[i + 2]] };
+		if (c0.w < NEAR_W || c1.w < NEAR_W || c2.w < NEAR_W) {
+			continue;
+		}
+		// Skip triangles that are entirely outside one side of the screen or beyond the far plane.
+		if ((c0.x < -c0.w && c1.x < -c1.w && c2.x < -c2.w) || (c0.x > c0.w && c1.x > c1.w && c2.x > c2.w)
+			|| (c0.y < -c0.w && c1.y < -c1.w && c2.y < -c2.w) || (c0.y > c0.w && c1.y > c1.w && c2.y > c2.w)
+			|| (c0.z > c0.w && c1.z > c1.w && c2.z > c2.w)) {
+			continue;
+		}
+
+		ScreenTriangle triangle{};
+		auto toScreen{ [&](const glm::vec4& clip, glm::vec2& screen, float& depth) {
+			float inverseW{ 1 / clip.w };
+			screen = glm::vec2{ (clip.x * inverseW * 0.5f + 0.5f) * m_width, (clip.y * inverseW * 0.5f + 0.5f) * m_height };
+			depth = std::clamp(clip.z * inverseW * 0.5f + 0.5f, 0.0f, 1.0f);
+		} };
+		toScreen(c0, triangle.v0, triangle.z0);
+		toScreen(c1, triangle.v1, triangle.z1);
+		toScreen(c2, triangle.v2, triangle.z2);
+
+		// Occluders are drawn from both sides; put every triangle in counterclockwise order.
+		float area{ (triangle.v1.x - triangle.v0.x) * (triangle.v2.y - triangle.v0.y)
+			- (triangle.v1.y - triangle.v0.y) * (triangle.v2.x - triangle.v0.x) };
+		if (area == 0) {
+			continue;
+		}
+		if (area < 0) {
+			std::swap(triangle.v1, triangle.v2);
+			std::swap(triangle.z1, triangle.z2);
+		}
+
+		triangle.minX = std::max(0, static_cast<int32_t>(std::floor(std::min({ triangle.v0.x, triangle.v1.x, triangle.v2.x }))));
+		triangle.minY = std::max(0, static_cast<int32_t>(std::floor(std::min({ triangle.v0.y, triangle.v1.y, triangle.v2.y }))));
+		triangle.maxX = std::min(static_cast<int32_t>(m_width) - 1,
+			static_cast<int32_t>(std::ceil(std::max({ triangle.v0.x, triangle.v1.x, triangle.v2.x }))));
+		triangle.maxY = std::min(static_cast<int32_t>(m_height) - 1,
+			static_cast<int32_t>(std::ceil(std::max({ triangle.v0.y, triangle.v1.y, triangle.v2.y }))));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+			continue;
+		}
+
+		uint32_t index{ static_cast<uint32_t>(m_triangles.size()) };
+		m_triangles.push_back(triangle);
+		for (int32_t ty{ triangle.minY / static_cast<int32_t>(TILE_HEIGHT) }; ty <= triangle.maxY / static_cast<int32_t>(TILE_HEIGHT); ++ty) {
+			for (int32_t tx{ triangle.minX / static_cast<int32_t>(TILE_WIDTH) }; tx <= triangle.maxX / static_cast<int32_t>(TILE_WIDTH); ++tx) {
+				m_bins[ty * m_tilesX + tx].push_back(index);
+			}
+		}
+		m_hasOccluders = true;
+	}
+}
+
+void OcclusionBuffer::rasterizeTile(uint32_t tile) {
+	int32_t tileX{ static_cast<int32_t>((tile % m_tilesX) * TILE_WIDTH) };
+	int32_t tileY{ static_cast<int32_t>((tile / m_tilesX) * TILE_HEIGHT) };
+	float* depth{ m_levels[0].data() };
+	for (int32_t y{ tileY }; y < tileY + static_cast<int32_t>(TILE_HEIGHT); ++y) {
+		std::fill_n(depth + y * m_width + tileX, TILE_WIDTH, 1.0f);
+	}
+
+	for (uint32_t index : m_bins[tile]) {
+		const ScreenTriangle& t{ m_triangles[index] };
+		// Start on a multiple of four pixels, so every group of four stays inside the tile.
+		int32_t startX{ std::max(t.minX, tileX) & ~3 };
+		int32_t endX{ std::min(t.maxX, tileX + static_cast<int32_t>(TILE_WIDTH) - 1) };
+		int32_t startY{ std::max(t.minY, tileY) };
+		int32_t endY{ std::min(t.maxY, tileY + static_cast<int32_t>(TILE_HEIGHT) - 1) };
+
+		// Edge function i is positive on the inside of the edge opposite vertex i, and is that
+		// vertex's barycentric weight times the triangle's doubled area.
+		float area{ (t.v1.x - t.v0.x) * (t.v2.y - t.v0.y) - (t.v1.y - t.v0.y) * (t.v2.x - t.v0.x) };
+		float inverseArea{ 1 / area };
+		auto edgeAt{ [](const glm::vec2& a, const glm::vec2& b, float x, float y) {
+			return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+		} };
+		float stepX0{ -(t.v2.y - t.v1.y) };
+		float stepX1{ -(t.v0.y - t.v2.y) };
+		float stepX2{ -(t.v1.y - t.v0.y) };
+
+		for (int32_t y{ startY }; y <= endY; ++y) {
+			// Sample at pixel centers.
+			float py{ y + 0.5f };
+			float px{ startX + 0.5f };
+			float e0{ edgeAt(t.v1, t.v2, px, py) };
+			float e1{ edgeAt(t.v2, t.v0, px, py) };
+			float e2{ edgeAt(t.v0, t.v1, px, py) };
+			float* row{ depth + y * m_width };
+#ifdef OCCLUSION_USE_SSE
+			__m128 offsets{ _mm_setr_ps(0, 1, 2, 3) };
+			__m128 w0{ _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(offsets, _mm_set1_ps(stepX0))) };
+			__m128 w1{ _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(offsets, _mm_set1_ps(stepX1))) };
+			__m128 w2{ _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(offsets, _mm_set1_ps(stepX2))) };
+			__m128 step0{ _mm_set1_ps(4 * stepX0) };
+			__m128 step1{ _mm_set1_ps(4 * stepX1) };
+			__m128 step2{ _mm_set1_ps(4 * stepX2) };
+			__m128 z0{ _mm_set1_ps(t.z0 * inverseArea) };
+			__m128 z1{ _mm_set1_ps(t.z1 * inverseArea) };
+			__m128 z2{ _mm_set1_ps(t.z2 * inverseArea) };
+			__m128 zero{ _mm_setzero_ps() };
+			for (int32_t x{ startX }; x <= endX; x += 4) {
+				__m128 inside{ _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero))) };
+				if (_mm_movemask_ps(inside) != 0) {
+					__m128 z{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, z0), _mm_mul_ps(w1, z1)), _mm_mul_ps(w2, z2)) };
+					__m128 old{ _mm_loadu_ps(row + x) };
+					__m128 nearer{ _mm_min_ps(old, z) };
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+				w0 = _mm_add_ps(w0, step0);
+				w1 = _mm_add_ps(w1, step1);
+				w2 = _mm_add_ps(w2, step2);
+			}
+#else
+			for (int32_t x{ startX }; x <= endX; ++x) {
+				if (e0 >= 0 && e1 >= 0 && e2 >= 0) {
+					float z{ (e0 * t.z0 + e1 * t.z1 + e2 * t.z2) * inverseArea };
+					row[x] = std::min(row[x], z);
+				}
+				e0 += stepX0;
+				e1 += stepX1;
+				e2 += stepX2;
+			}
+#endif
+		}
+	}
+}
+
+void OcclusionBuffer::buildPyramid() {
+	for (size_t level{ 1 }; level < m_levels.size(); ++level) {
+		const auto& below{ m_levels[level - 1] };
+		uint32_t belowWidth{ m_levelWidths[level - 1] };
+		uint32_t belowHeight{ m_levelHeights[level - 1] };
+		auto& current{ m_levels[level] };
+		for (uint32_t y{ 0 }; y < m_levelHeights[level]; ++y) {
+			uint32_t y0{ 2 * y };
+			uint32_t y1{ std::min(2 * y + 1, belowHeight - 1) };
+			for (uint32_t x{ 0 }; x < m_levelWidths[level]; ++x) {
+				uint32_t x0{ 2 * x };
+				uint32_t x1{ std::min(2 * x + 1, belowWidth - 1) };
+				current[y * m_levelWidths[level] + x] = std::max({
+					below[y0 * belowWidth + x0], below[y0 * belowWidth + x1],
+					below[y1 * belowWidth + x0], below[y1 * belowWidth + x1] });
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::rasterize() {
+	if (!m_hasOccluders) {
+		return;
+	}
+	parallelFor(m_bins.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t tile{ begin }; tile < end; ++tile) {
+			rasterizeTile(static_cast<uint32_t>(tile));
+		}
+	});
+	buildPyramid();
+}
+
+bool OcclusionBuffer::isOccluded(const BoundingBox& box) const {
+	if (!m_hasOccluders || box.isEmpty()) {
+		return false;
+	}
+
+	// Find the box's screen rectangle and nearest depth. A box that reaches the near plane is
+	// treated as visible.
+	glm::vec2 screenMin{ std::numeric_limits<float>::max() };
+	glm::vec2 screenMax{ std::numeric_limits<float>::lowest() };
+	float nearest{ 1 };
+	for (uint32_t corner{ 0 }; corner < 8; ++corner) {
+		glm::vec4 position{
+			(corner & 1) ? box.max.x : box.min.x,
+			(corner & 2) ? box.max.y : box.min.y,
+			(corner & 4) ? box.max.z : box.min.z,
+			1
+		};
+		glm::vec4 clip{ m_viewProjection * position };
+		if (clip.w < NEAR_W) {
+			return false;
+		}
+		glm::vec3 ndc{ glm::vec3{ clip } / clip.w };
+		screenMin = glm::min(screenMin, glm::vec2{ ndc.x, ndc.y });
+		screenMax = glm::max(screenMax, glm::vec2{ ndc.x, ndc.y });
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+	if (screenMax.x < -1 || screenMax.y < -1 || screenMin.x > 1 || screenMin.y > 1) {
+		return false;
+	}
+
+	auto toPixel{ [](float ndc, uint32_t size) {
+		return std::clamp(static_cast<int32_t>((std::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * size), 0,
+			static_cast<int32_t>(size) - 1);
+	} };
+	int32_t minX{ toPixel(screenMin.x, m_width) };
+	int32_t maxX{ toPixel(screenMax.x, m_width) };
+	int32_t minY{ toPixel(screenMin.y, m_height) };
+	int32_t maxY{ toPixel(screenMax.y, m_height) };
+
+	// Choose the level where the rectangle covers at most 3x3 texels.
+	int32_t extent{ std::max(maxX - minX, maxY - minY) + 1 };
+	uint32_t level{ 0 };
+	while ((extent >> level) > 2 && level + 1 < m_levels.size()) {
+		++level;
+	}
+	const auto& depths{ m_levels[level] };
+	uint32_t width{ m_levelWidths[level] };
+	for (int32_t y{ minY >> level }; y <= (maxY >> level); ++y) {
+		for (int32_t x{ minX >> level }; x <= (maxX >> level); ++x) {
+			if (depths[y * width + x] >= nearest) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,83 @@
+#include "Parallel.h"
+
+WorkerPool::WorkerPool(size_t threadCount) {
+	for (size_t i{ 0 }; i < threadCount; ++i) {
+		m_threads.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard lock{ m_mutex };
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	// The jthreads join when m_threads is destroyed.
+}
+
+WorkerPool& WorkerPool::shared() {
+	static WorkerPool pool{ std::max(1u, std::thread::hardware_concurrency()) - 1 };
+	return pool;
+}
+
+void WorkerPool::runChunks(Job& job) {
+	for (size_t chunk{ job.nextChunk++ }; chunk < job.chunks; chunk = job.nextChunk++) {
+		size_t begin{ chunk * job.grain };
+		job.run(job.body, begin, std::min(begin + job.grain, job.count));
+	}
+}
+
+WorkerPool::Job* WorkerPool::findJob() {
+	for (auto* job : m_jobs) {
+		if (job->nextChunk.load() < job->chunks) {
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void WorkerPool::workerLoop() {
+	std::unique_lock lock{ m_mutex };
+	while (true) {
+		Job* job{ nullptr };
+		m_wake.wait(lock, [&]() {
+			job = findJob();
+			return m_stopping || job != nullptr;
+		});
+		if (m_stopping) {
+			return;
+		}
+		// The job cannot leave m_jobs while this worker is counted in it.
+		++job->workers;
+		lock.unlock();
+		runChunks(*job);
+		lock.lock();
+		--job->workers;
+		m_workerLeft.notify_all();
+	}
+}
+
+void WorkerPool::execute(Job& job) {
+	job.chunks = (job.count + job.grain - 1) / job.grain;
+	// A single chunk is not worth waking anyone for.
+	if (m_threads.empty() || job.chunks == 1) {
+		runChunks(job);
+		return;
+	}
+
+	{
+		std::lock_guard lock{ m_mutex };
+		m_jobs.push_back(&job);
+	}
+	m_wake.notify_all();
+	runChunks(job);
+
+	// Every chunk has been taken; wait for the workers still processing theirs.
+	std::unique_lock lock{ m_mutex };
+	m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+	m_workerLeft.wait(lock, [&]() { return job.workers == 0; });
+}
+
+size_t WorkerPool::getThreadCount() const {
+	return m_threads.size();
+}
@@ -0,0 +1,144 @@
+#include "ProgramBinaryCache.h"
+#include <glad/glad.h>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+namespace {
+	constexpr uint32_t BINARY_MAGIC{ 0x42505347 }; // "GSPB"
+	constexpr uint32_t BINARY_VERSION{ 1 };
+
+	// The header at the start of a cache entry, followed by the program binary itself.
+	struct BinaryHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t format;
+		uint32_t size;
+	};
+
+	// 64-bit FNV-1a, continued from "hash".
+	uint64_t fnv1a(std::string_view data, uint64_t hash) {
+		for (char c : data) {
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 0x100000001b3;
+		}
+		return hash;
+	}
+
+	std::string_view glString(uint32_t name) {
+		const GLubyte* value{ glGetString(name) };
+		return value == nullptr ? std::string_view{} : reinterpret_cast<const char*>(value);
+	}
+}
+
+bool ProgramBinaryCache::isSupported() {
+#ifdef GL_VERSION_4_1
+	bool available{ GLAD_GL_VERSION_4_1 != 0 };
+#ifdef GL_ARB_get_program_binary
+	// The extension brings program binaries to older drivers. glad only declares it when it is
+	// generated with extensions, as vcpkg.json asks for.
+	available = available || GLAD_GL_ARB_get_program_binary != 0;
+#endif
+	if (!available) {
+		return false;
+	}
+	int32_t formats{ 0 };
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+#else
+	return false;
+#endif
+}
+
+void ProgramBinaryCache::setDirectory(const std::filesystem::path& directory) {
+	s_directory = directory;
+}
+
+std::filesystem::path ProgramBinaryCache::entryPath(const std::string& key) {
+	return s_directory / (key + ".bin");
+}
+
+std::string ProgramBinaryCache::makeKey(std::initializer_list<std::string_view> sources) {
+	uint64_t hash{ 0xcbf29ce484222325 };
+	// Hash a terminator after each string, so the same text split differently gives a different key.
+	for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		hash = fnv1a(glString(name), hash);
+		hash = fnv1a(std::string_view{ "\0", 1 }, hash);
+	}
+	for (auto source : sources) {
+		hash = fnv1a(source, hash);
+		hash = fnv1a(std::string_view{ "\0", 1 }, hash);
+	}
+	char key[17];
+	std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+	return key;
+}
+
+uint32_t ProgramBinaryCache::load(const std::string& key) {
+#ifdef GL_VERSION_4_1
+	if (!isSupported()) {
+		return 0;
+	}
+	std::ifstream file{ entryPath(key), std::ios::binary };
+	if (!file) {
+		return 0;
+	}
+	BinaryHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != BINARY_MAGIC || header.version != BINARY_VERSION) {
+		return 0;
+	}
+	std::vector<char> binary(header.size);
+	file.read(binary.data(), binary.size());
+	if (!file) {
+		return 0;
+	}
+
+	uint32_t program{ glCreateProgram() };
+	glProgramBinary(program, header.format, binary.data(), static_cast<int32_t>(binary.size()));
+	int32_t success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+#else
+	return 0;
+#endif
+}
+
+void ProgramBinaryCache::prepare(uint32_t program) {
+#ifdef GL_VERSION_4_1
+	if (isSupported()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+#endif
+}
+
+void ProgramBinaryCache::store(uint32_t program, const std::string& key) {
+#ifdef GL_VERSION_4_1
+	if (!isSupported()) {
+		return;
+	}
+	int32_t length{ 0 };
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	uint32_t format;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(s_directory, error);
+	std::ofstream file{ entryPath(key), std::ios::binary };
+	if (error || !file) {
+		return;
+	}
+	BinaryHeader header{ BINARY_MAGIC, BINARY_VERSION, format, static_cast<uint32_t>(length) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), length);
+#endif
+}
@@ -0,0 +1,418 @@
+#include "RenderQueue.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <bit>
+
+namespace {
+	constexpr uint32_t RADIX_BITS{ 8 };
+	constexpr uint32_t RADIX_BUCKETS{ 1 << RADIX_BITS };
+	constexpr uint32_t RADIX_PASSES{ 64 / RADIX_BITS };
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem& item) {
+	uint64_t program{ item.program->getId() & 0xffu };
+	// MaterialLibrary holds at most 256 materials, so a group and an index fit in a byte each.
+	uint64_t bindingGroup{ item.material->bindingGroup & 0xffu };
+	uint64_t material{ item.material->index & 0xffu };
+	uint64_t vertexArray{ item.mesh->getVertexArray() & 0xffffu };
+	// The bits of a non-negative float sort in the same order as its value. The top 24 bits keep
+	// the exponent and 15 bits of mantissa, which is plenty to order draws.
+	uint64_t depth{ std::bit_cast<uint32_t>(std::max(item.viewDepth, 0.0f)) >> 8 };
+	return program << 56 | bindingGroup << 48 | material << 40 | vertexArray << 24 | depth;
+}
+
+void RenderQueue::sortByKey() {
+	m_scratch.resize(m_order.size());
+	for (uint32_t pass{ 0 }; pass < RADIX_PASSES; ++pass) {
+		uint32_t shift{ pass * RADIX_BITS };
+		uint32_t counts[RADIX_BUCKETS]{};
+		for (auto& entry : m_order) {
+			++counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)];
+		}
+		// Skip a pass when every key has the same byte; it would not change the order.
+		if (counts[(m_order[0].key >> shift) & (RADIX_BUCKETS - 1)] == m_order.size()) {
+			continue;
+		}
+		uint32_t offset{ 0 };
+		for (auto& count : counts) {
+			uint32_t bucketSize{ count };
+			count = offset;
+			offset += bucketSize;
+		}
+		for (auto& entry : m_order) {
+			m_scratch[counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+		}
+		m_order.swap(m_scratch);
+	}
+}
+
+void RenderQueue::buildBatches() {
+	m_batches.clear();
+	m_instanceMatrices.clear();
+	uint32_t first{ 0 };
+	while (first < m_order.size()) {
+		const auto& head{ m_items[m_order[first].item] };
+		uint32_t end{ first + 1 };
+		while (end < m_order.size()) {
+			const auto& next{ m_items[m_order[end].item] };
+			if (next.mesh != head.mesh || next.program != head.program || next.material != head.material) {
+				break;
+			}
+			++end;
+		}
+
+		uint32_t count{ end - first };
+		if (count >= MIN_INSTANCES && m_instancedPrograms.contains(head.program->getId())) {
+			m_batches.push_back(Batch{ first, count, static_cast<int32_t>(m_instanceMatrices.size()) });
+			for (uint32_t i{ first }; i < end; ++i) {
+				m_instanceMatrices.push_back(m_items[m_order[i].item].world);
+			}
+		}
+		else {
+			// Not worth instancing; submit each draw on its own.
+			for (uint32_t i{ first }; i < end; ++i) {
+				m_batches.push_back(Batch{ i, 1, -1 });
+			}
+		}
+		first = end;
+	}
+}
+
+void RenderQueue::uploadInstances() {
+	if (m_instanceMatrices.empty()) {
+		return;
+	}
+	if (m_instanceBuffer == 0) {
+		glGenBuffers(1, &m_instanceBuffer);
+	}
+	// The matrices are computed once per instance here, instead of once per vertex in the shader.
+	m_instanceTransforms.resize(m_instanceMatrices.size());
+	computeInstanceTransforms(m_viewProjection, m_instanceMatrices.data(), m_instanceMatrices.size(), m_instanceTransforms.data());
+	size_t size{ m_instanceTransforms.size() * sizeof(InstanceTransform) };
+	m_instanceCapacity = std::max(m_instanceCapacity, size);
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	// Orphan the old storage, so the driver can hand out fresh memory instead of waiting for the
+	// previous frame's draws to finish reading it.
+	glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_instanceTransforms.data());
+}
+
+void RenderQueue::setInstancedProgram(const ShaderProgram& program, ShaderProgram& instancedProgram) {
+	m_instancedPrograms[program.getId()] = &instancedProgram;
+}
+
+void RenderQueue::clearInstancedPrograms() {
+	m_instancedPrograms.clear();
+}
+
+void RenderQueue::setGpuCulling(GpuCulling* culling) {
+	m_gpuCulling = culling;
+}
+
+void RenderQueue::setDepthPrepass(ShaderProgram* depthProgram, ShaderProgram* instancedDepthProgram) {
+	m_depthProgram = depthProgram;
+	m_instancedDepthProgram = instancedDepthProgram;
+}
+
+void RenderQueue::clear(const glm::mat4& view, const glm::mat4& projection) {
+	m_view = view;
+	m_viewProjection = projection * view;
+	m_items.clear();
+	m_order.clear();
+}
+
+void RenderQueue::add(ShaderProgram& program, const Mesh& mesh, const glm::mat4& world) {
+	// Depth is measured to the center of the mesh's bounds; the camera looks down its -z axis.
+	glm::vec4 center{ world * glm::vec4{ mesh.getBoundingSphere().center, 1 } };
+	float viewDepth{ -(m_view * center).z };
+	m_items.push_back(DrawItem{ &program, &mesh, world, &mesh.getMaterial(), viewDepth });
+}
+
+bool RenderQueue::sameState(const DrawItem& a, const DrawItem& b) {
+	// Equal materials are the same object, so the textures need no comparison of their own.
+	return a.program == b.program && a.material == b.material;
+}
+
+void RenderQueue::bindMaterial(ShaderProgram& program, const Material& material, const ShaderProgram*& lastProgram,
+	const Material*& lastMaterial) {
+	// The sampler uniforms belong to the program, so a new program needs them set even for the same
+	// textures. Materials that only differ in their parameters, or in their layers of the same
+	// texture arrays, need no new binds.
+	if (&program != lastProgram || lastMaterial == nullptr || !material.sameBindings(*lastMaterial)) {
+		material.bindTextures(program);
+		lastProgram = &program;
+		lastMaterial = &material;
+	}
+}
+
+const RenderQueue::DrawItem& RenderQueue::sortedItem(uint32_t position) const {
+	return m_items[m_order[position].item];
+}
+
+glm::vec4 RenderQueue::worldSphere(const DrawItem& item) {
+	const auto& sphere{ item.mesh->getBoundingSphere() };
+	glm::vec3 center{ item.world * glm::vec4{ sphere.center, 1 } };
+	// A non-uniform scale stretches the sphere by at most its largest axis scale.
+	float scale{ std::max({ glm::length(glm::vec3{ item.world[0] }), glm::length(glm::vec3{ item.world[1] }),
+		glm::length(glm::vec3{ item.world[2] }) }) };
+	return glm::vec4{ center, sphere.radius * scale };
+}
+
+void RenderQueue::bindInstanceAttributes(uint32_t vertexArray, uint32_t buffer, uint32_t firstInstance) {
+	RenderState::bindVertexArray(vertexArray);
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+	size_t offset{ firstInstance * sizeof(InstanceTransform) };
+	// Every column of the three matrices is one attribute; the normal matrix's columns are vec3s
+	// padded to vec4s.
+	constexpr uint32_t COLUMNS{ sizeof(InstanceTransform) / sizeof(glm::vec4) };
+	for (uint32_t column{ 0 }; column < COLUMNS; ++column) {
+		uint32_t location{ INSTANCE_ATTRIBUTE + column };
+		glVertexAttribPointer(location, column < 8 ? 4 : 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform),
+			reinterpret_cast<void*>(offset + column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+}
+
+void RenderQueue::submit(DrawUniformRing& drawUniforms) {
+	if (m_items.empty()) {
+		return;
+	}
+	m_order.clear();
+	for (uint32_t i{ 0 }; i < m_items.size(); ++i) {
+		m_order.push_back(SortEntry{ makeKey(m_items[i]), i });
+	}
+	sortByKey();
+	MaterialLibrary::bind();
+
+#ifdef GL_VERSION_4_3
+	if (GLAD_GL_VERSION_4_3) {
+		submitMultiDraw(drawUniforms);
+		return;
+	}
+#endif
+	submitBatches(drawUniforms);
+}
+
+void RenderQueue::beginDepthPrepass() {
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+void RenderQueue::beginShadingPass() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	// The prepass left the nearest depth of every pixel, so only the fragment that wrote it passes.
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+}
+
+void RenderQueue::endShadingPass() {
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+bool RenderQueue::inDepthPrepass(const DrawItem& item) const {
+	return m_depthProgram != nullptr && !item.program->isDefined("QUANTIZED_VERTICES")
+		&& !item.program->isDefined("SKINNING");
+}
+
+void RenderQueue::setShadingDepthTest(const DrawItem& item, bool& prepassed) const {
+	if (m_depthProgram == nullptr || inDepthPrepass(item) == prepassed) {
+		return;
+	}
+	prepassed = !prepassed;
+	if (prepassed) {
+		beginShadingPass();
+	}
+	else {
+		endShadingPass();
+	}
+}
+
+void RenderQueue::submitBatches(DrawUniformRing& drawUniforms) {
+	buildBatches();
+	uploadInstances();
+
+	if (m_depthProgram != nullptr) {
+		beginDepthPrepass();
+		drawBatches(drawUniforms, true);
+		beginShadingPass();
+	}
+	drawBatches(drawUniforms, false);
+	if (m_depthProgram != nullptr) {
+		endShadingPass();
+	}
+}
+
+void RenderQueue::drawBatches(DrawUniformRing& drawUniforms, bool depthOnly) {
+	const ShaderProgram* lastProgram{ nullptr };
+	const Material* lastMaterial{ nullptr };
+	// The shading pass starts with the GL_EQUAL test that beginShadingPass set.
+	bool prepassed{ true };
+	for (auto& batch : m_batches) {
+		const auto& item{ sortedItem(batch.first) };
+		if (depthOnly && !inDepthPrepass(item)) {
+			continue;
+		}
+		if (!depthOnly) {
+			setShadingDepthTest(item, prepassed);
+		}
+		if (batch.instanceStart < 0) {
+			ShaderProgram& program{ depthOnly ? *m_depthProgram : *item.program };
+			program.activate();
+			drawUniforms.push(item.world, item.material->index);
+			if (depthOnly) {
+				item.mesh->renderDepth();
+			}
+			else {
+				bindMaterial(program, *item.material, lastProgram, lastMaterial);
+				item.mesh->renderWithoutTextures();
+			}
+			continue;
+		}
+
+		ShaderProgram& program{ depthOnly ? *m_instancedDepthProgram : *m_instancedPrograms[item.program->getId()] };
+		program.activate();
+		// The Draw block still supplies the batch's material.
+		drawUniforms.push(glm::mat4{ 1 }, item.material->index);
+		// GL 3.3 has no base instance, so the attribute offsets move to the batch's matrices instead.
+		if (depthOnly) {
+			bindInstanceAttributes(item.mesh->getPositionVertexArray(), m_instanceBuffer, batch.instanceStart);
+			item.mesh->renderDepth(batch.count);
+		}
+		else {
+			bindInstanceAttributes(item.mesh->getVertexArray(), m_instanceBuffer, batch.instanceStart);
+			bindMaterial(program, *item.material, lastProgram, lastMaterial);
+			item.mesh->renderWithoutTextures(batch.count);
+		}
+	}
+}
+
+void RenderQueue::submitMultiDraw(DrawUniformRing& drawUniforms) {
+#ifdef GL_VERSION_4_3
+	m_commands.clear();
+	m_buckets.clear();
+	m_instanceMatrices.clear();
+	if (m_gpuCulling != nullptr) {
+		m_gpuCulling->clear();
+	}
+	uint32_t position{ 0 };
+	while (position < m_order.size()) {
+		const auto& head{ sortedItem(position) };
+		if (!m_instancedPrograms.contains(head.program->getId())) {
+			m_buckets.push_back(Bucket{ position, 0, 0 });
+			++position;
+			continue;
+		}
+
+		Bucket bucket{ position, static_cast<uint32_t>(m_commands.size()), 0 };
+		while (position < m_order.size() && sameState(head, sortedItem(position))) {
+			// Consecutive draws of one mesh share a command, with one instance each.
+			const Mesh* mesh{ sortedItem(position).mesh };
+			const auto& range{ m_geometry.add(*mesh) };
+			DrawCommand command{ range.indexCount, 0, range.firstIndex, range.baseVertex,
+				static_cast<uint32_t>(m_instanceMatrices.size()) };
+			while (position < m_order.size() && sortedItem(position).mesh == mesh && sameState(head, sortedItem(position))) {
+				m_instanceMatrices.push_back(sortedItem(position).world);
+				if (m_gpuCulling != nullptr) {
+					m_gpuCulling->addInstance(worldSphere(sortedItem(position)), static_cast<uint32_t>(m_commands.size()));
+				}
+				++command.instanceCount;
+				++position;
+			}
+			m_commands.push_back(command);
+		}
+		bucket.commandCount = static_cast<uint32_t>(m_commands.size()) - bucket.commandStart;
+		m_buckets.push_back(bucket);
+	}
+
+	uploadInstances();
+	if (!m_commands.empty()) {
+		if (m_gpuCulling != nullptr) {
+			// The culling shader counts the visible instances into each command.
+			for (auto& command : m_commands) {
+				command.instanceCount = 0;
+			}
+		}
+		if (m_indirectBuffer == 0) {
+			glGenBuffers(1, &m_indirectBuffer);
+		}
+		size_t size{ m_commands.size() * sizeof(DrawCommand) };
+		m_indirectCapacity = std::max(m_indirectCapacity, size);
+		RenderState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_indirectCapacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, m_commands.data());
+		uint32_t transforms{ m_instanceBuffer };
+		if (m_gpuCulling != nullptr) {
+			transforms = m_gpuCulling->cull(m_viewProjection, m_instanceBuffer, m_indirectBuffer);
+		}
+		// Base instances index the transform buffer from its start.
+		bindInstanceAttributes(m_geometry.getVertexArray(), transforms, 0);
+		if (m_depthProgram != nullptr) {
+			bindInstanceAttributes(m_geometry.getPositionVertexArray(), transforms, 0);
+		}
+	}
+
+	// Both passes read the same commands, so the GPU culls them only once.
+	if (m_depthProgram != nullptr) {
+		beginDepthPrepass();
+		drawBuckets(drawUniforms, true);
+		beginShadingPass();
+	}
+	drawBuckets(drawUniforms, false);
+	if (m_depthProgram != nullptr) {
+		endShadingPass();
+	}
+#endif
+}
+
+void RenderQueue::drawBuckets(DrawUniformRing& drawUniforms, bool depthOnly) {
+#ifdef GL_VERSION_4_3
+	const ShaderProgram* lastProgram{ nullptr };
+	const Material* lastMaterial{ nullptr };
+	bool prepassed{ true };
+	for (auto& bucket : m_buckets) {
+		const auto& head{ sortedItem(bucket.first) };
+		// Every draw of a bucket has the same program.
+		if (depthOnly && !inDepthPrepass(head)) {
+			continue;
+		}
+		if (!depthOnly) {
+			setShadingDepthTest(head, prepassed);
+		}
+		if (bucket.commandCount == 0) {
+			ShaderProgram& program{ depthOnly ? *m_depthProgram : *head.program };
+			program.activate();
+			drawUniforms.push(head.world, head.material->index);
+			if (depthOnly) {
+				head.mesh->renderDepth();
+			}
+			else {
+				bindMaterial(program, *head.material, lastProgram, lastMaterial);
+				head.mesh->renderWithoutTextures();
+			}
+			continue;
+		}
+
+		ShaderProgram& program{ depthOnly ? *m_instancedDepthProgram : *m_instancedPrograms[head.program->getId()] };
+		program.activate();
+		drawUniforms.push(glm::mat4{ 1 }, head.material->index);
+		if (depthOnly) {
+			RenderState::bindVertexArray(m_geometry.getPositionVertexArray());
+		}
+		else {
+			bindMaterial(program, *head.material, lastProgram, lastMaterial);
+			RenderState::bindVertexArray(m_geometry.getVertexArray());
+		}
+		RenderState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			reinterpret_cast<void*>(bucket.commandStart * sizeof(DrawCommand)), bucket.commandCount, 0);
+	}
+#endif
+}
+
+size_t RenderQueue::size() const {
+	return m_items.size();
+}
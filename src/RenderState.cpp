@@ -0,0 +1,160 @@
+#include "RenderState.h"
+#include <glad/glad.h>
+
+namespace {
+	int32_t textureTargetIndex(uint32_t target) {
+		switch (target) {
+		case GL_TEXTURE_2D:
+			return 0;
+		case GL_TEXTURE_2D_ARRAY:
+			return 1;
+		case GL_TEXTURE_CUBE_MAP:
+			return 2;
+		case GL_TEXTURE_BUFFER:
+			return 3;
+		case GL_TEXTURE_3D:
+			return 4;
+		default:
+			return -1;
+		}
+	}
+
+	int32_t bufferTargetIndex(uint32_t target) {
+		switch (target) {
+		case GL_ARRAY_BUFFER:
+			return 0;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return 1;
+		case GL_UNIFORM_BUFFER:
+			return 2;
+		case GL_COPY_READ_BUFFER:
+			return 3;
+		case GL_COPY_WRITE_BUFFER:
+			return 4;
+		case GL_TEXTURE_BUFFER:
+			return 5;
+#ifdef GL_VERSION_4_3
+		case GL_DRAW_INDIRECT_BUFFER:
+			return 6;
+		case GL_SHADER_STORAGE_BUFFER:
+			return 7;
+		case GL_DISPATCH_INDIRECT_BUFFER:
+			return 8;
+#endif
+		default:
+			return -1;
+		}
+	}
+}
+
+bool RenderState::changes(uint32_t& cached, uint32_t value) {
+	if (cached == value) {
+		++s_counters.skipped;
+		return false;
+	}
+	cached = value;
+	++s_counters.issued;
+	return true;
+}
+
+void RenderState::useProgram(uint32_t program) {
+	if (changes(s_program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void RenderState::bindVertexArray(uint32_t vertexArray) {
+	if (changes(s_vertexArray, vertexArray)) {
+		glBindVertexArray(vertexArray);
+		s_buffers[bufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+}
+
+void RenderState::bindTexture(uint32_t unit, uint32_t target, uint32_t texture) {
+	int32_t targetIndex{ textureTargetIndex(target) };
+	if (unit >= TEXTURE_UNITS || targetIndex < 0) {
+		s_activeUnit = UNKNOWN;
+		++s_counters.issued;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		return;
+	}
+	if (changes(s_textures[unit][targetIndex], texture)) {
+		if (s_activeUnit != unit) {
+			s_activeUnit = unit;
+			++s_counters.issued;
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+		glBindTexture(target, texture);
+	}
+}
+
+void RenderState::bindBuffer(uint32_t target, uint32_t buffer) {
+	int32_t targetIndex{ bufferTargetIndex(target) };
+	if (targetIndex < 0) {
+		++s_counters.issued;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (changes(s_buffers[targetIndex], buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void RenderState::bindBufferBase(uint32_t target, uint32_t index, uint32_t buffer) {
+	++s_counters.issued;
+	glBindBufferBase(target, index, buffer);
+	int32_t targetIndex{ bufferTargetIndex(target) };
+	if (targetIndex >= 0) {
+		s_buffers[targetIndex] = buffer;
+	}
+}
+
+void RenderState::bindBufferRange(uint32_t target, uint32_t index, uint32_t buffer, ptrdiff_t offset, ptrdiff_t size) {
+	++s_counters.issued;
+	glBindBufferRange(target, index, buffer, offset, size);
+	int32_t targetIndex{ bufferTargetIndex(target) };
+	if (targetIndex >= 0) {
+		s_buffers[targetIndex] = buffer;
+	}
+}
+
+void RenderState::deleteBuffer(uint32_t buffer) {
+	glDeleteBuffers(1, &buffer);
+	for (auto& bound : s_buffers) {
+		if (bound == buffer) {
+			bound = 0;
+		}
+	}
+}
+
+void RenderState::deleteTexture(uint32_t texture) {
+	glDeleteTextures(1, &texture);
+	for (auto& unit : s_textures) {
+		for (auto& bound : unit) {
+			if (bound == texture) {
+				bound = 0;
+			}
+		}
+	}
+}
+
+void RenderState::invalidate() {
+	s_program = UNKNOWN;
+	s_vertexArray = UNKNOWN;
+	s_activeUnit = UNKNOWN;
+	for (auto& unit : s_textures) {
+		for (auto& texture : unit) {
+			texture = UNKNOWN;
+		}
+	}
+	for (auto& buffer : s_buffers) {
+		buffer = UNKNOWN;
+	}
+}
+
+RenderStateCounters RenderState::takeCounters() {
+	RenderStateCounters counters{ s_counters };
+	s_counters = RenderStateCounters{};
+	return counters;
+}
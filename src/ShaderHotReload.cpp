@@ -0,0 +1,136 @@
+#include "ShaderHotReload.h"
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#define SHADER_RELOAD_USE_INOTIFY 1
+#endif
+
+ShaderHotReload::ShaderHotReload(const std::filesystem::path& sourceDirectory,
+	const std::filesystem::path& buildDirectory)
+	: m_sourceDirectory{ sourceDirectory }, m_buildDirectory{ buildDirectory } {
+#ifdef SHADER_RELOAD_USE_INOTIFY
+	m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	// Editors either rewrite a file in place or write a new one and rename it over the old.
+	if (m_inotify >= 0 && inotify_add_watch(m_inotify, sourceDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		close(m_inotify);
+		m_inotify = -1;
+	}
+#endif
+	if (m_inotify < 0) {
+		// Record the current times, so the first scan only reports real changes.
+		scanWriteTimes();
+	}
+}
+
+ShaderHotReload::~ShaderHotReload() {
+#ifdef SHADER_RELOAD_USE_INOTIFY
+	if (m_inotify >= 0) {
+		close(m_inotify);
+	}
+#endif
+}
+
+void ShaderHotReload::watch(ShaderProgram& program) {
+	m_programs.push_back(&program);
+}
+
+std::vector<std::filesystem::path> ShaderHotReload::scanWriteTimes() {
+	std::vector<std::filesystem::path> changed{};
+	std::error_code error;
+	for (auto& entry : std::filesystem::directory_iterator{ m_sourceDirectory, error }) {
+		auto time{ entry.last_write_time(error) };
+		if (error) {
+			continue;
+		}
+		auto [found, inserted] { m_writeTimes.try_emplace(entry.path().string(), time) };
+		if (!inserted && found->second != time) {
+			found->second = time;
+			changed.push_back(entry.path());
+		}
+	}
+	return changed;
+}
+
+std::vector<std::filesystem::path> ShaderHotReload::changedFiles() {
+	std::vector<std::filesystem::path> changed{};
+#ifdef SHADER_RELOAD_USE_INOTIFY
+	if (m_inotify >= 0) {
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+			for (ssize_t offset{ 0 }; offset < length;) {
+				auto* event{ reinterpret_cast<const inotify_event*>(buffer + offset) };
+				if (event->len > 0) {
+					changed.push_back(m_sourceDirectory / event->name);
+				}
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+		return changed;
+	}
+#endif
+	auto now{ std::chrono::steady_clock::now() };
+	if (now >= m_nextScan) {
+		m_nextScan = now + SCAN_INTERVAL;
+		changed = scanWriteTimes();
+	}
+	return changed;
+}
+
+std::vector<std::filesystem::path> ShaderHotReload::copyToBuild(const std::vector<std::filesystem::path>& changed) const {
+	std::vector<std::filesystem::path> copies{};
+	for (auto& file : changed) {
+		// Editors' swap and backup files have no copy, and are not followed.
+		std::filesystem::path copy{ m_buildDirectory / file.filename() };
+		std::error_code error;
+		if (!std::filesystem::is_regular_file(copy, error)) {
+			continue;
+		}
+		std::filesystem::copy_file(file, copy, std::filesystem::copy_options::overwrite_existing, error);
+		if (error) {
+			std::cout << "ERROR: could not copy " << file << " to " << copy << ": " << error.message() << std::endl;
+			continue;
+		}
+		copies.push_back(copy);
+	}
+	return copies;
+}
+
+bool ShaderHotReload::update() {
+	auto changed{ copyToBuild(changedFiles()) };
+	if (!changed.empty()) {
+		for (auto* program : m_programs) {
+			// A save can report the same file more than once; rebuild each program once.
+			bool affected{ false };
+			for (auto& file : changed) {
+				affected = affected || program->usesFile(file);
+			}
+			if (!affected) {
+				continue;
+			}
+			try {
+				program->startReload();
+			}
+			catch (std::runtime_error& e) {
+				std::cout << "ERROR: shader reload failed: " << e.what() << std::endl;
+			}
+		}
+	}
+
+	bool swapped{ false };
+	for (auto* program : m_programs) {
+		try {
+			if (program->finishReload()) {
+				swapped = true;
+			}
+		}
+		catch (std::runtime_error& e) {
+			std::cout << "ERROR: shader reload failed, keeping the old program: " << e.what() << std::endl;
+		}
+	}
+	return swapped;
+}
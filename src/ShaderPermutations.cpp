@@ -0,0 +1,97 @@
+#include "ShaderPermutations.h"
+#include <glad/glad.h>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+	// The #define of each feature bit, in bit order.
+	const char* const FEATURE_DEFINES[ShaderFeatures::COUNT]{
+		"LIGHTING", "NORMAL_MAP", "INSTANCING", "QUANTIZED_VERTICES", "SKINNING", "CLUSTERED_LIGHTS", "SHADOWS",
+		"LIGHTMAP"
+	};
+
+	// Lets the driver use as many background compile threads as it likes, if it can. The extension
+	// blocks need a glad generated with extensions; without one, or without driver support, this does
+	// nothing and the driver compiles each variant when it is checked, one after another.
+	void enableParallelCompile() {
+#ifdef GL_KHR_parallel_shader_compile
+		if (GLAD_GL_KHR_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsKHR(0xffffffff);
+			return;
+		}
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+		if (GLAD_GL_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xffffffff);
+		}
+#endif
+	}
+}
+
+ShaderPermutations::ShaderPermutations(std::string vertexShaderPath, std::string fragmentShaderPath,
+	std::string fragmentPreludePath)
+	: m_vertexShaderPath{ std::move(vertexShaderPath) }, m_fragmentShaderPath{ std::move(fragmentShaderPath) },
+	m_fragmentPreludePath{ std::move(fragmentPreludePath) } {
+}
+
+std::vector<std::string> ShaderPermutations::definesFor(uint32_t features) {
+	if ((features & ShaderFeatures::INSTANCING) && (features & ShaderFeatures::SKINNING)) {
+		// Bone attributes use the same locations as the instance matrices.
+		throw std::runtime_error("A shader variant cannot have both INSTANCING and SKINNING");
+	}
+	if ((features & ShaderFeatures::CLUSTERED_LIGHTS) && !(features & ShaderFeatures::LIGHTING)) {
+		throw std::runtime_error("A shader variant with CLUSTERED_LIGHTS needs LIGHTING");
+	}
+	if ((features & ShaderFeatures::SHADOWS) && !(features & ShaderFeatures::LIGHTING)) {
+		throw std::runtime_error("A shader variant with SHADOWS needs LIGHTING");
+	}
+	if ((features & ShaderFeatures::LIGHTMAP) && !(features & ShaderFeatures::LIGHTING)) {
+		throw std::runtime_error("A shader variant with LIGHTMAP needs LIGHTING");
+	}
+	if (features >> ShaderFeatures::COUNT) {
+		throw std::runtime_error("Unknown shader feature bits");
+	}
+	std::vector<std::string> defines{};
+	for (uint32_t bit{ 0 }; bit < ShaderFeatures::COUNT; ++bit) {
+		if (features & (1u << bit)) {
+			defines.push_back(FEATURE_DEFINES[bit]);
+		}
+	}
+	return defines;
+}
+
+void ShaderPermutations::compile(const std::vector<uint32_t>& variants) {
+	enableParallelCompile();
+	// Start everything first, so that no variant waits on the driver while others could be compiling.
+	std::vector<uint32_t> started{};
+	for (auto features : variants) {
+		if (m_variants.contains(features)) {
+			continue;
+		}
+		ShaderProgram program{};
+		program.startLoad(m_vertexShaderPath, m_fragmentShaderPath, definesFor(features), m_fragmentPreludePath);
+		m_variants.emplace(features, std::move(program));
+		started.push_back(features);
+	}
+	for (size_t i{ 0 }; i < started.size(); ++i) {
+		try {
+			m_variants[started[i]].finishLoad();
+		}
+		catch (std::runtime_error&) {
+			// Drop the failed variant and the ones not yet checked, so get() never returns them.
+			for (size_t j{ i }; j < started.size(); ++j) {
+				m_variants.erase(started[j]);
+			}
+			throw;
+		}
+	}
+}
+
+ShaderProgram& ShaderPermutations::get(uint32_t features) {
+	auto found{ m_variants.find(features) };
+	if (found == m_variants.end()) {
+		compile({ features });
+		found = m_variants.find(features);
+	}
+	return found->second;
+}
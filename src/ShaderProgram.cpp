@@ -1,123 +1,478 @@
 #include "ShaderProgram.h"
+#include "UniformBuffers.h"
+#include "RenderState.h"
+#include "ProgramBinaryCache.h"
 #include <glad/glad.h>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
 
 ShaderProgram::ShaderProgram()
 	: m_programId(-1) {
 }
 
-void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath) {
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	// ensure ifstream objects can throw exceptions:
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try
-	{
-		// open files
-		vShaderFile.open(vertexShaderPath);
-		fShaderFile.open(fragmentShaderPath);
-		std::stringstream vShaderStream, fShaderStream;
-		// read file's buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		// close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	}
-	catch (std::ifstream::failure&) {
-		throw std::runtime_error("Failed to locate vertex or fragment shader files");
-	}
-
-	const char* vShaderCode{ vertexCode.c_str() };
-	const char* fShaderCode{ fragmentCode.c_str() };
-
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
-
-	// vertex Shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	// print compile errors if any
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		throw std::runtime_error(infoLog);
-	};
-
-	// similiar for Fragment Shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	// print compile errors if any
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		throw std::runtime_error(infoLog);
-	};
-
-	// shader Program
-	m_programId = glCreateProgram();
-	glAttachShader(m_programId, vertex);
-	glAttachShader(m_programId, fragment);
-	glLinkProgram(m_programId);
-	// print linking errors if any
-	glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
-		throw std::runtime_error(infoLog);
+namespace {
+	std::string readShaderFile(const std::string& path) {
+		std::ifstream file;
+		// ensure ifstream objects can throw exceptions:
+		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try {
+			file.open(path);
+			std::stringstream stream;
+			stream << file.rdbuf();
+			return stream.str();
+		}
+		catch (std::ifstream::failure&) {
+			throw std::runtime_error("Failed to locate shader file " + path);
+		}
 	}
 
+	// Inserts a #define for each name right after the #version line, which must stay first, followed
+	// by the prelude's code.
+	std::string injectDefines(const std::string& code, const std::vector<std::string>& defines,
+		const std::string& prelude) {
+		if (defines.empty() && prelude.empty()) {
+			return code;
+		}
+		std::string block{};
+		for (auto& define : defines) {
+			block += "#define " + define + " 1\n";
+		}
+		if (!prelude.empty()) {
+			block += prelude.back() == '\n' ? prelude : prelude + "\n";
+		}
+		size_t version{ code.find("#version") };
+		if (version == std::string::npos) {
+			return block + code;
+		}
+		size_t lineEnd{ code.find('\n', version) };
+		if (lineEnd == std::string::npos) {
+			return code + "\n" + block;
+		}
+		return code.substr(0, lineEnd + 1) + block + code.substr(lineEnd + 1);
+	}
+
+	// Starts compiling a shader without waiting for the result; see checkCompile.
+	uint32_t startCompile(uint32_t type, const std::string& code) {
+		const char* source{ code.c_str() };
+		uint32_t shader{ glCreateShader(type) };
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		return shader;
+	}
+
+	// Throws the info log of a shader that failed to compile. Asking for the status waits for the
+	// compile to finish.
+	void checkCompile(uint32_t shader) {
+		int success;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success) {
+			char infoLog[512];
+			glGetShaderInfoLog(shader, 512, NULL, infoLog);
+			throw std::runtime_error(infoLog);
+		}
+	}
+
+	// Starts linking a program without waiting for the result; see checkLink.
+	uint32_t startLink(const std::vector<uint32_t>& shaders) {
+		uint32_t program{ glCreateProgram() };
+		for (auto shader : shaders) {
+			glAttachShader(program, shader);
+		}
+		ProgramBinaryCache::prepare(program);
+		glLinkProgram(program);
+		return program;
+	}
+
+	void checkLink(uint32_t program) {
+		int success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			char infoLog[512];
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
+			throw std::runtime_error(infoLog);
+		}
+	}
+}
+
+ShaderProgram::PendingBuild ShaderProgram::startBuild(const std::vector<ShaderSource>& sources,
+	const std::vector<std::string>& defines) {
+	std::vector<std::string> codes{};
+	for (auto& source : sources) {
+		std::string prelude{ source.preludePath.empty() ? std::string{} : readShaderFile(source.preludePath) };
+		codes.push_back(injectDefines(readShaderFile(source.path), defines, prelude));
+	}
+	PendingBuild build{};
+	// Reuse the program linked by an earlier launch, if the sources and driver are unchanged.
+	build.cacheKey = codes.size() == 1 ? ProgramBinaryCache::makeKey({ codes[0] })
+		: ProgramBinaryCache::makeKey({ codes[0], codes[1] });
+	build.program = ProgramBinaryCache::load(build.cacheKey);
+	if (build.program == 0) {
+		for (size_t i{ 0 }; i < sources.size(); ++i) {
+			build.shaders.push_back(startCompile(sources[i].type, codes[i]));
+		}
+		build.program = startLink(build.shaders);
+	}
+	return build;
+}
+
+bool ShaderProgram::isBuildComplete(const PendingBuild& build) {
+	if (build.shaders.empty()) {
+		return true;
+	}
+	int32_t complete{ GL_TRUE };
+#ifdef GL_KHR_parallel_shader_compile
+	if (GLAD_GL_KHR_parallel_shader_compile) {
+		glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+	}
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+	if (GLAD_GL_ARB_parallel_shader_compile) {
+		glGetProgramiv(build.program, GL_COMPLETION_STATUS_ARB, &complete);
+	}
+#endif
+	// Without parallel compile there is no way to ask without waiting, so the build counts as done.
+	return complete == GL_TRUE;
+}
+
+void ShaderProgram::finishBuild(PendingBuild& build) {
+	if (build.shaders.empty()) {
+		return;
+	}
+	try {
+		for (auto shader : build.shaders) {
+			checkCompile(shader);
+		}
+		checkLink(build.program);
+	}
+	catch (std::runtime_error&) {
+		discardBuild(build);
+		throw;
+	}
 	// delete the shaders as they're linked into our program now and no longer necessary
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	for (auto shader : build.shaders) {
+		glDeleteShader(shader);
+	}
+	build.shaders.clear();
+	ProgramBinaryCache::store(build.program, build.cacheKey);
+}
+
+void ShaderProgram::discardBuild(PendingBuild& build) {
+	for (auto shader : build.shaders) {
+		glDeleteShader(shader);
+	}
+	if (build.program != 0) {
+		glDeleteProgram(build.program);
+	}
+	build = PendingBuild{};
+}
+
+void ShaderProgram::prepareLinked() {
+	reflectUniforms();
+	// Connect the shared uniform blocks to their buffers' binding points.
+	bindUniformBlock("Frame", FRAME_UNIFORM_BINDING);
+	bindUniformBlock("Draw", DRAW_UNIFORM_BINDING);
+	bindUniformBlock("Materials", MATERIAL_UNIFORM_BINDING);
+}
+
+void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+	const std::vector<std::string>& defines, const std::string& fragmentPreludePath) {
+	startLoad(vertexShaderPath, fragmentShaderPath, defines, fragmentPreludePath);
+	finishLoad();
+}
+
+void ShaderProgram::startLoad(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+	const std::vector<std::string>& defines, const std::string& fragmentPreludePath) {
+	m_sources = { ShaderSource{ GL_VERTEX_SHADER, vertexShaderPath },
+		ShaderSource{ GL_FRAGMENT_SHADER, fragmentShaderPath, fragmentPreludePath } };
+	m_defines = defines;
+	m_pending = startBuild(m_sources, m_defines);
+	m_programId = m_pending.program;
+}
+
+void ShaderProgram::finishLoad() {
+	try {
+		finishBuild(m_pending);
+	}
+	catch (std::runtime_error&) {
+		m_programId = -1;
+		throw;
+	}
+	m_pending = PendingBuild{};
+	prepareLinked();
+}
+
+void ShaderProgram::loadCompute(const std::string& computeShaderPath) {
+#ifdef GL_VERSION_4_3
+	if (!GLAD_GL_VERSION_4_3) {
+		throw std::runtime_error("Compute shaders need an OpenGL 4.3 context");
+	}
+	m_sources = { ShaderSource{ GL_COMPUTE_SHADER, computeShaderPath } };
+	m_defines.clear();
+	m_pending = startBuild(m_sources, m_defines);
+	m_programId = m_pending.program;
+	finishLoad();
+#else
+	throw std::runtime_error("Compute shaders need an OpenGL 4.3 context");
+#endif
+}
+
+bool ShaderProgram::usesFile(const std::filesystem::path& path) const {
+	auto normal{ path.lexically_normal() };
+	for (auto& source : m_sources) {
+		if (std::filesystem::path{ source.path }.lexically_normal() == normal
+			|| (!source.preludePath.empty() && std::filesystem::path{ source.preludePath }.lexically_normal() == normal)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ShaderProgram::isDefined(std::string_view name) const {
+	return std::find(m_defines.begin(), m_defines.end(), name) != m_defines.end();
+}
+
+void ShaderProgram::startReload() {
+	// A reload that is still compiling is out of date.
+	discardBuild(m_reload);
+	m_reload = startBuild(m_sources, m_defines);
+}
+
+bool ShaderProgram::finishReload() {
+	if (m_reload.program == 0 || !isBuildComplete(m_reload)) {
+		return false;
+	}
+	finishBuild(m_reload);
+	glDeleteProgram(m_programId);
+	m_programId = m_reload.program;
+	m_reload = PendingBuild{};
+	// The old program's ID may be handed out again, which the cache would mistake for the old program.
+	RenderState::invalidate();
+	prepareLinked();
+	return true;
+}
+
+uint32_t ShaderProgram::getId() const {
+	return m_programId;
+}
+
+void ShaderProgram::bindUniformBlock(const std::string& blockName, uint32_t binding) {
+	uint32_t index{ glGetUniformBlockIndex(m_programId, blockName.c_str()) };
+	if (index != GL_INVALID_INDEX) {
+		glUniformBlockBinding(m_programId, index, binding);
+	}
+}
+
+void ShaderProgram::reflectUniforms() {
+	m_uniforms.clear();
+	int32_t count, maxNameLength;
+	glGetProgramiv(m_programId, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	std::string name(std::max(maxNameLength, 1), '\0');
+	for (int32_t i{ 0 }; i < count; ++i) {
+		int32_t length, size;
+		uint32_t type;
+		glGetActiveUniform(m_programId, i, static_cast<int32_t>(name.size()), &length, &size, &type, name.data());
+		std::string uniformName{ name.data(), static_cast<size_t>(length) };
+		int32_t location{ glGetUniformLocation(m_programId, uniformName.c_str()) };
+		// Uniforms inside uniform blocks have no location.
+		if (location < 0) {
+			continue;
+		}
+		UniformInfo info{ location, type, size };
+		// Arrays are reported as "name[0]", but are usually set through their plain name.
+		if (uniformName.ends_with("[0]")) {
+			m_uniforms.emplace(uniformName.substr(0, uniformName.size() - 3), info);
+		}
+		m_uniforms.emplace(std::move(uniformName), info);
+	}
+}
+
+int32_t ShaderProgram::findUniform(std::string_view uniformName) const {
+	++s_uniformLookups;
+	auto found{ m_uniforms.find(uniformName) };
+	return found == m_uniforms.end() ? -1 : found->second.location;
 }
 
 void ShaderProgram::activate() {
-	glUseProgram(m_programId);
+	RenderState::useProgram(m_programId);
+}
+
+namespace {
+	// Whether a GLSL uniform of the given type can be set with a value of type T.
+	template <typename T>
+	bool acceptsType(uint32_t glType);
+
+	template <>
+	bool acceptsType<bool>(uint32_t glType) {
+		return glType == GL_BOOL;
+	}
+
+	template <>
+	bool acceptsType<int32_t>(uint32_t glType) {
+		switch (glType) {
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_2D_ARRAY:
+		case GL_SAMPLER_2D_SHADOW:
+		case GL_SAMPLER_2D_ARRAY_SHADOW:
+		case GL_SAMPLER_3D:
+		case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_BUFFER:
+		case GL_INT_SAMPLER_BUFFER:
+		case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	template <>
+	bool acceptsType<float>(uint32_t glType) {
+		return glType == GL_FLOAT;
+	}
+
+	template <>
+	bool acceptsType<glm::vec2>(uint32_t glType) {
+		return glType == GL_FLOAT_VEC2;
+	}
+
+	template <>
+	bool acceptsType<glm::vec3>(uint32_t glType) {
+		return glType == GL_FLOAT_VEC3;
+	}
+
+	template <>
+	bool acceptsType<glm::vec4>(uint32_t glType) {
+		return glType == GL_FLOAT_VEC4;
+	}
+
+	template <>
+	bool acceptsType<glm::mat2>(uint32_t glType) {
+		return glType == GL_FLOAT_MAT2;
+	}
+
+	template <>
+	bool acceptsType<glm::mat3>(uint32_t glType) {
+		return glType == GL_FLOAT_MAT3;
+	}
+
+	template <>
+	bool acceptsType<glm::mat4>(uint32_t glType) {
+		return glType == GL_FLOAT_MAT4;
+	}
 }
 
+template <typename T>
+UniformHandle<T> ShaderProgram::getUniform(const std::string& uniformName) const {
+	++s_uniformLookups;
+	auto found{ m_uniforms.find(uniformName) };
+	if (found == m_uniforms.end()) {
+		return UniformHandle<T>{};
+	}
+	if (!acceptsType<T>(found->second.type)) {
+		throw std::runtime_error("Uniform " + uniformName + " does not have the requested type");
+	}
+	return UniformHandle<T>{ found->second.location };
+}
+
+template UniformHandle<bool> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<int32_t> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<float> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::vec2> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::vec3> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::vec4> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::mat2> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::mat3> ShaderProgram::getUniform(const std::string&) const;
+template UniformHandle<glm::mat4> ShaderProgram::getUniform(const std::string&) const;
+
 void ShaderProgram::setUniform(const std::string& uniformName, bool value) {
-	glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), (int32_t)value);
+	setUniform(UniformHandle<bool>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, int32_t value) {
-	glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), value);
+	setUniform(UniformHandle<int32_t>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, float value) {
-	glUniform1f(glGetUniformLocation(m_programId, uniformName.c_str()), value);
+	setUniform(UniformHandle<float>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec2& value) {
-	glUniform2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+	setUniform(UniformHandle<glm::vec2>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec3& value) {
-	glUniform3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+	setUniform(UniformHandle<glm::vec3>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec4& value) {
-	glUniform4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+	setUniform(UniformHandle<glm::vec4>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat2& value) {
-	glUniformMatrix2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+	setUniform(UniformHandle<glm::mat2>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat3& value) {
-	glUniformMatrix3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+	setUniform(UniformHandle<glm::mat3>{ findUniform(uniformName) }, value);
 }
 
 void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4& value) {
-	glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+	setUniform(UniformHandle<glm::mat4>{ findUniform(uniformName) }, value);
+}
+
+void ShaderProgram::setUniform(UniformHandle<bool> uniform, bool value) {
+	glUniform1i(uniform.location, (int32_t)value);
+}
+
+void ShaderProgram::setUniform(UniformHandle<int32_t> uniform, int32_t value) {
+	glUniform1i(uniform.location, value);
+}
+
+void ShaderProgram::setUniform(UniformHandle<float> uniform, float value) {
+	glUniform1f(uniform.location, value);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::vec2> uniform, const glm::vec2& value) {
+	glUniform2fv(uniform.location, 1, &value[0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::vec3> uniform, const glm::vec3& value) {
+	glUniform3fv(uniform.location, 1, &value[0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::vec4> uniform, const glm::vec4& value) {
+	glUniform4fv(uniform.location, 1, &value[0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::vec4> uniform, const glm::vec4* values, int32_t count) {
+	glUniform4fv(uniform.location, count, &values[0][0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::mat2> uniform, const glm::mat2& value) {
+	glUniformMatrix2fv(uniform.location, 1, false, &value[0][0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::mat3> uniform, const glm::mat3& value) {
+	glUniformMatrix3fv(uniform.location, 1, false, &value[0][0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::mat4> uniform, const glm::mat4& value) {
+	glUniformMatrix4fv(uniform.location, 1, false, &value[0][0]);
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::mat4> uniform, const glm::mat4* values, int32_t count) {
+	glUniformMatrix4fv(uniform.location, count, false, &values[0][0][0]);
+}
+
+uint32_t ShaderProgram::takeUniformLookupCount() {
+	uint32_t count{ s_uniformLookups };
+	s_uniformLookups = 0;
+	return count;
 }
@@ -0,0 +1,155 @@
+#include "TextureArrays.h"
+#include "RenderState.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace {
+	// The texels copied around each atlas tile. Filtering reads one texel past the tile, and each mip
+	// level halves the margin, so the first few levels stay clear of the neighbors.
+	constexpr uint32_t ATLAS_PADDING{ 8 };
+
+	struct Image {
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> pixels;
+	};
+
+	// One layer of an array: an image, and the indices of the textures that are in it.
+	struct Layer {
+		const Image* image;
+		std::vector<size_t> textures;
+	};
+
+	Image readBack(uint32_t texture) {
+		RenderState::bindTexture(0, GL_TEXTURE_2D, texture);
+		GLint width, height;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		Image image{ static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+			std::vector<uint8_t>(static_cast<size_t>(width) * height * 4) };
+		// Rows of 4-byte texels are always aligned, so the default pack alignment is fine.
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+		return image;
+	}
+
+	// Copies a tile into a page with its top left at (x, y), surrounded by ATLAS_PADDING texels taken
+	// from its opposite edges, as a repeating texture would be.
+	void copyTile(const Image& tile, Image& page, uint32_t x, uint32_t y) {
+		int32_t padding{ static_cast<int32_t>(ATLAS_PADDING) };
+		int32_t width{ static_cast<int32_t>(tile.width) };
+		int32_t height{ static_cast<int32_t>(tile.height) };
+		for (int32_t row{ -padding }; row < height + padding; ++row) {
+			int32_t sourceRow{ (row % height + height) % height };
+			for (int32_t column{ -padding }; column < width + padding; ++column) {
+				int32_t sourceColumn{ (column % width + width) % width };
+				const uint8_t* source{ &tile.pixels[(static_cast<size_t>(sourceRow) * tile.width + sourceColumn) * 4] };
+				size_t destination{ ((static_cast<size_t>(y) + row) * page.width + x + column) * 4 };
+				std::copy(source, source + 4, page.pixels.begin() + destination);
+			}
+		}
+	}
+
+	uint32_t createArray(uint32_t width, uint32_t height, const std::vector<const Layer*>& layers) {
+		uint32_t texture;
+		glGenTextures(1, &texture);
+		RenderState::bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, static_cast<GLsizei>(layers.size()), 0,
+			GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		for (uint32_t i{ 0 }; i < layers.size(); ++i) {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+				layers[i]->image->pixels.data());
+		}
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		return texture;
+	}
+}
+
+std::vector<Texture> packTextureArrays(const std::vector<Texture>& textures) {
+	std::vector<Texture> packed{ textures };
+	std::vector<Image> images{};
+	images.reserve(textures.size());
+	for (auto& t : textures) {
+		images.push_back(readBack(t.textureId));
+	}
+
+	// Atlas the small textures, tallest first, in rows across pages of ATLAS_SIZE. A lone small
+	// texture gains nothing from an atlas, and keeps a layer of its own size.
+	std::vector<size_t> small{};
+	for (size_t i{ 0 }; i < images.size(); ++i) {
+		if (images[i].width <= ATLAS_TILE_LIMIT && images[i].height <= ATLAS_TILE_LIMIT) {
+			small.push_back(i);
+		}
+	}
+	if (small.size() < 2) {
+		small.clear();
+	}
+	std::sort(small.begin(), small.end(), [&](size_t a, size_t b) { return images[a].height > images[b].height; });
+
+	std::vector<Image> pages{};
+	std::vector<std::vector<size_t>> pageTiles{};
+	uint32_t x{ ATLAS_SIZE };
+	uint32_t y{ 0 };
+	uint32_t rowHeight{ 0 };
+	for (size_t i : small) {
+		uint32_t width{ images[i].width + 2 * ATLAS_PADDING };
+		uint32_t height{ images[i].height + 2 * ATLAS_PADDING };
+		if (x + width > ATLAS_SIZE) {
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+		if (pages.empty() || y + height > ATLAS_SIZE) {
+			pages.push_back(Image{ ATLAS_SIZE, ATLAS_SIZE, std::vector<uint8_t>(static_cast<size_t>(ATLAS_SIZE) * ATLAS_SIZE * 4) });
+			pageTiles.emplace_back();
+			x = 0;
+			y = 0;
+			rowHeight = 0;
+		}
+		copyTile(images[i], pages.back(), x + ATLAS_PADDING, y + ATLAS_PADDING);
+		pageTiles.back().push_back(i);
+		packed[i].rect = glm::vec4{ static_cast<float>(images[i].width) / ATLAS_SIZE, static_cast<float>(images[i].height) / ATLAS_SIZE,
+			static_cast<float>(x + ATLAS_PADDING) / ATLAS_SIZE, static_cast<float>(y + ATLAS_PADDING) / ATLAS_SIZE };
+		x += width;
+		rowHeight = std::max(rowHeight, height);
+	}
+
+	// Group the layers by size: every texture that was not atlased, then the atlas pages.
+	std::vector<Layer> layers{};
+	layers.reserve(images.size() + pages.size());
+	for (size_t i{ 0 }; i < images.size(); ++i) {
+		if (std::find(small.begin(), small.end(), i) == small.end()) {
+			layers.push_back(Layer{ &images[i], { i } });
+		}
+	}
+	for (size_t page{ 0 }; page < pages.size(); ++page) {
+		layers.push_back(Layer{ &pages[page], pageTiles[page] });
+	}
+	std::map<std::pair<uint32_t, uint32_t>, std::vector<const Layer*>> sizes{};
+	for (auto& layer : layers) {
+		sizes[{ layer.image->width, layer.image->height }].push_back(&layer);
+	}
+
+	GLint maxLayers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	for (auto& [size, group] : sizes) {
+		for (size_t first{ 0 }; first < group.size(); first += maxLayers) {
+			std::vector<const Layer*> arrayLayers{ group.begin() + first,
+				group.begin() + std::min(group.size(), first + static_cast<size_t>(maxLayers)) };
+			uint32_t array{ createArray(size.first, size.second, arrayLayers) };
+			for (uint32_t layer{ 0 }; layer < arrayLayers.size(); ++layer) {
+				for (size_t i : arrayLayers[layer]->textures) {
+					packed[i].textureId = array;
+					packed[i].target = GL_TEXTURE_2D_ARRAY;
+					packed[i].layer = layer;
+				}
+			}
+		}
+	}
+	return packed;
+}
@@ -0,0 +1,77 @@
+#include "UniformBuffers.h"
+#include "RenderState.h"
+#include "InstanceTransforms.h"
+#include <glad/glad.h>
+#include <cstring>
+
+FrameUniformBuffer::FrameUniformBuffer() {
+	glGenBuffers(1, &m_buffer);
+	RenderState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+	RenderState::bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_buffer);
+}
+
+void FrameUniformBuffer::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos) {
+	FrameUniforms frame{ view, projection, glm::vec4{ cameraPos, 1 } };
+	RenderState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+}
+
+DrawUniformRing::DrawUniformRing(uint32_t slotsPerFrame)
+	: m_slotsPerFrame{ slotsPerFrame } {
+	int32_t alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_stride = static_cast<uint32_t>((sizeof(DrawUniforms) + alignment - 1) / alignment * alignment);
+	size_t size{ static_cast<size_t>(m_stride) * m_slotsPerFrame * FRAMES_IN_FLIGHT };
+
+	glGenBuffers(1, &m_buffer);
+	RenderState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+#ifdef GL_VERSION_4_4
+	if (GLAD_GL_VERSION_4_4) {
+		GLbitfield flags{ GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT };
+		glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+		m_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+		return;
+	}
+#endif
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+}
+
+void DrawUniformRing::beginFrame(const glm::mat4& viewProjection) {
+	m_viewProjection = viewProjection;
+	m_frame = (m_frame + 1) % FRAMES_IN_FLIGHT;
+	m_nextSlot = 0;
+	if (m_fences[m_frame] != nullptr) {
+		GLsync fence{ static_cast<GLsync>(m_fences[m_frame]) };
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED) {
+		}
+		glDeleteSync(fence);
+		m_fences[m_frame] = nullptr;
+	}
+}
+
+void DrawUniformRing::setViewProjection(const glm::mat4& viewProjection) {
+	m_viewProjection = viewProjection;
+}
+
+void DrawUniformRing::endFrame() {
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void DrawUniformRing::push(const glm::mat4& model, uint32_t materialIndex) {
+	if (m_nextSlot == m_slotsPerFrame) {
+		// The frame has used its whole region. Earlier draws of this frame may still be reading it.
+		glFinish();
+		m_nextSlot = 0;
+	}
+	DrawUniforms draw{ model, m_viewProjection * model, glm::mat4{ computeNormalMatrix(model) }, materialIndex };
+	size_t offset{ (static_cast<size_t>(m_frame) * m_slotsPerFrame + m_nextSlot++) * m_stride };
+	if (m_mapped != nullptr) {
+		std::memcpy(m_mapped + offset, &draw, sizeof(DrawUniforms));
+	}
+	else {
+		RenderState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(DrawUniforms), &draw);
+	}
+	RenderState::bindBufferRange(GL_UNIFORM_BUFFER, DRAW_UNIFORM_BINDING, m_buffer, offset, sizeof(DrawUniforms));
+}
@@ -15,6 +15,11 @@
 #include <memory>
 #include <filesystem>
 #include <numbers>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <random>
+#include <algorithm>
 
 #include <SFML/Window/Event.hpp>
 #include <SFML/Window/Window.hpp>
@@ -25,25 +30,208 @@
 #include "Object3D.h"
 #include "Animator.h"
 #include "ShaderProgram.h"
+#include "ShaderPermutations.h"
+#include "ShaderHotReload.h"
+#include "Impostor.h"
+#include "UniformBuffers.h"
+#include "RenderState.h"
+#include "RenderQueue.h"
+#include "GpuCulling.h"
+#include "ClusteredLighting.h"
+#include "DeferredRenderer.h"
+#include "CascadedShadowMaps.h"
+#include "Lightmap.h"
+#include "CookedMesh.h"
 
 #define M_PI std::numbers::pi_v<float>
 
+// Where the shaders are edited; CMake passes the real path. The build copies them to shaders/.
+#ifndef SHADER_SOURCE_DIRECTORY
+#define SHADER_SOURCE_DIRECTORY "shaders_source"
+#endif
+
 // We use a structure to track all the elements of a scene, including a list of objects,
 // a list of animators, and a shader program to use to render those objects.
 struct Scene {
 	ShaderProgram program{};
+	// The instanced variant of program, used when several objects draw the same mesh.
+	ShaderProgram instancedProgram{};
 	std::vector<Object3D> objects{};
 	std::vector<Animator> animators{};
+	// Objects whose bounds are farther than this from the camera are drawn as impostors.
+	// 0 disables impostors for the scene.
+	float impostorDistance{ 0 };
+	// Point and spot lights, shaded by programs with ShaderFeatures::CLUSTERED_LIGHTS.
+	std::vector<Light> lights{};
+	// The lighting ShaderFeatures (LIGHTING, CLUSTERED_LIGHTS, SHADOWS) of the scene's program, which
+	// the deferred renderer's lighting pass is compiled with to shade the scene the same way.
+	uint32_t lighting{ 0 };
+	// The direction of the directional light, which casts shadows if lighting includes SHADOWS.
+	glm::vec3 sunDirection{ 0, -1, 0 };
+	// Whether the scene's meshes are lit by baked lightmaps, which only the forward programs sample.
+	bool lightmapped{ false };
 };
 
+/**
+ * @brief Compiles the variants of a set of shader permutations, exiting if any of them fails.
+ */
+void compileVariants(ShaderPermutations& shaders, const std::vector<uint32_t>& variants) {
+	try {
+		shaders.compile(variants);
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+}
+
+/**
+ * @brief The variants of the mesh shaders, light_perspective.vert and lighting.frag. Every variant the
+ * scenes use is compiled together the first time this is called, in parallel if the driver can.
+ */
+ShaderPermutations& meshShaders() {
+	static ShaderPermutations shaders{ "shaders/light_perspective.vert", "shaders/lighting.frag",
+		"shaders/lighting_common.glsl" };
+	static bool compiled{ false };
+	if (!compiled) {
+		compiled = true;
+		compileVariants(shaders, {
+			0, ShaderFeatures::INSTANCING,
+			ShaderFeatures::LIGHTING, ShaderFeatures::LIGHTING | ShaderFeatures::INSTANCING,
+			ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS,
+			ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS | ShaderFeatures::INSTANCING,
+			ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS,
+			ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS | ShaderFeatures::INSTANCING,
+			ShaderFeatures::LIGHTING | ShaderFeatures::LIGHTMAP,
+			ShaderFeatures::LIGHTING | ShaderFeatures::LIGHTMAP | ShaderFeatures::INSTANCING
+		});
+	}
+	return shaders;
+}
+
+/**
+ * @brief The variants of the depth prepass's shaders, depth_only.vert and depth_only.frag.
+ */
+ShaderPermutations& depthPrepassShaders() {
+	static ShaderPermutations shaders{ "shaders/depth_only.vert", "shaders/depth_only.frag" };
+	static bool compiled{ false };
+	if (!compiled) {
+		compiled = true;
+		compileVariants(shaders, { 0, ShaderFeatures::INSTANCING });
+	}
+	return shaders;
+}
+
+/**
+ * @brief The variants of the deferred renderer's geometry pass, light_perspective.vert and gbuffer.frag.
+ */
+ShaderPermutations& gBufferShaders() {
+	static ShaderPermutations shaders{ "shaders/light_perspective.vert", "shaders/gbuffer.frag" };
+	static bool compiled{ false };
+	if (!compiled) {
+		compiled = true;
+		compileVariants(shaders, { 0, ShaderFeatures::INSTANCING });
+	}
+	return shaders;
+}
+
+/**
+ * @brief The variants of the deferred renderer's lighting pass, fullscreen.vert and deferred_lighting.frag,
+ * one for each lighting model a scene can have. It shares lighting.frag's lighting functions.
+ */
+ShaderPermutations& deferredLightingShaders() {
+	static ShaderPermutations shaders{ "shaders/fullscreen.vert", "shaders/deferred_lighting.frag",
+		"shaders/lighting_common.glsl" };
+	static bool compiled{ false };
+	if (!compiled) {
+		compiled = true;
+		compileVariants(shaders, {
+			0, ShaderFeatures::LIGHTING, ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS,
+			ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS
+		});
+	}
+	return shaders;
+}
+
 /**
  * @brief Constructs a shader program that applies the Phong reflection model.
  */
 ShaderProgram phongLightingShader() {
+	// These shaders are INCOMPLETE.
+	return meshShaders().get(ShaderFeatures::LIGHTING);
+}
+
+/**
+ * @brief Constructs a shader program that performs texture mapping with no lighting.
+ */
+ShaderProgram texturingShader() {
+	return meshShaders().get(0);
+}
+
+/**
+ * @brief Constructs the instanced variant of phongLightingShader.
+ */
+ShaderProgram instancedPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::INSTANCING);
+}
+
+/**
+ * @brief Constructs the instanced variant of texturingShader.
+ */
+ShaderProgram instancedTexturingShader() {
+	return meshShaders().get(ShaderFeatures::INSTANCING);
+}
+
+/**
+ * @brief Constructs a Phong lighting program that also shades a scene's clustered point and spot lights.
+ */
+ShaderProgram clusteredPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS);
+}
+
+/**
+ * @brief Constructs the instanced variant of clusteredPhongLightingShader.
+ */
+ShaderProgram instancedClusteredPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS | ShaderFeatures::INSTANCING);
+}
+
+/**
+ * @brief Constructs a Phong lighting program whose directional light is shadowed by CascadedShadowMaps.
+ */
+ShaderProgram shadowedPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS);
+}
+
+/**
+ * @brief Constructs the instanced variant of shadowedPhongLightingShader.
+ */
+ShaderProgram instancedShadowedPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS | ShaderFeatures::INSTANCING);
+}
+
+/**
+ * @brief Constructs a Phong lighting program that takes its ambient and directional light from a
+ * mesh's baked lightmap.
+ */
+ShaderProgram lightmappedPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::LIGHTMAP);
+}
+
+/**
+ * @brief Constructs the instanced variant of lightmappedPhongLightingShader.
+ */
+ShaderProgram instancedLightmappedPhongLightingShader() {
+	return meshShaders().get(ShaderFeatures::LIGHTING | ShaderFeatures::LIGHTMAP | ShaderFeatures::INSTANCING);
+}
+
+/**
+ * @brief Constructs a shader program that renders textured meshes into an impostor's color and normal atlases.
+ */
+ShaderProgram impostorCaptureShader() {
 	ShaderProgram shader{};
 	try {
-		// These shaders are INCOMPLETE.
-		shader.load("shaders/light_perspective.vert", "shaders/lighting.frag");
+		shader.load("shaders/texture_perspective.vert", "shaders/impostor_capture.frag");
 	}
 	catch (std::runtime_error& e) {
 		std::cout << "ERROR: " << e.what() << std::endl;
@@ -53,12 +241,26 @@ ShaderProgram phongLightingShader() {
 }
 
 /**
- * @brief Constructs a shader program that performs texture mapping with no lighting.
+ * @brief Constructs a shader program that draws impostors as camera-facing quads, lit by the normal
+ * atlas if the scene's lighting features include LIGHTING.
  */
-ShaderProgram texturingShader() {
+ShaderProgram impostorShader(uint32_t lighting) {
 	ShaderProgram shader{};
 	try {
-		shader.load("shaders/texture_perspective.vert", "shaders/texturing.frag");
+		shader.load("shaders/impostor.vert", "shaders/impostor.frag",
+			(lighting & ShaderFeatures::LIGHTING) ? std::vector<std::string>{ "LIGHTING" } : std::vector<std::string>{});
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return shader;
+}
+
+ShaderProgram computeShader(const std::string& path) {
+	ShaderProgram shader{};
+	try {
+		shader.loadCompute(path);
 	}
 	catch (std::runtime_error& e) {
 		std::cout << "ERROR: " << e.what() << std::endl;
@@ -80,7 +282,7 @@ Texture loadTexture(const std::filesystem::path& path, const std::string& sample
 *  DEMONSTRATION SCENES
 *****************************************************************************************/
 Scene bunny() {
-	Scene scene{ texturingShader() };
+	Scene scene{ texturingShader(), instancedTexturingShader() };
 
 	// We assume that (0,0) in texture space is the upper left corner, but some artists use (0,0) in the lower
 	// left corner. In that case, we have to flip the V-coordinate of each UV texture location. The last parameter
@@ -110,7 +312,7 @@ Scene bunny() {
  * that does not come from Assimp.
  */
 Scene marbleSquare() {
-	Scene scene{ texturingShader() };
+	Scene scene{ texturingShader(), instancedTexturingShader() };
 
 	std::vector<Texture> textures{
 		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "baseTexture"),
@@ -125,11 +327,41 @@ Scene marbleSquare() {
 	return scene;
 }
 
+/**
+ * @brief The marble floor lit by a grid of small colored point lights, of which each part of the floor
+ * only sees a handful.
+ */
+Scene marbleLights() {
+	Scene scene{ clusteredPhongLightingShader(), instancedClusteredPhongLightingShader() };
+
+	std::vector<Texture> textures{
+		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "baseTexture"),
+	};
+	auto mesh{ Mesh::square(textures) };
+	Object3D floor{ std::vector<Mesh>{mesh} };
+	floor.grow(glm::vec3{ 5, 5, 5 });
+	floor.move(glm::vec3{ 0, -1.5, 0 });
+	floor.rotate(glm::vec3{ -M_PI / 2, 0, 0 });
+	scene.objects.push_back(std::move(floor));
+
+	scene.lighting = ShaderFeatures::LIGHTING | ShaderFeatures::CLUSTERED_LIGHTS;
+	constexpr int32_t LIGHTS_PER_SIDE{ 24 };
+	for (int32_t row{ 0 }; row < LIGHTS_PER_SIDE; ++row) {
+		for (int32_t column{ 0 }; column < LIGHTS_PER_SIDE; ++column) {
+			float hue{ static_cast<float>(row * LIGHTS_PER_SIDE + column) / (LIGHTS_PER_SIDE * LIGHTS_PER_SIDE) * 2 * M_PI };
+			glm::vec3 color{ 0.5f + 0.5f * glm::cos(glm::vec3{ hue, hue - 2 * M_PI / 3, hue + 2 * M_PI / 3 }) };
+			glm::vec3 position{ -5 + 10.0f * (column + 0.5f) / LIGHTS_PER_SIDE, -1.3f, -5 + 10.0f * (row + 0.5f) / LIGHTS_PER_SIDE };
+			scene.lights.push_back(Light{ position, 0.8f, color });
+		}
+	}
+	return scene;
+}
+
 /**
  * @brief Loads a cube with a cube map texture.
  */
 Scene cube() {
-	Scene scene{ texturingShader() };
+	Scene scene{ texturingShader(), instancedTexturingShader() };
 
 	auto cube{ assimpLoad("models/cube.obj", true) };
 
@@ -152,9 +384,10 @@ Scene cube() {
  */
 Scene lifeOfPi() {
 	// This scene is more complicated; it has child objects, as well as animators.
-	Scene scene{ texturingShader() };
+	Scene scene{ texturingShader(), instancedTexturingShader() };
 
-	auto boat{ assimpLoad("models/boat/boat.fbx", true) };
+	// The boat's hull hides much of what is behind it, so it is imported with occluder proxies.
+	auto boat{ assimpLoad("models/boat/boat.fbx", true, AssimpImportOptions{ .buildOccluders = true }) };
 	boat.move(glm::vec3{ 0, -0.7, 0 });
 	boat.grow(glm::vec3{ 0.01, 0.01, 0.01 });
 	auto tiger{ assimpLoad("models/tiger/scene.gltf", true) };
@@ -182,18 +415,416 @@ Scene lifeOfPi() {
 	return scene;
 }
 
+/**
+ * @brief A lit row of spinning bunnies receding from the camera. Those farther than impostorDistance
+ * are drawn as impostors, lit through their captured normals.
+ */
+Scene bunnyParade() {
+	Scene scene{ phongLightingShader(), instancedPhongLightingShader() };
+	scene.lighting = ShaderFeatures::LIGHTING;
+	scene.sunDirection = glm::vec3{ -1, -1, -1 };
+	scene.impostorDistance = 12;
+
+	constexpr int32_t BUNNIES{ 10 };
+	auto bunny{ assimpLoad("models/bunny_textured.obj", true) };
+	bunny.grow(glm::vec3{ 9, 9, 9 });
+	for (int32_t i{ 0 }; i < BUNNIES; ++i) {
+		// Copies of an object share its meshes' buffers.
+		Object3D copy{ bunny };
+		copy.move(glm::vec3{ (i % 2 == 0) ? -1.5f : 1.5f, -1, -4.0f * i });
+		scene.objects.push_back(std::move(copy));
+	}
+
+	// The animators refer to the objects where they ended up in the list.
+	for (auto& o : scene.objects) {
+		Animator spin{};
+		spin.addAnimation(std::make_unique<RotationAnimation>(o, 10.0f, glm::vec3{ 0, 2 * M_PI, 0 }));
+		scene.animators.push_back(std::move(spin));
+	}
+	return scene;
+}
+
+/**
+ * @brief The boat and tiger of lifeOfPi turning over the marble floor in low sunlight. The floor is
+ * static, so its shadow maps are only redrawn when the cascades move; the boat's are redrawn as it turns.
+ */
+Scene shadowedBoat() {
+	Scene scene{ shadowedPhongLightingShader(), instancedShadowedPhongLightingShader() };
+	scene.lighting = ShaderFeatures::LIGHTING | ShaderFeatures::SHADOWS;
+	scene.sunDirection = glm::vec3{ -1, -1.5, -0.5 };
+
+	std::vector<Texture> textures{
+		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "baseTexture"),
+	};
+	auto mesh{ Mesh::square(textures) };
+	Object3D floor{ std::vector<Mesh>{mesh} };
+	floor.grow(glm::vec3{ 5, 5, 5 });
+	floor.move(glm::vec3{ 0, -1.5, 0 });
+	floor.rotate(glm::vec3{ -M_PI / 2, 0, 0 });
+	floor.setStatic(true);
+	scene.objects.push_back(std::move(floor));
+
+	auto boat{ assimpLoad("models/boat/boat.fbx", true) };
+	boat.move(glm::vec3{ 0, -0.7, 0 });
+	boat.grow(glm::vec3{ 0.01, 0.01, 0.01 });
+	auto tiger{ assimpLoad("models/tiger/scene.gltf", true) };
+	tiger.move(glm::vec3{ 0, -5, 10 });
+	boat.addChild(std::move(tiger));
+	scene.objects.push_back(std::move(boat));
+
+	// The objects list is complete, so references into it stay valid.
+	Animator animBoat{};
+	animBoat.addAnimation(std::make_unique<RotationAnimation>(scene.objects[1], 10.0f, glm::vec3{ 0, 2 * M_PI, 0 }));
+	scene.animators.push_back(std::move(animBoat));
+	return scene;
+}
+
+/**
+ * @brief The boat and tiger of lifeOfPi at rest on the marble floor, with their sunlight, sky light,
+ * and the light bounced between them baked into lightmaps when the scene is built. The G-buffer does
+ * not carry lightmap coordinates, so the scene is always shaded forward.
+ */
+Scene bakedBoat() {
+	Scene scene{ lightmappedPhongLightingShader(), instancedLightmappedPhongLightingShader() };
+	scene.lighting = ShaderFeatures::LIGHTING;
+	scene.sunDirection = glm::vec3{ -1, -1.5, -0.5 };
+	scene.lightmapped = true;
+	constexpr uint32_t LIGHTMAP_RESOLUTION{ 256 };
+
+	std::vector<Texture> textures{
+		loadTexture("models/White_marble_03/Textures_2K/white_marble_03_2k_baseColor.tga", "baseTexture"),
+	};
+	auto mesh{ Mesh::square(textures) };
+	Object3D floor{ std::vector<Mesh>{mesh} };
+	floor.grow(glm::vec3{ 5, 5, 5 });
+	floor.move(glm::vec3{ 0, -1.5, 0 });
+	floor.rotate(glm::vec3{ -M_PI / 2, 0, 0 });
+	scene.objects.push_back(std::move(floor));
+
+	AssimpImportOptions bakeable{ .lightmapResolution = LIGHTMAP_RESOLUTION, .retainGeometry = true };
+	auto boat{ assimpLoad("models/boat/boat.fbx", true, bakeable) };
+	boat.move(glm::vec3{ 0, -0.7, 0 });
+	boat.grow(glm::vec3{ 0.01, 0.01, 0.01 });
+	auto tiger{ assimpLoad("models/tiger/scene.gltf", true, bakeable) };
+	tiger.move(glm::vec3{ 0, -5, 10 });
+	boat.addChild(std::move(tiger));
+	scene.objects.push_back(std::move(boat));
+
+	// The objects list is complete, so the baker's references into it stay valid.
+	LightmapBakeSettings settings{};
+	settings.sunDirection = scene.sunDirection;
+	LightmapBaker baker{ settings };
+	for (auto& o : scene.objects) {
+		o.updateHierarchy();
+		baker.add(o, LIGHTMAP_RESOLUTION);
+	}
+	baker.bake();
+	return scene;
+}
 
+// The scenes that can be chosen on the command line, by name.
+const std::vector<std::pair<std::string, Scene(*)()>> SCENES{
+	{ "bunny", bunny }, { "marbleSquare", marbleSquare }, { "marbleLights", marbleLights }, { "cube", cube },
+	{ "lifeOfPi", lifeOfPi }, { "bunnyParade", bunnyParade }, { "shadowedBoat", shadowedBoat },
+	{ "bakedBoat", bakedBoat },
+};
 
-int main() {
+
+/**
+ * @brief Builds a UV sphere of radius 1 with the given number of rings and segments, for benchmarks
+ * that need a large mesh whose vertices are actually filled in.
+ */
+void tessellatedSphere(uint32_t rings, uint32_t segments, std::vector<Vertex3D>& vertices, std::vector<uint32_t>& faces) {
+	vertices.clear();
+	faces.clear();
+	for (uint32_t ring{ 0 }; ring <= rings; ++ring) {
+		float v{ static_cast<float>(ring) / rings };
+		float theta{ v * M_PI };
+		for (uint32_t segment{ 0 }; segment <= segments; ++segment) {
+			float u{ static_cast<float>(segment) / segments };
+			float phi{ u * 2 * M_PI };
+			glm::vec3 normal{ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+			vertices.push_back(Vertex3D{ normal.x, normal.y, normal.z, normal.x, normal.y, normal.z, u, v });
+		}
+	}
+	for (uint32_t ring{ 0 }; ring < rings; ++ring) {
+		for (uint32_t segment{ 0 }; segment < segments; ++segment) {
+			uint32_t first{ ring * (segments + 1) + segment };
+			uint32_t below{ first + segments + 1 };
+			faces.insert(faces.end(), { first, below, first + 1, first + 1, below, below + 1 });
+		}
+	}
+}
+
+#ifdef COOKED_MESH_BENCHMARK
+/**
+ * @brief Checks that a cooked mesh decodes back to exactly what was encoded, for a large sphere and
+ * for an empty mesh, and that out-of-range indices and truncated files are rejected. Then times
+ * decoding the sphere and reports the throughput and compression ratio.
+ * @return 0 if every round trip matched and every corrupt mesh was rejected.
+ */
+int benchmarkCookedMesh() {
+	constexpr uint32_t RUNS{ 20 };
+
+	std::vector<Vertex3D> vertices{};
+	std::vector<uint32_t> faces{};
+	tessellatedSphere(1000, 1000, vertices, faces);
+	CookedMesh cooked{ CookedMesh::encode(vertices, faces) };
+
+	std::vector<Vertex3D> decodedVertices(cooked.getVertexCount());
+	std::vector<uint32_t> decodedFaces(cooked.getFaceCount());
+	cooked.decodeVertices(decodedVertices.data());
+	cooked.decodeFaces(decodedFaces.data());
+	bool matches{ decodedVertices.size() == vertices.size() && decodedFaces == faces
+		&& std::memcmp(decodedVertices.data(), vertices.data(), vertices.size() * sizeof(Vertex3D)) == 0 };
+
+	CookedMesh empty{ CookedMesh::encode({}, {}) };
+	CookedMesh unencoded{};
+	matches = matches && empty.getVertexCount() == 0 && empty.getEncodedSize() == 0 && unencoded.getEncodedSize() == 0;
+	empty.decodeVertices(nullptr);
+	unencoded.decodeFaces(nullptr);
+	std::cout << "Round trips " << (matches ? "match" : "DO NOT match") << std::endl;
+
+	// A face block whose last index is past the vertices, and a file cut off in its data.
+	bool rejected{ true };
+	CookedMesh badFaces{ CookedMesh::encode(std::vector<Vertex3D>(3), { 0, 1, 7 }) };
+	uint32_t badIndices[3];
+	try {
+		badFaces.decodeFaces(badIndices);
+		rejected = false;
+	}
+	catch (std::runtime_error&) {}
+	auto path{ std::filesystem::temp_directory_path() / "truncated.cmsh" };
+	cooked.saveToFile(path);
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+	try {
+		CookedMesh::loadFromFile(path);
+		rejected = false;
+	}
+	catch (std::runtime_error&) {}
+	std::filesystem::remove(path);
+	std::cout << "Corrupt meshes " << (rejected ? "are rejected" : "ARE NOT rejected") << std::endl;
+	matches = matches && rejected;
+
+	auto start{ std::chrono::steady_clock::now() };
+	for (uint32_t run{ 0 }; run < RUNS; ++run) {
+		cooked.decodeVertices(decodedVertices.data());
+		cooked.decodeFaces(decodedFaces.data());
+	}
+	std::chrono::duration<double> seconds{ std::chrono::steady_clock::now() - start };
+	size_t rawSize{ vertices.size() * sizeof(Vertex3D) + faces.size() * sizeof(uint32_t) };
+	std::cout << vertices.size() << " vertices, " << faces.size() / 3 << " triangles: "
+		<< cooked.getEncodedSize() << " of " << rawSize << " bytes ("
+		<< 100.0 * cooked.getEncodedSize() / rawSize << "%), decoded at "
+		<< rawSize * RUNS / seconds.count() / 1e9 << " GB/s" << std::endl;
+	return matches ? 0 : 1;
+}
+#endif
+
+#ifdef BVH_VALIDATION
+/**
+ * @brief Checks Bvh queries against brute force over every triangle: closest hits, any hits, and
+ * sphere overlaps, for random rays and spheres among 100,000 random triangles.
+ * @return the number of queries whose answers differed.
+ */
+int validateBvh() {
+	constexpr uint32_t TRIANGLES{ 100000 };
+	constexpr uint32_t QUERIES{ 300 };
+	constexpr float SIZE{ 100 };
+
+	std::mt19937 random{ 449 };
+	std::uniform_real_distribution<float> coordinate{ 0, SIZE };
+	std::uniform_real_distribution<float> offset{ -1, 1 };
+	std::vector<glm::vec3> positions{};
+	std::vector<uint32_t> faces{};
+	for (uint32_t i{ 0 }; i < TRIANGLES; ++i) {
+		glm::vec3 center{ coordinate(random), coordinate(random), coordinate(random) };
+		for (uint32_t corner{ 0 }; corner < 3; ++corner) {
+			faces.push_back(static_cast<uint32_t>(positions.size()));
+			positions.push_back(center + glm::vec3{ offset(random), offset(random), offset(random) });
+		}
+	}
+	Bvh bvh{ positions, faces };
+
+	// The same Moller-Trumbore test the Bvh uses, so both sides agree on rays that graze an edge.
+	auto intersect{ [&](uint32_t triangle, const glm::vec3& origin, const glm::vec3& direction, float& distance) {
+		glm::vec3 a{ positions[faces[3 * triangle]] };
+		glm::vec3 edge1{ positions[faces[3 * triangle + 1]] - a };
+		glm::vec3 edge2{ positions[faces[3 * triangle + 2]] - a };
+		glm::vec3 p{ glm::cross(direction, edge2) };
+		float determinant{ glm::dot(edge1, p) };
+		if (std::abs(determinant) < 1e-12f) {
+			return false;
+		}
+		glm::vec3 s{ origin - a };
+		float u{ glm::dot(s, p) / determinant };
+		glm::vec3 q{ glm::cross(s, edge1) };
+		float v{ glm::dot(direction, q) / determinant };
+		distance = glm::dot(edge2, q) / determinant;
+		return u >= 0 && u <= 1 && v >= 0 && u + v <= 1 && distance > 0;
+	} };
+
+	uint32_t mismatches{ 0 };
+	uint32_t hits{ 0 };
+	for (uint32_t query{ 0 }; query < QUERIES; ++query) {
+		glm::vec3 origin{ coordinate(random), coordinate(random), coordinate(random) };
+		glm::vec3 direction{ glm::normalize(glm::vec3{ offset(random), offset(random), offset(random) }) };
+		float maxDistance{ SIZE };
+
+		float closest{ maxDistance };
+		bool anyHit{ false };
+		for (uint32_t i{ 0 }; i < TRIANGLES; ++i) {
+			float distance;
+			if (intersect(i, origin, direction, distance) && distance < maxDistance) {
+				anyHit = true;
+				closest = std::min(closest, distance);
+			}
+		}
+		BvhHit hit{};
+		bool bvhHit{ bvh.raycast(origin, direction, maxDistance, hit) };
+		if (bvhHit != anyHit || (anyHit && std::abs(hit.distance - closest) > 1e-4f * closest)
+			|| bvh.occluded(origin, direction, maxDistance) != anyHit) {
+			++mismatches;
+		}
+		hits += anyHit;
+
+		float radius{ 2 };
+		std::vector<uint32_t> expected{};
+		for (uint32_t i{ 0 }; i < TRIANGLES; ++i) {
+			glm::vec3 point{ Bvh::closestPointOnTriangle(origin, positions[faces[3 * i]], positions[faces[3 * i + 1]],
+				positions[faces[3 * i + 2]]) };
+			if (glm::dot(point - origin, point - origin) <= radius * radius) {
+				expected.push_back(i);
+			}
+		}
+		std::vector<uint32_t> overlapping{};
+		bvh.overlapSphere(origin, radius, overlapping);
+		std::sort(overlapping.begin(), overlapping.end());
+		if (overlapping != expected) {
+			++mismatches;
+		}
+	}
+	std::cout << QUERIES << " rays (" << hits << " hitting) and spheres against " << TRIANGLES << " triangles: "
+		<< mismatches << " mismatches" << std::endl;
+	return static_cast<int>(mismatches);
+}
+#endif
+
+#ifdef VERTEX_THROUGHPUT_BENCHMARK
+/**
+ * @brief Compares the vertex stage with matrices built per vertex (per_vertex_matrices.vert) against
+ * matrices computed once per draw on the CPU (texture_perspective.vert). A procedural sphere of
+ * 131,072 triangles, with its positions, normals, and texture coordinates bound, is drawn many times
+ * into a 1x1 viewport, so the fragment stage costs next to nothing, and each program is timed with
+ * GPU queries.
+ */
+void benchmarkVertexThroughput(FrameUniformBuffer& frameUniforms, DrawUniformRing& drawUniforms) {
+	constexpr uint32_t DRAWS_PER_FRAME{ 100 };
+	constexpr uint32_t FRAMES{ 30 };
+
+	std::vector<Vertex3D> vertices{};
+	std::vector<uint32_t> faces{};
+	tessellatedSphere(256, 256, vertices, faces);
+	Object3D ball{ std::vector<Mesh>{ Mesh{ vertices, faces } } };
+	ball.updateHierarchy();
+	// Mesh::createBuffers leaves the position, normal, and texture coordinate attributes to the
+	// student, so they are set up here; otherwise every vertex would read the constant (0, 0, 0, 1)
+	// and no attribute data would be fetched.
+	const Mesh& mesh{ ball.getMesh(0) };
+	RenderState::bindVertexArray(mesh.getVertexArray());
+	RenderState::bindBuffer(GL_ARRAY_BUFFER, mesh.getVertexBuffer());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, x)));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, nx)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex3D), reinterpret_cast<void*>(offsetof(Vertex3D, u)));
+	glEnableVertexAttribArray(2);
+	RenderState::bindVertexArray(0);
+	BoundingSphere sphere{ ball.getWorldBoundingSphere() };
+	glm::vec3 eye{ sphere.center + glm::vec3{ 0, 0, 3 * sphere.radius } };
+	glm::mat4 view{ glm::lookAt(eye, sphere.center, glm::vec3{ 0, 1, 0 }) };
+	glm::mat4 projection{ glm::perspective(glm::radians(45.0f), 1.0f, sphere.radius, 5 * sphere.radius) };
+	frameUniforms.update(view, projection, eye);
+	Frustum frustum{ projection * view };
+
+	ShaderProgram perVertex{};
+	perVertex.load("shaders/per_vertex_matrices.vert", "shaders/texturing.frag");
+	ShaderProgram perDraw{};
+	perDraw.load("shaders/texture_perspective.vert", "shaders/texturing.frag");
+	// Without instanced programs, the queue submits every draw on its own.
+	RenderQueue queue{};
+
+	int32_t viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, 1, 1);
+	uint32_t queries[2];
+	glGenQueries(2, queries);
+	for (auto [name, program] : { std::pair{ "per-vertex matrices", &perVertex }, std::pair{ "per-draw matrices", &perDraw } }) {
+		uint64_t nanoseconds{ 0 };
+		uint64_t triangles{ 0 };
+		for (uint32_t frame{ 0 }; frame < FRAMES; ++frame) {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawUniforms.beginFrame(projection * view);
+			queue.clear(view, projection);
+			CullingStats culling{};
+			for (uint32_t i{ 0 }; i < DRAWS_PER_FRAME; ++i) {
+				ball.collect(queue, *program, frustum, nullptr, culling);
+			}
+			glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+			glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+			queue.submit(drawUniforms);
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+			glEndQuery(GL_TIME_ELAPSED);
+			drawUniforms.endFrame();
+
+			uint64_t elapsed, generated;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &elapsed);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &generated);
+			nanoseconds += elapsed;
+			triangles += generated;
+		}
+		double seconds{ nanoseconds / 1e9 };
+		std::cout << name << ": " << seconds * 1000 / FRAMES << " ms per frame, "
+			<< triangles * 3 / seconds / 1e6 << " million vertices per second" << std::endl;
+	}
+	glDeleteQueries(2, queries);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+#endif
+
+int main(int argc, char** argv) {
 
 	std::cout << std::filesystem::current_path() << std::endl;
 
+	// The first argument names the scene to show; the bunny is shown by default.
+	std::string sceneName{ argc > 1 ? argv[1] : "bunny" };
+	auto selected{ std::find_if(SCENES.begin(), SCENES.end(), [&](auto& scene) { return scene.first == sceneName; }) };
+	if (selected == SCENES.end()) {
+		std::cout << "ERROR: unknown scene \"" << sceneName << "\". The scenes are:";
+		for (auto& [name, makeScene] : SCENES) {
+			std::cout << " " << name;
+		}
+		std::cout << std::endl;
+		return 1;
+	}
+
+#ifdef COOKED_MESH_BENCHMARK
+	return benchmarkCookedMesh();
+#endif
+#ifdef BVH_VALIDATION
+	return validateBvh();
+#endif
+
 	// Initialize the window and OpenGL.
 	sf::ContextSettings settings;
 	settings.depthBits = 24; // Request a 24 bits depth buffer
 	settings.stencilBits = 8;  // Request a 8 bits stencil buffer
-	settings.majorVersion = 3; // You might have to change these on Mac.
-	settings.minorVersion = 3;
+	// Ask for the newest core context; SFML steps down through older versions until the driver accepts
+	// one. Multi-draw indirect and GPU culling need OpenGL 4.3, and the persistently mapped draw
+	// uniforms 4.4, so everything still runs on 3.3 through the older paths.
+	settings.majorVersion = 4;
+	settings.minorVersion = 6;
+	settings.attributeFlags = sf::ContextSettings::Attribute::Core;
 
 	sf::Window window{
 		sf::VideoMode::getFullscreenModes().at(0), "Modern OpenGL",
@@ -203,12 +834,89 @@ int main() {
 
 	gladLoadGL();
 	glEnable(GL_DEPTH_TEST);
+#ifdef GL_VERSION_4_4
+	bool persistentUniforms{ GLAD_GL_VERSION_4_4 != 0 };
+#else
+	bool persistentUniforms{ false };
+#endif
+	std::cout << "OpenGL " << reinterpret_cast<const char*>(glGetString(GL_VERSION)) << ": "
+		<< (GpuCulling::isSupported() ? "multi-draw indirect with GPU culling" : "instanced draws with CPU culling")
+		<< ", " << (persistentUniforms ? "persistently mapped" : "glBufferSubData") << " draw uniforms" << std::endl;
 
 	// Inintialize scene objects.
-	auto myScene{ bunny() };
+	auto myScene{ selected->second() };
 	// You can directly access specific objects in the scene using references.
 	auto& firstObject{ myScene.objects[0] };
 
+	// The camera is shared by every program through one uniform buffer, and each draw's model
+	// matrix and material go into a ring of per-draw blocks.
+	FrameUniformBuffer frameUniforms{};
+	DrawUniformRing drawUniforms{};
+
+#ifdef VERTEX_THROUGHPUT_BENCHMARK
+	benchmarkVertexThroughput(frameUniforms, drawUniforms);
+	return 0;
+#endif
+
+	RenderQueue renderQueue{};
+	OcclusionBuffer occlusion{};
+	renderQueue.setInstancedProgram(myScene.program, myScene.instancedProgram);
+	// On OpenGL 4.3, instances are culled by a compute shader against the previous frame's depth,
+	// which takes the place of the CPU occlusion buffer.
+	std::unique_ptr<GpuCulling> gpuCulling{};
+	if (GpuCulling::isSupported()) {
+		gpuCulling = std::make_unique<GpuCulling>(computeShader("shaders/cull_instances.comp"),
+			computeShader("shaders/depth_pyramid.comp"));
+		renderQueue.setGpuCulling(gpuCulling.get());
+	}
+
+	// Lights are assigned to the clusters of a view-space grid each frame, for scenes that have any.
+	ClusteredLighting clusteredLighting{};
+
+	// The scene can also be drawn into a G-buffer and lit in a separate pass; F1 switches between the two.
+	DeferredRenderer deferredRenderer{};
+	ShaderProgram geometryProgram{ gBufferShaders().get(0) };
+	ShaderProgram instancedGeometryProgram{ gBufferShaders().get(ShaderFeatures::INSTANCING) };
+	ShaderProgram deferredLightingProgram{ deferredLightingShaders().get(myScene.lighting) };
+	renderQueue.setInstancedProgram(geometryProgram, instancedGeometryProgram);
+	bool deferred{ false };
+
+	// F2 switches on a depth-only prepass, after which the scene's shaders run once per visible pixel.
+	ShaderProgram depthProgram{ depthPrepassShaders().get(0) };
+	ShaderProgram instancedDepthProgram{ depthPrepassShaders().get(ShaderFeatures::INSTANCING) };
+	bool depthPrepass{ false };
+
+	// The directional light of scenes with SHADOWS casts shadows from cascaded maps, drawn with the
+	// depth prepass's programs.
+	std::unique_ptr<CascadedShadowMaps> shadows{};
+	if (myScene.lighting & ShaderFeatures::SHADOWS) {
+		shadows = std::make_unique<CascadedShadowMaps>(depthProgram, instancedDepthProgram);
+		shadows->setLightDirection(myScene.sunDirection);
+	}
+
+	// Pre-render each object into an impostor for when it is far from the camera.
+	ShaderProgram impostorProgram{};
+	if (myScene.impostorDistance > 0) {
+		auto captureProgram{ impostorCaptureShader() };
+		impostorProgram = impostorShader(myScene.lighting);
+		for (auto& o : myScene.objects) {
+			o.setImpostor(std::make_shared<Impostor>(Impostor::capture(o, captureProgram, frameUniforms, drawUniforms)), myScene.impostorDistance);
+		}
+	}
+
+	// Rebuild the scene's programs in the background when their files in shaders_source/ are edited.
+	ShaderHotReload shaderReload{ SHADER_SOURCE_DIRECTORY, "shaders" };
+	shaderReload.watch(myScene.program);
+	shaderReload.watch(myScene.instancedProgram);
+	shaderReload.watch(geometryProgram);
+	shaderReload.watch(instancedGeometryProgram);
+	shaderReload.watch(deferredLightingProgram);
+	shaderReload.watch(depthProgram);
+	shaderReload.watch(instancedDepthProgram);
+	if (myScene.impostorDistance > 0) {
+		shaderReload.watch(impostorProgram);
+	}
+
 	// Activate the shader program.
 	myScene.program.activate();
 
@@ -228,11 +936,33 @@ int main() {
 			if (event->is<sf::Event::Closed>()) {
 				window.close();
 			}
+			else if (const auto* key{ event->getIf<sf::Event::KeyPressed>() }) {
+				if (key->code == sf::Keyboard::Key::F1 && myScene.lightmapped) {
+					std::cout << "Deferred shading does not sample lightmaps; staying with forward shading" << std::endl;
+				}
+				else if (key->code == sf::Keyboard::Key::F1) {
+					deferred = !deferred;
+					std::cout << (deferred ? "Deferred" : "Forward") << " shading" << std::endl;
+				}
+				else if (key->code == sf::Keyboard::Key::F2) {
+					depthPrepass = !depthPrepass;
+					renderQueue.setDepthPrepass(depthPrepass ? &depthProgram : nullptr,
+						depthPrepass ? &instancedDepthProgram : nullptr);
+					std::cout << "Depth prepass " << (depthPrepass ? "on" : "off") << std::endl;
+				}
+			}
 		}
 		auto now{ c.getElapsedTime() };
 		auto diff{ now - last };
 		last = now;
 
+		if (shaderReload.update()) {
+			// Rebuilt programs have new IDs.
+			renderQueue.clearInstancedPrograms();
+			renderQueue.setInstancedProgram(myScene.program, myScene.instancedProgram);
+			renderQueue.setInstancedProgram(geometryProgram, instancedGeometryProgram);
+		}
+
 #ifdef LOG_FPS
 		// FPS calculation.
 		std::cout << 1 / diff.asSeconds() << " FPS " << std::endl;
@@ -241,22 +971,93 @@ int main() {
 		glm::vec3 cameraPos{ glm::vec3{ 0, 0, 5 } };
 		glm::mat4 camera{ glm::lookAt(cameraPos, glm::vec3{ 0, 0, 0 }, glm::vec3{ 0, 1, 0 }) };
 		glm::mat4 perspective{ glm::perspective(glm::radians(45.0f), static_cast<float>(window.getSize().x) / window.getSize().y, 0.1f, 100.0f) };
-		myScene.program.setUniform("view", camera);
-		myScene.program.setUniform("projection", perspective);
-		myScene.program.setUniform("cameraPos", cameraPos);
+		frameUniforms.update(camera, perspective, cameraPos);
+		if (!myScene.lights.empty()) {
+			clusteredLighting.update(myScene.lights, camera, perspective, glm::uvec2{ window.getSize().x, window.getSize().y });
+			clusteredLighting.bind(myScene.program);
+			clusteredLighting.bind(myScene.instancedProgram);
+			clusteredLighting.bind(deferredLightingProgram);
+		}
 
 		// Update the scene.
 		for (auto& anim : myScene.animators) {
 			anim.tick(diff.asSeconds());
 		}
+		for (auto& o : myScene.objects) {
+			// The cached static shadows are out of date once static scenery moves.
+			if (o.updateHierarchy() && o.isStatic() && shadows) {
+				shadows->invalidateStatic();
+			}
+		}
 
 		// Clear the OpenGL "context".
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		// Render the scene objects.
+		ShaderProgram& sceneProgram{ deferred ? geometryProgram : myScene.program };
+		drawUniforms.beginFrame(perspective * camera);
+		if (shadows) {
+			shadows->update(camera, perspective, myScene.objects, drawUniforms);
+			for (auto* program : { &myScene.program, &myScene.instancedProgram, &deferredLightingProgram }) {
+				shadows->bind(*program);
+				program->setUniform("directionalLight", myScene.sunDirection);
+			}
+		}
+		if (deferred) {
+			deferredRenderer.beginGeometryPass(glm::uvec2{ window.getSize().x, window.getSize().y });
+		}
+		// Collect the scene objects' draws, then sort and submit them. Distant objects are drawn
+		// afterward as impostors.
+		renderQueue.clear(camera, perspective);
+		Frustum frustum{ perspective * camera };
+		CullingStats culling{};
+		// Without GPU culling, draw the scene's occluders into the CPU depth buffer, to skip whatever they hide.
+		OcclusionBuffer* cpuOcclusion{ nullptr };
+		if (!gpuCulling) {
+			occlusion.clear(perspective * camera);
+			for (auto& o : myScene.objects) {
+				o.collectOccluders(occlusion, frustum);
+			}
+			occlusion.rasterize();
+			cpuOcclusion = &occlusion;
+		}
+		bool anyImpostors{ false };
 		for (auto& o : myScene.objects) {
-			o.render(myScene.program);
+			if (o.useImpostor(cameraPos)) {
+				anyImpostors = true;
+			}
+			else {
+				o.collect(renderQueue, sceneProgram, frustum, cpuOcclusion, culling);
+			}
+		}
+		renderQueue.submit(drawUniforms);
+		if (deferred) {
+			deferredRenderer.shade(deferredLightingProgram, perspective * camera);
+		}
+		if (anyImpostors) {
+			impostorProgram.activate();
+			impostorProgram.setUniform("directionalLight", myScene.sunDirection);
+			for (auto& o : myScene.objects) {
+				if (o.useImpostor(cameraPos)) {
+					o.getImpostor()->render(impostorProgram, o, cameraPos);
+				}
+			}
+			myScene.program.activate();
 		}
+		if (gpuCulling) {
+			gpuCulling->buildDepthPyramid(window.getSize().x, window.getSize().y, perspective * camera);
+		}
+		drawUniforms.endFrame();
 		window.display();
+
+#ifdef LOG_RENDER_STATS
+		std::cout << ShaderProgram::takeUniformLookupCount() << " uniform lookups" << std::endl;
+		std::cout << culling.tested << " bounds tested, " << culling.culled << " culled, "
+			<< culling.accepted << " accepted, " << culling.occluded << " occluded" << std::endl;
+		auto stateCalls{ RenderState::takeCounters() };
+		std::cout << stateCalls.issued << " state calls issued, " << stateCalls.skipped << " skipped" << std::endl;
+		if (!myScene.lights.empty()) {
+			std::cout << clusteredLighting.getAssignmentCount() << " light-cluster assignments" << std::endl;
+		}
+#endif
 	}
 
 	return 0;